@@ -426,6 +426,7 @@ LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
     luaC_checkGC(L);
     o = index2value(L, idx);  /* previous call may reallocate the stack */
   }
+  luaS_seal(L, tsvalue(o));  /* string must keep its ending zero */
   lua_unlock(L);
   if (len != NULL)
     return getlstr(tsvalue(o), *len);
@@ -784,6 +785,24 @@ LUA_API int lua_rawgetp (lua_State *L, int idx, const void *p) {
 }
 
 
+LUA_API void lua_rawgetn (lua_State *L, int idx, lua_Integer i, int n) {
+  Table *t;
+  StkId p;
+  int k;
+  lua_lock(L);
+  api_check(L, n >= 0 && n <= L->stack_last.p - L->top.p, "stack overflow");
+  t = gettable(L, idx);
+  for (k = 0, p = L->top.p; k < n; k++, p++) {
+    lu_byte tag;
+    luaH_fastgeti(t, l_castU2S(l_castS2U(i) + cast_uint(k)), s2v(p), tag);
+    if (tagisempty(tag))  /* avoid copying empty items to the stack */
+      setnilvalue(s2v(p));
+  }
+  L->top.p = p;
+  lua_unlock(L);
+}
+
+
 LUA_API void lua_createtable (lua_State *L, unsigned narray, unsigned nrec) {
   Table *t;
   lua_lock(L);
@@ -797,6 +816,18 @@ LUA_API void lua_createtable (lua_State *L, unsigned narray, unsigned nrec) {
 }
 
 
+LUA_API void lua_createvector (lua_State *L, int isint, unsigned size) {
+  Table *t;
+  lua_lock(L);
+  t = luaH_new(L);
+  sethvalue2s(L, L->top.p, t);
+  api_incr_top(L);
+  luaH_setvector(L, t, isint ? LUA_VNUMINT : LUA_VNUMFLT, size);
+  luaC_checkGC(L);
+  lua_unlock(L);
+}
+
+
 LUA_API int lua_getmetatable (lua_State *L, int objindex) {
   const TValue *obj;
   Table *mt;
@@ -957,6 +988,20 @@ LUA_API void lua_rawseti (lua_State *L, int idx, lua_Integer n) {
 }
 
 
+LUA_API void lua_rawmove (lua_State *L, int idx1, lua_Integer f,
+                          lua_Integer e, lua_Integer t, int idx2) {
+  Table *src, *dst;
+  lua_lock(L);
+  src = gettable(L, idx1);
+  dst = gettable(L, idx2);
+  api_check(L, e < f || ((f > 0 || e < LUA_MAXINTEGER + f) &&
+                         t <= LUA_MAXINTEGER - (e - f)), "range too large");
+  if (e >= f)
+    luaH_move(L, src, f, e - f + 1, dst, t);
+  lua_unlock(L);
+}
+
+
 LUA_API int lua_setmetatable (lua_State *L, int objindex) {
   TValue *obj;
   Table *mt;
@@ -1116,14 +1161,13 @@ LUA_API int lua_pcallk (lua_State *L, int nargs, int nresults, int errfunc,
 }
 
 
-LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
-                      const char *chunkname, const char *mode) {
+static int loadaux (lua_State *L, lua_Reader reader, void *data,
+                    const char *chunkname, const char *mode, FixedBuf *fb) {
   ZIO z;
   int status;
-  lua_lock(L);
   if (!chunkname) chunkname = "?";
   luaZ_init(L, &z, reader, data);
-  status = luaD_protectedparser(L, &z, chunkname, mode);
+  status = luaD_protectedparser(L, &z, chunkname, mode, fb);
   if (status == LUA_OK) {  /* no errors? */
     LClosure *f = clLvalue(s2v(L->top.p - 1));  /* get new function */
     if (f->nupvalues >= 1) {  /* does it have an upvalue? */
@@ -1135,6 +1179,59 @@ LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
       luaC_barrier(L, f->upvals[0], &gt);
     }
   }
+  return status;
+}
+
+
+LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
+                      const char *chunkname, const char *mode) {
+  int status;
+  lua_lock(L);
+  status = loadaux(L, reader, data, chunkname, mode, NULL);
+  lua_unlock(L);
+  return status;
+}
+
+
+typedef struct LoadFixed {
+  const char *s;
+  size_t size;
+} LoadFixed;
+
+
+static const char *getfixed (lua_State *L, void *ud, size_t *size) {
+  LoadFixed *lf = (LoadFixed *)ud;
+  UNUSED(L);
+  if (lf->size == 0) return NULL;
+  *size = lf->size;
+  lf->size = 0;
+  return lf->s;
+}
+
+
+/*
+** Load a binary chunk in place from buffer 'buff'. Parts of the chunk
+** point into the buffer, which is released through 'falloc' only when
+** nothing else refers to it.
+*/
+LUA_API int lua_loadfixed (lua_State *L, const char *buff, size_t size,
+                           const char *chunkname, lua_Alloc falloc, void *ud) {
+  LoadFixed lf;
+  FixedBuf *fb;
+  int status;
+  lua_lock(L);
+  fb = luaF_newfixedbuf(L, buff, size, falloc, ud);
+  if (l_unlikely(fb == NULL)) {  /* cannot create owner? */
+    if (falloc != NULL)
+      (*falloc)(ud, cast_voidp(buff), size, 0);  /* release buffer */
+    setsvalue2s(L, L->top.p, G(L)->memerrmsg);
+    api_incr_top(L);
+    lua_unlock(L);
+    return LUA_ERRMEM;
+  }
+  lf.s = buff; lf.size = size;
+  status = loadaux(L, getfixed, &lf, chunkname, "B", fb);
+  luaF_releasefixed(fb, NULL, 0, 0);  /* release reference from the loader */
   lua_unlock(L);
   return status;
 }
@@ -1229,11 +1326,37 @@ LUA_API int lua_gc (lua_State *L, int what, ...) {
       int param = va_arg(argp, int);
       int value = va_arg(argp, int);
       api_check(L, 0 <= param && param < LUA_GCPN, "invalid parameter");
-      res = cast_int(luaO_applyparam(g->gcparams[param], 100));
-      if (value >= 0)
-        g->gcparams[param] = luaO_codeparam(cast_uint(value));
+      if (param == LUA_GCPWORKERS) {  /* a plain number of threads */
+        res = g->gcparams[param];
+        if (value >= 0)
+          luaC_setworkers(L, value);
+      }
+      else {
+        res = cast_int(luaO_applyparam(g->gcparams[param], 100));
+        if (value >= 0)
+          g->gcparams[param] = luaO_codeparam(cast_uint(value));
+      }
+      break;
+    }
+#if defined(LUA_USE_FIELDCACHE)
+    case LUA_GCFCACHE: {
+      int reset = va_arg(argp, int);
+      lu_mem total = g->fchits + g->fcmisses;
+      /* hit rate, in percentage */
+      res = (total == 0) ? 0 : cast_int((g->fchits * 100u) / total);
+      if (reset)
+        g->fchits = g->fcmisses = 0;
+      break;
+    }
+#endif
+#if defined(LUA_USE_BGSWEEP)
+    case LUA_GCBGSWEEP: {
+      int on = va_arg(argp, int);
+      res = (g->bgsweep != NULL);
+      luaM_setbgsweep(L, on);
       break;
     }
+#endif
     default: res = -1;  /* invalid option */
   }
   va_end(argp);
@@ -1327,6 +1450,10 @@ LUA_API lua_Alloc lua_getallocf (lua_State *L, void **ud) {
 
 LUA_API void lua_setallocf (lua_State *L, lua_Alloc f, void *ud) {
   lua_lock(L);
+#if defined(LUA_USE_BGSWEEP)
+  /* free queued blocks; new function may not be thread safe */
+  luaM_setbgsweep(L, 0);
+#endif
   G(L)->ud = ud;
   G(L)->frealloc = f;
   lua_unlock(L);
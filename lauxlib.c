@@ -868,6 +868,128 @@ LUALIB_API int luaL_loadstring (lua_State *L, const char *s) {
   return luaL_loadbuffer(L, s, strlen(s), s);
 }
 
+
+/*
+** 'mapfile' gives the contents of a file in a block that lives until
+** the call to 'falloc(ud, block, size, 0)'; it returns NULL (with a
+** proper 'errno') if it fails. POSIX systems map the file; otherwise,
+** the file is read into a block from the state's allocator.
+*/
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void *unmapf (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud; (void)nsize;  /* not used */
+  munmap(ptr, osize);
+  return NULL;
+}
+
+
+static char *mapfile (lua_State *L, const char *path, size_t *size,
+                                    lua_Alloc *falloc, void **ud) {
+  struct stat st;
+  void *m = MAP_FAILED;
+  int err;
+  int fd = open(path, O_RDONLY);
+  (void)L;  /* not used */
+  if (fd < 0)
+    return NULL;
+  *falloc = unmapf; *ud = NULL;
+  if (fstat(fd, &st) == 0) {
+    *size = (size_t)st.st_size;
+    if (*size == 0) {  /* cannot map an empty file */
+      m = (void *)"";
+      *falloc = NULL;  /* nothing to release */
+    }
+    else
+      m = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  err = errno;
+  close(fd);  /* mapping does not need the descriptor */
+  errno = err;
+  return (m == MAP_FAILED) ? NULL : (char *)m;
+}
+
+#else				/* }{ */
+
+static char *mapfile (lua_State *L, const char *path, size_t *size,
+                                    lua_Alloc *falloc, void **ud) {
+  size_t n = 0;
+  size_t cap = LUAL_BUFFERSIZE;
+  char *b;
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return NULL;
+  *falloc = lua_getallocf(L, ud);
+  b = (char *)(*falloc)(*ud, NULL, 0, cap);
+  while (b != NULL && (n += fread(b + n, 1, cap - n, f)) == cap) {
+    char *nb = (char *)(*falloc)(*ud, b, cap, cap * 2);
+    if (nb == NULL)
+      (*falloc)(*ud, b, cap, 0);
+    b = nb;
+    cap *= 2;
+  }
+  if (b != NULL && ferror(f)) {
+    (*falloc)(*ud, b, cap, 0);
+    b = NULL;
+  }
+  fclose(f);
+  if (b == NULL)
+    return NULL;
+  *size = n;
+  if (n == 0) {  /* empty file? */
+    (*falloc)(*ud, b, cap, 0);
+    *falloc = NULL;  /* nothing to release */
+    return (char *)"";
+  }
+  return (char *)(*falloc)(*ud, b, cap, n);  /* shrink to its contents */
+}
+
+#endif				/* } */
+
+
+/*
+** Load a file with a binary chunk without copying it: the code and
+** the long strings of the chunk stay in the file's mapping, which
+** lives while any of them is in use. Text chunks are loaded as usual.
+*/
+LUALIB_API int luaL_loadmapped (lua_State *L, const char *path,
+                                              const char *name) {
+  size_t size;
+  lua_Alloc falloc;
+  void *ud;
+  int status;
+  char *buff;
+  if (name == NULL)  /* push name before mapping, as it may raise errors */
+    name = lua_pushfstring(L, "@%s", path);
+  else
+    name = lua_pushstring(L, name);
+  errno = 0;
+  buff = mapfile(L, path, &size, &falloc, &ud);
+  if (buff == NULL) {
+    int err = errno;
+    lua_pop(L, 1);  /* remove name */
+    if (err != 0)
+      lua_pushfstring(L, "cannot open %s: %s", path, strerror(err));
+    else
+      lua_pushfstring(L, "cannot open %s", path);
+    return LUA_ERRFILE;
+  }
+  if (size > 0 && buff[0] == LUA_SIGNATURE[0])  /* binary chunk? */
+    status = lua_loadfixed(L, buff, size, name, falloc, ud);
+  else {
+    status = luaL_loadbuffer(L, buff, size, name);
+    if (falloc != NULL)
+      (*falloc)(ud, buff, size, 0);  /* buffer not needed anymore */
+  }
+  lua_remove(L, -2);  /* remove name */
+  return status;
+}
+
 /* }====================================================== */
 
 
@@ -1169,16 +1291,326 @@ LUALIB_API unsigned int luaL_makeseed (lua_State *L) {
 }
 
 
-LUALIB_API lua_State *luaL_newstate (void) {
-  lua_State *L = lua_newstate(l_alloc, NULL, luai_makeseed());
+/*
+** {======================================================
+** Slab allocator
+** =======================================================
+*/
+
+#if defined(LUA_USE_POSIX)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+** Blocks up to SLABMAX bytes are served from pages of SLABPAGE bytes,
+** aligned to their size, each page holding blocks of only one size
+** class (multiples of SLABGRAIN). As Lua always gives the size of a
+** block when freeing it, blocks need no headers. The page of a block
+** is found by masking its address; pages keep count of their used
+** blocks, so that empty pages can be returned to the system. Larger
+** blocks go to 'realloc'/'free'.
+*/
+
+#define SLABPAGE	(64 * 1024)
+#define SLABGRAIN	16
+#define SLABMAX		256
+#define SLABNCLASS	(SLABMAX / SLABGRAIN)
+
+/* maximum number of empty pages kept between collections */
+#define SLABMAXEMPTY	16
+
+/* size class of a block of size 's' (0 < s <= SLABMAX) */
+#define slabclass(s)	(((s) - 1) / SLABGRAIN)
+
+#define slabsize(c)	(((c) + 1) * SLABGRAIN)
+
+#define slabpage(b)  \
+  ((SlabPage *)((size_t)(b) & ~((size_t)SLABPAGE - 1)))
+
+
+typedef struct SlabPage {
+  struct SlabPage *next, *prev;  /* list of pages with free blocks */
+  void *free;  /* list of free blocks in this page */
+  char *fresh;  /* first never-used block */
+  unsigned nused;  /* number of used blocks */
+  unsigned cls;  /* size class */
+  int full;  /* true iff page is not in the list of its class */
+} SlabPage;
+
+
+/*
+** Offset of the first block in a page. Rounding it to SLABGRAIN (as
+** are the sizes of all blocks) aligns all blocks to 16 bytes, which
+** is enough for LUAI_MAXALIGN and what 'malloc' ensures on most
+** systems.
+*/
+#define SLABHEAD  \
+  ((sizeof(SlabPage) + SLABGRAIN - 1) & ~((size_t)SLABGRAIN - 1))
+
+
+typedef struct SlabState {
+  SlabPage *avail[SLABNCLASS];  /* pages with free blocks, by class */
+  unsigned nempty;  /* number of empty pages */
+  void *first;  /* first block allocated (the state itself) */
+  int *pclosed;  /* set when the allocator is destroyed */
+} SlabState;
+
+
+static void slabunlink (SlabState *s, SlabPage *p) {
+  if (p->prev) p->prev->next = p->next;
+  else s->avail[p->cls] = p->next;
+  if (p->next) p->next->prev = p->prev;
+}
+
+
+static void slablink (SlabState *s, SlabPage *p) {
+  p->prev = NULL;
+  p->next = s->avail[p->cls];
+  if (p->next) p->next->prev = p;
+  s->avail[p->cls] = p;
+}
+
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+/*
+** Map 'size' bytes of fresh memory. (Without anonymous mappings, which
+** are not in older POSIX versions, map '/dev/zero'.)
+*/
+static char *slabmap (size_t size) {
+  void *m;
+#if defined(MAP_ANONYMOUS)
+  m = mmap(NULL, size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#else
+  int fd = open("/dev/zero", O_RDWR);
+  if (fd < 0)
+    return NULL;
+  m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+#endif
+  return (m == MAP_FAILED) ? NULL : (char *)m;
+}
+
+
+/*
+** Get an aligned page from the system. 'mmap' only ensures alignment
+** to the system page size, so map twice the needed space and unmap the
+** excess.
+*/
+static char *slabgetpage (void) {
+  char *m = slabmap(2 * SLABPAGE);
+  char *a;
+  if (m == NULL)
+    return NULL;
+  a = (char *)(((size_t)m + SLABPAGE - 1) & ~((size_t)SLABPAGE - 1));
+  if (a > m) munmap(m, (size_t)(a - m));
+  munmap(a + SLABPAGE, (size_t)(m + SLABPAGE - a));
+  return a;
+}
+
+#define slabputpage(p)	munmap(p, SLABPAGE)
+
+
+static SlabPage *slabnewpage (SlabState *s, unsigned c) {
+  char *a = slabgetpage();
+  SlabPage *p;
+  if (a == NULL)
+    return NULL;
+  p = (SlabPage *)a;
+  p->free = NULL;
+  p->fresh = a + SLABHEAD;
+  p->nused = 0;
+  p->cls = c;
+  p->full = 0;
+  slablink(s, p);
+  s->nempty++;
+  return p;
+}
+
+
+static void slabfreepage (SlabState *s, SlabPage *p) {
+  slabunlink(s, p);
+  s->nempty--;
+  slabputpage(p);
+}
+
+
+static void *slaballoc (SlabState *s, size_t size) {
+  unsigned c = (unsigned)slabclass(size);
+  SlabPage *p = s->avail[c];
+  void *b;
+  if (p == NULL && (p = slabnewpage(s, c)) == NULL)
+    return NULL;
+  if (p->free != NULL) {  /* reuse a freed block? */
+    b = p->free;
+    p->free = *(void **)b;
+  }
+  else {  /* use a fresh block */
+    b = p->fresh;
+    p->fresh += slabsize(c);
+  }
+  if (p->nused++ == 0)
+    s->nempty--;
+  if (p->free == NULL &&
+      p->fresh + slabsize(c) > (char *)p + SLABPAGE) {  /* page is full? */
+    slabunlink(s, p);
+    p->full = 1;
+  }
+  return b;
+}
+
+
+static void slabfree (SlabState *s, void *b) {
+  SlabPage *p = slabpage(b);
+  *(void **)b = p->free;
+  p->free = b;
+  if (p->full) {  /* page has free blocks again? */
+    p->full = 0;
+    slablink(s, p);
+  }
+  if (--p->nused == 0) {
+    s->nempty++;
+    if (s->nempty > SLABMAXEMPTY)
+      slabfreepage(s, p);
+  }
+}
+
+
+/*
+** Return all empty pages to the system.
+*/
+static void slabtrim (SlabState *s) {
+  unsigned c;
+  for (c = 0; c < SLABNCLASS; c++) {
+    SlabPage *p = s->avail[c];
+    while (p != NULL) {
+      SlabPage *next = p->next;
+      if (p->nused == 0)
+        slabfreepage(s, p);
+      p = next;
+    }
+  }
+}
+
+
+static void slabdestroy (SlabState *s) {
+  slabtrim(s);  /* all pages must be empty by now */
+  if (s->pclosed)
+    *s->pclosed = 1;
+  free(s);
+}
+
+
+/*
+** Allocation function for states using the slab allocator. The
+** allocator destroys itself when the first block it allocated (the
+** state) is freed.
+*/
+static void *l_slaballoc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  SlabState *s = (SlabState *)ud;
+  void *nb;
+  if (ptr == NULL) {
+    if (nsize == 0)
+      return NULL;
+    osize = 0;  /* 'osize' is a tag */
+  }
+  else if (nsize == 0) {  /* free */
+    if (osize > SLABMAX)
+      free(ptr);
+    else
+      slabfree(s, ptr);
+    if (ptr == s->first)
+      slabdestroy(s);
+    return NULL;
+  }
+  if (osize > SLABMAX && nsize > SLABMAX)  /* large blocks? */
+    return realloc(ptr, nsize);
+  else if (osize != 0 && nsize <= SLABMAX &&
+           slabclass(osize) == slabclass(nsize))
+    return ptr;  /* same size class */
+  nb = (nsize <= SLABMAX) ? slaballoc(s, nsize) : malloc(nsize);
+  if (nb == NULL)
+    return NULL;
+  if (ptr != NULL) {
+    memcpy(nb, ptr, (osize < nsize) ? osize : nsize);
+    if (osize > SLABMAX)
+      free(ptr);
+    else
+      slabfree(s, ptr);
+  }
+  else if (s->first == NULL)
+    s->first = nb;
+  return nb;
+}
+
+
+static lua_State *newslabstate (void) {
+  SlabState *s = (SlabState *)malloc(sizeof(SlabState));
+  int closed = 0;
+  lua_State *L;
+  if (s == NULL)
+    return NULL;
+  memset(s, 0, sizeof(SlabState));
+  s->pclosed = &closed;
+  L = lua_newstate(l_slaballoc, s, luai_makeseed());
+  if (L != NULL)
+    s->pclosed = NULL;
+  else if (!closed)  /* state was not even allocated? */
+    free(s);
+  return L;
+}
+
+#else
+
+#define newslabstate()	lua_newstate(l_alloc, NULL, luai_makeseed())
+
+#endif
+
+
+LUALIB_API int luaL_trimalloc (lua_State *L) {
+#if defined(LUA_USE_POSIX)
+  void *ud;
+  if (lua_getallocf(L, &ud) == l_slaballoc) {
+    slabtrim((SlabState *)ud);
+    return 1;
+  }
+#else
+  (void)L;
+#endif
+  return 0;
+}
+
+/* }====================================================== */
+
+
+LUALIB_API lua_State *luaL_newstatex (int opts) {
+  lua_State *L;
+  if (opts & LUAL_SLABALLOC)
+    L = newslabstate();
+  else
+    L = lua_newstate(l_alloc, NULL, luai_makeseed());
   if (l_likely(L)) {
     lua_atpanic(L, &panic);
     lua_setwarnf(L, warnfoff, L);  /* default is warnings off */
+#if defined(LUA_USE_BGSWEEP)
+    if (!(opts & LUAL_SLABALLOC))
+      lua_gc(L, LUA_GCBGSWEEP, 1);  /* 'l_alloc' is thread safe */
+#endif
   }
   return L;
 }
 
 
+LUALIB_API lua_State *luaL_newstate (void) {
+  return luaL_newstatex(0);
+}
+
+
 LUALIB_API void luaL_checkversion_ (lua_State *L, lua_Number ver, size_t sz) {
   lua_Number v = lua_version(L);
   if (sz != LUAL_NUMSIZES)  /* check numeric types */
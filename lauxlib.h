@@ -97,9 +97,17 @@ LUALIB_API int (luaL_loadfilex) (lua_State *L, const char *filename,
 LUALIB_API int (luaL_loadbufferx) (lua_State *L, const char *buff, size_t sz,
                                    const char *name, const char *mode);
 LUALIB_API int (luaL_loadstring) (lua_State *L, const char *s);
+LUALIB_API int (luaL_loadmapped) (lua_State *L, const char *path,
+                                                const char *name);
 
 LUALIB_API lua_State *(luaL_newstate) (void);
 
+/* options for 'luaL_newstatex' */
+#define LUAL_SLABALLOC	1	/* use a slab allocator */
+
+LUALIB_API lua_State *(luaL_newstatex) (int opts);
+LUALIB_API int (luaL_trimalloc) (lua_State *L);
+
 LUALIB_API unsigned luaL_makeseed (lua_State *L);
 
 LUALIB_API lua_Integer (luaL_len) (lua_State *L, int idx);
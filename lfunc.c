@@ -20,6 +20,7 @@
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 
 
@@ -260,20 +261,92 @@ Proto *luaF_newproto (lua_State *L) {
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+  f->fixedbuf = NULL;
+#if defined(LUA_USE_FIELDCACHE)
+  f->fcache = NULL;
+#endif
   return f;
 }
 
 
+#if defined(LUA_USE_FIELDCACHE)
+/*
+** Create the field cache for a prototype, after its code is complete.
+** Functions without field accesses do not need a cache. All hints
+** start pointing to the first node of a table; wrong hints are
+** harmless, as they are always checked before being used.
+*/
+void luaF_initfcache (lua_State *L, Proto *f) {
+  int i;
+  for (i = 0; i < f->sizecode; i++) {
+    OpCode op = GET_OPCODE(f->code[i]);
+    if (op == OP_GETFIELD || op == OP_SETFIELD || op == OP_SELF)
+      break;
+  }
+  if (i == f->sizecode)  /* no field accesses? */
+    return;  /* no cache */
+  f->fcache = luaM_newvector(L, cast_sizet(f->sizecode), unsigned);
+  for (i = 0; i < f->sizecode; i++)
+    f->fcache[i] = 0;
+}
+#endif
+
+
+/*
+** Create an owned fixed buffer, with one reference for the caller.
+** Returns NULL if it cannot allocate the structure.
+*/
+FixedBuf *luaF_newfixedbuf (lua_State *L, const char *buff, size_t size,
+                            lua_Alloc falloc, void *ud) {
+  global_State *g = G(L);
+  FixedBuf *fb = cast(FixedBuf *,
+                      (*g->frealloc)(g->ud, NULL, 0, sizeof(FixedBuf)));
+  if (fb != NULL) {
+    fb->buff = buff;
+    fb->size = size;
+    fb->nrefs = 1;
+    fb->falloc = falloc;
+    fb->ud = ud;
+    fb->frealloc = g->frealloc;
+    fb->fud = g->ud;
+  }
+  return fb;
+}
+
+
+/*
+** Drop a reference to a fixed buffer. It has the signature of a
+** 'lua_Alloc' so that it can also release external strings.
+*/
+void *luaF_releasefixed (void *ud, void *ptr, size_t osize, size_t nsize) {
+  FixedBuf *fb = cast(FixedBuf *, ud);
+  UNUSED(ptr); UNUSED(osize); UNUSED(nsize);
+  lua_assert(fb->nrefs > 0);
+  if (--fb->nrefs == 0) {
+    if (fb->falloc != NULL)
+      (*fb->falloc)(fb->ud, cast_voidp(fb->buff), fb->size, 0);
+    (*fb->frealloc)(fb->fud, fb, sizeof(FixedBuf), 0);
+  }
+  return NULL;
+}
+
+
 void luaF_freeproto (lua_State *L, Proto *f) {
   if (!(f->flag & PF_FIXED)) {
     luaM_freearray(L, f->code, cast_sizet(f->sizecode));
     luaM_freearray(L, f->lineinfo, cast_sizet(f->sizelineinfo));
     luaM_freearray(L, f->abslineinfo, cast_sizet(f->sizeabslineinfo));
   }
+  else if (f->fixedbuf != NULL)
+    luaF_releasefixed(f->fixedbuf, NULL, 0, 0);
   luaM_freearray(L, f->p, cast_sizet(f->sizep));
   luaM_freearray(L, f->k, cast_sizet(f->sizek));
   luaM_freearray(L, f->locvars, cast_sizet(f->sizelocvars));
   luaM_freearray(L, f->upvalues, cast_sizet(f->sizeupvalues));
+#if defined(LUA_USE_FIELDCACHE)
+  if (f->fcache != NULL)
+    luaM_freearray(L, f->fcache, cast_sizet(f->sizecode));
+#endif
   luaM_free(L, f);
 }
 
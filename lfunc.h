@@ -57,6 +57,13 @@ LUAI_FUNC void luaF_closeupval (lua_State *L, StkId level);
 LUAI_FUNC StkId luaF_close (lua_State *L, StkId level, int status, int yy);
 LUAI_FUNC void luaF_unlinkupval (UpVal *uv);
 LUAI_FUNC void luaF_freeproto (lua_State *L, Proto *f);
+LUAI_FUNC FixedBuf *luaF_newfixedbuf (lua_State *L, const char *buff,
+                                      size_t size, lua_Alloc falloc, void *ud);
+LUAI_FUNC void *luaF_releasefixed (void *ud, void *ptr, size_t osize,
+                                                        size_t nsize);
+#if defined(LUA_USE_FIELDCACHE)
+LUAI_FUNC void luaF_initfcache (lua_State *L, Proto *f);
+#endif
 LUAI_FUNC const char *luaF_getlocalname (const Proto *func, int local_number,
                                          int pc);
 
@@ -11,6 +11,10 @@
 
 #include <string.h>
 
+#if defined(LUA_USE_PARALLELMARK)
+#include <pthread.h>
+#endif
+
 
 #include "lua.h"
 
@@ -717,6 +721,442 @@ static l_obj convergeephemerons (global_State *g) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** Parallel marking
+** =======================================================
+*/
+
+#if defined(LUA_USE_PARALLELMARK)
+
+/*
+** With LUA_USE_PARALLELMARK, the propagations of the atomic phase
+** share the traversal of gray objects with LUA_GCPWORKERS helper
+** threads. (The mutator is stopped in the atomic phase, so marking
+** races only with marking.) Each worker has its own gray list, linked
+** through the 'gclist' fields, as an object belongs to the worker that
+** turned it gray; an object goes from white to gray with an atomic
+** compare-and-swap, so it gets only one owner. A worker with a long
+** gray list gives half of it to a shared pool when other workers are
+** idle. Objects whose traversal changes the collector's lists are not
+** traversed by the workers, but handed back to the main thread: these
+** are threads, tables that may be weak (their metatables do not have
+** '__mode' cached as absent), and tables and userdata that are not new
+** (which only happens while a generational collector does a major
+** collection). Ephemeron convergence and the clearing of weak tables
+** are always sequential.
+*/
+
+
+/* number of objects a worker takes from the pool at once */
+#define GCPARBATCH	64
+
+/* number of sequential traversals before starting the workers */
+#define GCPARSTART	128
+
+
+#define atomload(x)	__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define atomstore(x,v)	__atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+
+typedef struct GCWorker {
+  GCObject *gray;  /* list of gray objects owned by this worker */
+  GCObject *deferred;  /* objects left to the main thread */
+  l_obj ngray;  /* length of list 'gray' */
+  l_obj marked;  /* number of objects marked by this worker */
+  l_obj work;  /* number of objects traversed by this worker */
+  struct GCWorkers *P;
+  pthread_t thread;
+} GCWorker;
+
+
+typedef struct GCWorkers {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;  /* new round, new work in the pool, or end of round */
+  pthread_cond_t done;  /* a helper finished its round */
+  GCObject *pool;  /* shared gray objects */
+  l_obj npool;  /* length of list 'pool' */
+  int nw;  /* number of workers (helpers plus the main thread) */
+  int size;  /* number of entries in 'w' */
+  int nidle;  /* workers without work in the current round */
+  int ndone;  /* helpers that finished the current round */
+  int round;  /* counter of rounds */
+  int stop;  /* true to terminate the helpers */
+  GCWorker w[1];  /* 'w[0]' is the main thread */
+} GCWorkers;
+
+
+#define sizeworkers(n)  \
+	(offsetof(GCWorkers, w) + cast_sizet(n) * sizeof(GCWorker))
+
+
+/*
+** Try to turn a white object gray. Returns true iff it succeeded,
+** which makes the calling worker the owner of the object.
+*/
+static int parclaim (GCObject *o) {
+  lu_byte old = atomload(o->marked);
+  do {
+    if (!(old & WHITEBITS))  /* already gray or black? */
+      return 0;
+  } while (!__atomic_compare_exchange_n(&o->marked, &old,
+                cast_byte(old & ~maskcolors), 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return 1;
+}
+
+
+#define parblack(o)  cast_void(__atomic_fetch_or(&(o)->marked, \
+                                  bitmask(BLACKBIT), __ATOMIC_RELAXED))
+
+
+/* link object 'o' into list 'l' of a worker */
+#define parlink(o,l)	{ *getgclist(o) = (l); (l) = (o); }
+
+
+/*
+** Mark an object, as 'reallymarkobject' does; objects with something
+** to be traversed go to the worker's gray list.
+*/
+static void parmark (GCWorker *w, GCObject *o) {
+  if (!parclaim(o))
+    return;
+  w->marked++;
+  switch (o->tt) {
+    case LUA_VSHRSTR:
+    case LUA_VLNGSTR: {
+      parblack(o);  /* nothing to visit */
+      break;
+    }
+    case LUA_VUPVAL: {
+      UpVal *uv = gco2upv(o);
+      if (!upisopen(uv))  /* open upvalues are kept gray */
+        parblack(o);
+      if (iscollectable(uv->v.p))
+        parmark(w, gcvalue(uv->v.p));
+      break;
+    }
+    case LUA_VUSERDATA: {
+      Udata *u = gco2u(o);
+      if (u->nuvalue == 0) {  /* no user values? */
+        if (u->metatable)
+          parmark(w, obj2gco(u->metatable));
+        parblack(o);  /* nothing else to mark */
+        break;
+      }
+      /* else... */
+    }  /* FALLTHROUGH */
+    default: {
+      parlink(o, w->gray);  /* to be visited later */
+      w->ngray++;
+      break;
+    }
+  }
+}
+
+
+#define parmarkvalue(w,v)  \
+	{ if (iscollectable(v)) parmark(w, gcvalue(v)); }
+
+#define parmarkobjectN(w,t)	{ if (t) parmark(w, obj2gco(t)); }
+
+
+/*
+** Traverse a gray object owned by worker 'w', turning it black.
+** Returns false if the object must be traversed by the main thread.
+*/
+static int partraverse (GCWorker *w, GCObject *o) {
+  int i;
+  switch (o->tt) {
+    case LUA_VTABLE: {
+      Table *h = gco2t(o);
+      Table *mt = h->metatable;
+      Node *n, *limit = gnodelast(h);
+      unsigned asize = luaH_realasize(h);
+      unsigned k;
+      if ((atomload(o->marked) & AGEBITS) != G_NEW || !checknoTM(mt, TM_MODE))
+        return 0;  /* not new, or it may be weak */
+      parblack(o);
+      parmarkobjectN(w, mt);
+      for (k = 0; k < asize; k++) {
+        GCObject *v = gcvalarr(h, k);
+        if (v != NULL)
+          parmark(w, v);
+      }
+      for (n = gnode(h, 0); n < limit; n++) {
+        if (isempty(gval(n)))  /* entry is empty? */
+          clearkey(n);  /* clear its key */
+        else {
+          if (keyiscollectable(n))
+            parmark(w, gckey(n));
+          parmarkvalue(w, gval(n));
+        }
+      }
+      return 1;
+    }
+    case LUA_VUSERDATA: {
+      Udata *u = gco2u(o);
+      if ((atomload(o->marked) & AGEBITS) != G_NEW)
+        return 0;
+      parblack(o);
+      parmarkobjectN(w, u->metatable);
+      for (i = 0; i < u->nuvalue; i++)
+        parmarkvalue(w, &u->uv[i].uv);
+      return 1;
+    }
+    case LUA_VLCL: {
+      LClosure *cl = gco2lcl(o);
+      parblack(o);
+      parmarkobjectN(w, cl->p);
+      for (i = 0; i < cl->nupvalues; i++)
+        parmarkobjectN(w, cl->upvals[i]);
+      return 1;
+    }
+    case LUA_VCCL: {
+      CClosure *cl = gco2ccl(o);
+      parblack(o);
+      for (i = 0; i < cl->nupvalues; i++)
+        parmarkvalue(w, &cl->upvalue[i]);
+      return 1;
+    }
+    case LUA_VPROTO: {
+      Proto *f = gco2p(o);
+      parblack(o);
+      parmarkobjectN(w, f->source);
+      for (i = 0; i < f->sizek; i++)
+        parmarkvalue(w, &f->k[i]);
+      for (i = 0; i < f->sizeupvalues; i++)
+        parmarkobjectN(w, f->upvalues[i].name);
+      for (i = 0; i < f->sizep; i++)
+        parmarkobjectN(w, f->p[i]);
+      for (i = 0; i < f->sizelocvars; i++)
+        parmarkobjectN(w, f->locvars[i].varname);
+      return 1;
+    }
+    default: return 0;  /* threads */
+  }
+}
+
+
+/*
+** Move the first 'n' objects from list 'from' to list 'to'.
+*/
+static void parmove (GCObject **from, GCObject **to, l_obj n) {
+  GCObject *first = *from;
+  GCObject *last = first;
+  lua_assert(n > 0);
+  while (--n > 0)
+    last = *getgclist(last);
+  *from = *getgclist(last);
+  *getgclist(last) = *to;
+  *to = first;
+}
+
+
+/*
+** Give half of the gray list of worker 'w' to the pool.
+*/
+static void pardonate (GCWorkers *P, GCWorker *w) {
+  l_obj n = w->ngray / 2;
+  pthread_mutex_lock(&P->lock);
+  parmove(&w->gray, &P->pool, n);
+  w->ngray -= n;
+  atomstore(P->npool, P->npool + n);
+  pthread_cond_broadcast(&P->wake);
+  pthread_mutex_unlock(&P->lock);
+}
+
+
+/*
+** Work of one worker in a round: traverse its gray objects and then
+** get more from the pool, until all workers are idle.
+*/
+static void parwork (GCWorkers *P, GCWorker *w) {
+  for (;;) {
+    l_obj n;
+    while (w->gray != NULL) {
+      GCObject *o = w->gray;
+      w->gray = *getgclist(o);
+      w->ngray--;
+      if (partraverse(w, o))
+        w->work++;
+      else
+        parlink(o, w->deferred);  /* leave it to the main thread */
+      if (w->ngray > 1 && atomload(P->nidle) > 0 && atomload(P->npool) == 0)
+        pardonate(P, w);  /* share work with idle workers */
+    }
+    pthread_mutex_lock(&P->lock);
+    if (P->npool == 0) {  /* no more work available? */
+      atomstore(P->nidle, P->nidle + 1);
+      if (P->nidle == P->nw)  /* all workers idle? */
+        pthread_cond_broadcast(&P->wake);  /* round is over */
+      while (P->npool == 0 && P->nidle < P->nw)
+        pthread_cond_wait(&P->wake, &P->lock);
+      if (P->npool == 0) {  /* round is over? */
+        pthread_mutex_unlock(&P->lock);
+        return;
+      }
+      atomstore(P->nidle, P->nidle - 1);
+    }
+    n = (P->npool < GCPARBATCH) ? P->npool : GCPARBATCH;
+    parmove(&P->pool, &w->gray, n);
+    w->ngray += n;
+    atomstore(P->npool, P->npool - n);
+    pthread_mutex_unlock(&P->lock);
+  }
+}
+
+
+static void *parhelper (void *ud) {
+  GCWorker *w = cast(GCWorker *, ud);
+  GCWorkers *P = w->P;
+  int round = 0;
+  pthread_mutex_lock(&P->lock);
+  for (;;) {
+    while (P->round == round && !P->stop)
+      pthread_cond_wait(&P->wake, &P->lock);
+    if (P->stop)
+      break;
+    round = P->round;
+    pthread_mutex_unlock(&P->lock);
+    parwork(P, w);
+    pthread_mutex_lock(&P->lock);
+    P->ndone++;
+    pthread_cond_signal(&P->done);
+  }
+  pthread_mutex_unlock(&P->lock);
+  return NULL;
+}
+
+
+/*
+** Traverse all objects in the 'gray' list (and all objects they
+** reach) using all workers. Then traverse sequentially the objects
+** left by the workers, which may leave new objects in the 'gray' list.
+*/
+static l_obj parround (global_State *g) {
+  GCWorkers *P = g->workers;
+  GCObject *o;
+  l_obj work = 0;
+  int i;
+  P->w[0].gray = g->gray;
+  for (o = g->gray; o != NULL; o = *getgclist(o))
+    P->w[0].ngray++;
+  g->gray = NULL;
+  pthread_mutex_lock(&P->lock);
+  P->nidle = P->ndone = 0;
+  P->round++;
+  pthread_cond_broadcast(&P->wake);  /* start helpers */
+  pthread_mutex_unlock(&P->lock);
+  parwork(P, &P->w[0]);
+  pthread_mutex_lock(&P->lock);
+  while (P->ndone < P->nw - 1)  /* wait for all helpers */
+    pthread_cond_wait(&P->done, &P->lock);
+  pthread_mutex_unlock(&P->lock);
+  for (i = 0; i < P->nw; i++) {
+    GCWorker *w = &P->w[i];
+    lua_assert(w->gray == NULL && w->ngray == 0);
+    g->marked += w->marked;
+    work += w->work;
+    w->marked = w->work = 0;
+    while ((o = w->deferred) != NULL) {
+      w->deferred = *getgclist(o);
+      parlink(o, g->gray);  /* it is already gray */
+      propagatemark(g);  /* traverse it */
+      work++;
+    }
+  }
+  return work;
+}
+
+
+/*
+** Propagate marks through the 'gray' list, using the helper threads
+** when there are enough objects.
+*/
+static l_obj propagateallpar (global_State *g) {
+  l_obj work = 0;
+  if (g->workers == NULL)
+    return propagateall(g);
+  while (g->gray != NULL) {
+    int i;
+    for (i = 0; g->gray != NULL && i < GCPARSTART; i++) {
+      propagatemark(g);
+      work++;
+    }
+    if (g->gray != NULL)
+      work += parround(g);
+  }
+  return work;
+}
+
+
+static void freeworkers (lua_State *L, GCWorkers *P) {
+  int i;
+  pthread_mutex_lock(&P->lock);
+  P->stop = 1;
+  pthread_cond_broadcast(&P->wake);
+  pthread_mutex_unlock(&P->lock);
+  for (i = 1; i < P->nw; i++)
+    pthread_join(P->w[i].thread, NULL);
+  pthread_cond_destroy(&P->done);
+  pthread_cond_destroy(&P->wake);
+  pthread_mutex_destroy(&P->lock);
+  luaM_freemem(L, P, sizeworkers(P->size));
+}
+
+
+/*
+** Set the number of helper threads for marking. The parameter keeps
+** the number of threads actually created.
+*/
+void luaC_setworkers (lua_State *L, int n) {
+  global_State *g = G(L);
+  if (g->workers != NULL) {
+    freeworkers(L, g->workers);
+    g->workers = NULL;
+  }
+  if (n > LUAI_MAXGCWORKERS)
+    n = LUAI_MAXGCWORKERS;
+  if (n > 0) {
+    GCWorkers *P = cast(GCWorkers *, luaM_malloc_(L, sizeworkers(n + 1), 0));
+    int i;
+    memset(P, 0, sizeworkers(n + 1));
+    P->size = n + 1;
+    P->nw = 1;  /* main thread */
+    P->w[0].P = P;
+    pthread_mutex_init(&P->lock, NULL);
+    pthread_cond_init(&P->wake, NULL);
+    pthread_cond_init(&P->done, NULL);
+    for (i = 1; i <= n; i++) {
+      P->w[i].P = P;
+      if (pthread_create(&P->w[i].thread, NULL, parhelper, &P->w[i]) != 0)
+        break;  /* keep the helpers already created */
+      P->nw++;
+    }
+    if (P->nw > 1)
+      g->workers = P;
+    else
+      freeworkers(L, P);
+  }
+  g->gcparams[LUA_GCPWORKERS] =
+      cast_byte(g->workers == NULL ? 0 : g->workers->nw - 1);
+}
+
+#else
+
+#define propagateallpar(g)	propagateall(g)
+
+void luaC_setworkers (lua_State *L, int n) {
+  UNUSED(n);
+  G(L)->gcparams[LUA_GCPWORKERS] = 0;  /* no parallel marking */
+}
+
+#endif
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** Sweep Functions
@@ -820,6 +1260,10 @@ static void freeobj (lua_State *L, GCObject *o) {
       TString *ts = gco2ts(o);
       if (ts->shrlen == LSTRMEM)  /* must free external string? */
         (*ts->falloc)(ts->ud, ts->contents, ts->u.lnglen + 1, 0);
+#if defined(LUA_USE_CONCATBUF)
+      else if (ts->shrlen == LSTRBUF)  /* string in a buffer? */
+        luaS_freebuf(L, ts);
+#endif
       luaM_freemem(L, ts, luaS_sizelngstr(ts->u.lnglen, ts->shrlen));
       break;
     }
@@ -828,6 +1272,24 @@ static void freeobj (lua_State *L, GCObject *o) {
 }
 
 
+/*
+** Free a dead object found by a sweep. With background sweeping,
+** its memory blocks go to the background thread, except in emergency
+** collections, whose callers need the memory right away.
+*/
+#if defined(LUA_USE_BGSWEEP)
+static void sweepfree (lua_State *L, GCObject *o) {
+  global_State *g = G(L);
+  if (!g->gcemergency)
+    g->bgdefer = g->bgsweep;
+  freeobj(L, o);
+  g->bgdefer = NULL;
+}
+#else
+#define sweepfree(L,o)	freeobj(L,o)
+#endif
+
+
 /*
 ** sweep at most 'countin' elements from a list of GCObjects erasing dead
 ** objects, where a dead object is one marked with the old (non current)
@@ -845,7 +1307,7 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, l_obj countin) {
     int marked = curr->marked;
     if (isdeadm(ow, marked)) {  /* is 'curr' dead? */
       *p = curr->next;  /* remove 'curr' from list */
-      freeobj(L, curr);  /* erase 'curr' */
+      sweepfree(L, curr);  /* erase 'curr' */
     }
     else {  /* change mark to 'white' and age to 'new' */
       curr->marked = cast_byte((marked & ~maskgcbits) | white | G_NEW);
@@ -877,9 +1339,13 @@ static GCObject **sweeptolive (lua_State *L, GCObject **p) {
 */
 
 /*
-** If possible, shrink string table.
+** Called at the end of a sweep: hand pending frees to the background
+** thread (if any) and, if possible, shrink string table.
 */
 static void checkSizes (lua_State *L, global_State *g) {
+#if defined(LUA_USE_BGSWEEP)
+  luaM_flushbgsweep(L);
+#endif
   if (!g->gcemergency) {
     if (g->strt.nuse < g->strt.size / 4)  /* string table too big? */
       luaS_resize(L, g->strt.size / 2);
@@ -1072,7 +1538,7 @@ static void sweep2old (lua_State *L, GCObject **p) {
     if (iswhite(curr)) {  /* is 'curr' dead? */
       lua_assert(isdead(g, curr));
       *p = curr->next;  /* remove 'curr' from list */
-      freeobj(L, curr);  /* erase 'curr' */
+      sweepfree(L, curr);  /* erase 'curr' */
     }
     else {  /* all surviving objects become old */
       setage(curr, G_OLD);
@@ -1120,7 +1586,7 @@ static GCObject **sweepgen (lua_State *L, global_State *g, GCObject **p,
     if (iswhite(curr)) {  /* is 'curr' dead? */
       lua_assert(!isold(curr) && isdead(g, curr));
       *p = curr->next;  /* remove 'curr' from list */
-      freeobj(L, curr);  /* erase 'curr' */
+      sweepfree(L, curr);  /* erase 'curr' */
     }
     else {  /* correct mark and age */
       int age = getage(curr);
@@ -1463,6 +1929,9 @@ static void deletelist (lua_State *L, GCObject *p, GCObject *limit) {
 void luaC_freeallobjects (lua_State *L) {
   global_State *g = G(L);
   g->gcstp = GCSTPCLS;  /* no extra finalizers after here */
+#if defined(LUA_USE_BGSWEEP)
+  luaM_setbgsweep(L, 0);  /* free everything here */
+#endif
   luaC_changemode(L, KGC_INC);
   separatetobefnz(g, 1);  /* separate all objects with finalizers */
   lua_assert(g->finobj == NULL);
@@ -1471,6 +1940,7 @@ void luaC_freeallobjects (lua_State *L) {
   lua_assert(g->finobj == NULL);  /* no new finalizers */
   deletelist(L, g->fixedgc, NULL);  /* collect fixed objects */
   lua_assert(g->strt.nuse == 0);
+  luaC_setworkers(L, 0);  /* stop helper threads */
 }
 
 
@@ -1487,12 +1957,12 @@ static l_obj atomic (lua_State *L) {
   /* registry and global metatables may be changed by API */
   markvalue(g, &g->l_registry);
   markmt(g);  /* mark global metatables */
-  work += propagateall(g);  /* empties 'gray' list */
+  work += propagateallpar(g);  /* empties 'gray' list */
   /* remark occasional upvalues of (maybe) dead threads */
   work += remarkupvals(g);
-  work += propagateall(g);  /* propagate changes */
+  work += propagateallpar(g);  /* propagate changes */
   g->gray = grayagain;
-  work += propagateall(g);  /* traverse 'grayagain' list */
+  work += propagateallpar(g);  /* traverse 'grayagain' list */
   work += convergeephemerons(g);
   /* at this point, all strongly accessible objects are marked. */
   /* Clear values from weak tables, before checking finalizers */
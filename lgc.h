@@ -193,6 +193,12 @@
 #define LUAI_GCSTEPSIZE	250
 
 
+/* parallel marking */
+
+/* Maximum number of helper threads for marking */
+#define LUAI_MAXGCWORKERS	64
+
+
 #define setgcparam(g,p,v)  (g->gcparams[LUA_GCP##p] = luaO_codeparam(v))
 #define applygcparam(g,p,x)  luaO_applyparam(g->gcparams[LUA_GCP##p], x)
 
@@ -252,6 +258,7 @@ LUAI_FUNC void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v);
 LUAI_FUNC void luaC_barrierback_ (lua_State *L, GCObject *o);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUAI_FUNC void luaC_changemode (lua_State *L, int newmode);
+LUAI_FUNC void luaC_setworkers (lua_State *L, int n);
 
 
 #endif
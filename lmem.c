@@ -12,6 +12,10 @@
 
 #include <stddef.h>
 
+#if defined(LUA_USE_BGSWEEP)
+#include <pthread.h>
+#endif
+
 #include "lua.h"
 
 #include "ldebug.h"
@@ -144,12 +148,211 @@ l_noret luaM_toobig (lua_State *L) {
 }
 
 
+/*
+** {==================================================================
+** Background sweeping
+** ===================================================================
+*/
+
+#if defined(LUA_USE_BGSWEEP)
+
+/*
+** With LUA_USE_BGSWEEP, the collector can leave the calls that free
+** the memory of dead objects to another thread. While sweeping, the
+** collector still does all its bookkeeping of a dead object (removing
+** it from the string table, unlinking it from its lists, updating
+** 'totalbytes'), but the blocks it frees are queued in batches that
+** are freed by a background thread. If that thread falls behind and
+** there are no free batches, blocks are freed right away. Emergency
+** collections free blocks right away, too, and then wait for the
+** queued ones, so that the failed allocation can use them. This only
+** works with allocation functions that can be called from another
+** thread, so the host must ask for it (LUA_GCBGSWEEP). Changing the
+** allocation function ('lua_setallocf') turns it off.
+*/
+
+/* number of batches */
+#define BGNBATCH	8
+
+/* number of blocks in a batch */
+#define BGBATCHSIZE	256
+
+
+typedef struct BGBatch {
+  lua_Alloc f;  /* function to free the blocks */
+  void *ud;  /* its user data */
+  int n;  /* number of blocks in the batch */
+  struct {
+    void *block;
+    size_t osize;
+  } b[BGBATCHSIZE];
+} BGBatch;
+
+
+typedef struct BGSweep {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;  /* signals new full batches and 'stop' */
+  pthread_cond_t done;  /* signals batches freed */
+  pthread_t thread;
+  BGBatch *cur;  /* batch being filled (owned by the Lua thread) */
+  BGBatch *full[BGNBATCH];  /* batches to be freed */
+  BGBatch *empty[BGNBATCH];  /* free batches */
+  int nfull;
+  int nempty;
+  int stop;  /* true when the thread must finish */
+  BGBatch batches[BGNBATCH];
+} BGSweep;
+
+
+static void *bgsweeper (void *ud) {
+  BGSweep *bg = cast(BGSweep *, ud);
+  pthread_mutex_lock(&bg->lock);
+  for (;;) {
+    BGBatch *b;
+    int i;
+    while (bg->nfull == 0 && !bg->stop)
+      pthread_cond_wait(&bg->cond, &bg->lock);
+    if (bg->nfull == 0)  /* stopped with nothing left to free? */
+      break;
+    b = bg->full[--bg->nfull];
+    pthread_mutex_unlock(&bg->lock);
+    for (i = 0; i < b->n; i++)
+      (*b->f)(b->ud, b->b[i].block, b->b[i].osize, 0);
+    pthread_mutex_lock(&bg->lock);
+    bg->empty[bg->nempty++] = b;
+    pthread_cond_signal(&bg->done);
+  }
+  pthread_mutex_unlock(&bg->lock);
+  return NULL;
+}
+
+
+/*
+** Hand the current batch to the background thread.
+*/
+static void bgsubmit (BGSweep *bg) {
+  if (bg->cur != NULL) {
+    pthread_mutex_lock(&bg->lock);
+    bg->full[bg->nfull++] = bg->cur;
+    pthread_cond_signal(&bg->cond);
+    pthread_mutex_unlock(&bg->lock);
+    bg->cur = NULL;
+  }
+}
+
+
+/*
+** Queue a block to be freed by the background thread. Returns false
+** if there is no room for it.
+*/
+static int bgdelay (global_State *g, void *block, size_t osize) {
+  BGSweep *bg = g->bgdefer;
+  BGBatch *b = bg->cur;
+  lua_assert(b == NULL || (b->f == g->frealloc && b->ud == g->ud));
+  if (b == NULL) {
+    pthread_mutex_lock(&bg->lock);
+    if (bg->nempty > 0)
+      b = bg->empty[--bg->nempty];
+    pthread_mutex_unlock(&bg->lock);
+    if (b == NULL)  /* all batches in use? */
+      return 0;
+    b->f = g->frealloc;
+    b->ud = g->ud;
+    b->n = 0;
+    bg->cur = b;
+  }
+  b->b[b->n].block = block;
+  b->b[b->n].osize = osize;
+  if (++b->n == BGBATCHSIZE)
+    bgsubmit(bg);
+  return 1;
+}
+
+
+/*
+** Wait until the background thread has freed all queued blocks.
+*/
+static void bgwait (BGSweep *bg) {
+  bgsubmit(bg);
+  pthread_mutex_lock(&bg->lock);
+  while (bg->nempty < BGNBATCH)
+    pthread_cond_wait(&bg->done, &bg->lock);
+  pthread_mutex_unlock(&bg->lock);
+}
+
+
+/*
+** Called at the end of a sweep, so that frees do not wait for the next
+** sweep to fill the current batch.
+*/
+void luaM_flushbgsweep (lua_State *L) {
+  global_State *g = G(L);
+  if (g->bgsweep != NULL)
+    bgsubmit(g->bgsweep);
+}
+
+
+/*
+** Start or stop the background thread. Stopping it waits until all
+** queued blocks are freed. Failures to start it are silent: the state
+** just keeps freeing memory by itself.
+*/
+void luaM_setbgsweep (lua_State *L, int on) {
+  global_State *g = G(L);
+  BGSweep *bg = g->bgsweep;
+  if (!on && bg != NULL) {
+    g->bgsweep = g->bgdefer = NULL;
+    bgsubmit(bg);
+    pthread_mutex_lock(&bg->lock);
+    bg->stop = 1;
+    pthread_cond_signal(&bg->cond);
+    pthread_mutex_unlock(&bg->lock);
+    pthread_join(bg->thread, NULL);
+    pthread_cond_destroy(&bg->done);
+    pthread_cond_destroy(&bg->cond);
+    pthread_mutex_destroy(&bg->lock);
+    callfrealloc(g, bg, sizeof(BGSweep), 0);
+    g->totalbytes -= sizeof(BGSweep);
+  }
+  else if (on && bg == NULL) {
+    int i;
+    bg = cast(BGSweep *, callfrealloc(g, NULL, 0, sizeof(BGSweep)));
+    if (bg == NULL)
+      return;  /* no memory */
+    bg->cur = NULL;
+    bg->nfull = bg->stop = 0;
+    bg->nempty = BGNBATCH;
+    for (i = 0; i < BGNBATCH; i++)
+      bg->empty[i] = &bg->batches[i];
+    pthread_mutex_init(&bg->lock, NULL);
+    pthread_cond_init(&bg->cond, NULL);
+    pthread_cond_init(&bg->done, NULL);
+    if (pthread_create(&bg->thread, NULL, bgsweeper, bg) != 0) {
+      pthread_cond_destroy(&bg->done);
+      pthread_cond_destroy(&bg->cond);
+      pthread_mutex_destroy(&bg->lock);
+      callfrealloc(g, bg, sizeof(BGSweep), 0);
+      return;  /* cannot create the thread */
+    }
+    g->totalbytes += sizeof(BGSweep);
+    g->bgsweep = bg;
+  }
+}
+
+#endif
+
+/* }================================================================== */
+
+
 /*
 ** Free memory
 */
 void luaM_free_ (lua_State *L, void *block, size_t osize) {
   global_State *g = G(L);
   lua_assert((osize == 0) == (block == NULL));
+#if defined(LUA_USE_BGSWEEP)
+  if (g->bgdefer == NULL || block == NULL || !bgdelay(g, block, osize))
+#endif
   callfrealloc(g, block, osize, 0);
   g->totalbytes -= osize;
 }
@@ -164,6 +367,10 @@ static void *tryagain (lua_State *L, void *block,
   global_State *g = G(L);
   if (cantryagain(g)) {
     luaC_fullgc(L, 1);  /* try to free some memory... */
+#if defined(LUA_USE_BGSWEEP)
+    if (g->bgsweep != NULL)  /* ...including blocks queued before */
+      bgwait(g->bgsweep);
+#endif
     return callfrealloc(g, block, osize, nsize);  /* try again */
   }
   else return NULL;  /* cannot run an emergency collection */
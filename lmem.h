@@ -84,6 +84,10 @@ LUAI_FUNC void *luaM_realloc_ (lua_State *L, void *block, size_t oldsize,
 LUAI_FUNC void *luaM_saferealloc_ (lua_State *L, void *block, size_t oldsize,
                                                               size_t size);
 LUAI_FUNC void luaM_free_ (lua_State *L, void *block, size_t osize);
+#if defined(LUA_USE_BGSWEEP)
+LUAI_FUNC void luaM_setbgsweep (lua_State *L, int on);
+LUAI_FUNC void luaM_flushbgsweep (lua_State *L);
+#endif
 LUAI_FUNC void *luaM_growaux_ (lua_State *L, void *block, int nelems,
                                int *size, unsigned size_elem, int limit,
                                const char *what);
@@ -401,6 +401,279 @@ static int ll_loadlib (lua_State *L) {
 
 
 
+/*
+** {======================================================
+** Bytecode cache
+** When 'package.bytecodecache' is a directory name, the Lua searcher
+** keeps there the dump of each module it loads, in a file named after
+** a hash of the module's path. The cached dump is used only while the
+** source keeps the same size, modification time, and contents. (Cached
+** files are loaded as binary chunks without further checks, so the
+** directory must be private to its users.)
+** =======================================================
+*/
+
+#if defined(LUA_USE_POSIX)
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define l_bcmtime(fname,m)  \
+  { struct stat st_; if (stat(fname, &st_) == 0) m = (l_uint32)st_.st_mtime; }
+#define l_bcpid()	((lua_Integer)getpid())
+
+#else
+
+#include <time.h>
+
+#define l_bcmtime(fname,m)	((void)0)  /* no modification time */
+#define l_bcpid()	((lua_Integer)clock())  /* best effort */
+
+#endif
+
+
+/* key in the registry for the userdata with the cache counters */
+static const char *const BCSTATS = "_BCSTATS";
+
+#define BCMAGIC		"\x1bLuaBC1"
+
+
+typedef struct BCStats {
+  lua_Integer hits;
+  lua_Integer misses;
+} BCStats;
+
+
+/*
+** Header of a cache file; it is followed by the name of the source
+** file and by the dump.
+*/
+typedef struct BCHeader {
+  char magic[sizeof(BCMAGIC)];
+  l_uint32 size;  /* size of the source file */
+  l_uint32 mtime;  /* modification time of the source file */
+  l_uint32 hash;  /* hash of the contents of the source file */
+  size_t namelen;  /* length of the name of the source file */
+} BCHeader;
+
+
+typedef struct BCReader {
+  FILE *f;
+  char buff[BUFSIZ];
+} BCReader;
+
+
+/* FNV-1a hash */
+static l_uint32 bchash (l_uint32 h, const char *s, size_t l) {
+  for (; l > 0; l--)
+    h = (h ^ cast_byte(*(s++))) * 16777619u;
+  return h;
+}
+
+#define BCSEED		2166136261u
+
+
+static BCStats *getbcstats (lua_State *L) {
+  BCStats *st;
+  lua_getfield(L, LUA_REGISTRYINDEX, BCSTATS);
+  st = (BCStats *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return st;
+}
+
+
+/*
+** Fill the header for source file 'filename'. Returns 0 if the file
+** cannot be read.
+*/
+static int bcstamp (const char *filename, BCHeader *h) {
+  BCReader rd;
+  size_t n;
+  int err;
+  memset(h, 0, sizeof(BCHeader));  /* also clears padding */
+  memcpy(h->magic, BCMAGIC, sizeof(BCMAGIC));
+  h->hash = BCSEED;
+  h->namelen = strlen(filename);
+  rd.f = fopen(filename, "rb");
+  if (rd.f == NULL) return 0;
+  do {
+    n = fread(rd.buff, 1, sizeof(rd.buff), rd.f);
+    h->hash = bchash(h->hash, rd.buff, n);
+    h->size += (l_uint32)n;
+  } while (n == sizeof(rd.buff));
+  err = ferror(rd.f);
+  fclose(rd.f);
+  l_bcmtime(filename, h->mtime);
+  return !err;
+}
+
+
+/*
+** Push the name of the cache file for 'filename' in directory 'dir'.
+*/
+static const char *bcname (lua_State *L, const char *filename,
+                                         const char *dir) {
+  char key[2 * sizeof(l_uint32) + 1];
+  l_uint32 h = bchash(BCSEED, filename, strlen(filename));
+  int i;
+  for (i = cast_int(sizeof(key)) - 2; i >= 0; i--, h >>= 4)
+    key[i] = "0123456789abcdef"[h & 0xf];
+  key[sizeof(key) - 1] = '\0';
+  return lua_pushfstring(L, "%s" LUA_DIRSEP "%s.luac", dir, key);
+}
+
+
+static const char *bcreader (lua_State *L, void *ud, size_t *size) {
+  BCReader *rd = (BCReader *)ud;
+  (void)L;  /* not used */
+  if (feof(rd->f)) return NULL;
+  *size = fread(rd->buff, 1, sizeof(rd->buff), rd->f);
+  return rd->buff;
+}
+
+
+static int bcsamename (BCReader *rd, const char *name, size_t len) {
+  while (len > 0) {
+    size_t n = (len < sizeof(rd->buff)) ? len : sizeof(rd->buff);
+    if (fread(rd->buff, 1, n, rd->f) != n || memcmp(rd->buff, name, n) != 0)
+      return 0;
+    name += n; len -= n;
+  }
+  return 1;
+}
+
+
+/*
+** Try to load 'filename' from cache file 'cname'. If it succeeds,
+** pushes the loaded function; otherwise, pushes nothing.
+*/
+static int bcread (lua_State *L, const char *cname, const char *filename,
+                                 const BCHeader *h) {
+  BCReader rd;
+  BCHeader ch;
+  int status;
+  rd.f = fopen(cname, "rb");
+  if (rd.f == NULL) return LUA_ERRFILE;
+  if (fread(&ch, sizeof(ch), 1, rd.f) != 1 ||
+      memcmp(&ch, h, sizeof(ch)) != 0 ||  /* stale entry? */
+      !bcsamename(&rd, filename, h->namelen)) {  /* hash collision? */
+    fclose(rd.f);
+    return LUA_ERRFILE;
+  }
+  lua_pushfstring(L, "@%s", filename);
+  status = lua_load(L, bcreader, &rd, lua_tostring(L, -1), "b");
+  if (ferror(rd.f) && status == LUA_OK) {
+    lua_pop(L, 1);  /* discard function */
+    lua_pushnil(L);  /* placeholder for error */
+    status = LUA_ERRFILE;
+  }
+  fclose(rd.f);
+  lua_remove(L, -2);  /* remove chunk name */
+  if (status != LUA_OK)
+    lua_pop(L, 1);  /* remove error message */
+  return status;
+}
+
+
+static int bcwriter (lua_State *L, const void *p, size_t sz, void *ud) {
+  (void)L;  /* not used */
+  if (p == NULL) return 0;  /* end of dump */
+  return (fwrite(p, 1, sz, (FILE *)ud) != sz);
+}
+
+
+/*
+** Store the function on the top of the stack into cache file 'cname'.
+** The dump goes to a temporary file that is then renamed over 'cname',
+** so that concurrent readers never see a partial file. Any failure
+** simply leaves the cache without the entry.
+*/
+static void bcwrite (lua_State *L, const char *cname, const char *filename,
+                                   const BCHeader *h, BCStats *st) {
+  const char *tname = lua_pushfstring(L, "%s.%I.%p", cname,
+                                         (LUAI_UACINT)l_bcpid(), (void *)st);
+  FILE *f = fopen(tname, "wb");
+  int ok;
+  if (f == NULL) {
+    lua_pop(L, 1);  /* remove temporary name */
+    return;
+  }
+  ok = (fwrite(h, sizeof(*h), 1, f) == 1 &&
+        fwrite(filename, 1, h->namelen, f) == h->namelen);
+  if (ok) {
+    lua_pushvalue(L, -2);  /* function must be on the top */
+    ok = (lua_dump(L, bcwriter, f, 0) == 0);
+    lua_pop(L, 1);
+  }
+  ok = (fclose(f) == 0) && ok;
+  if (ok && rename(tname, cname) != 0) {
+    /* some systems cannot rename over an existing file */
+    remove(cname);
+    ok = (rename(tname, cname) == 0);
+  }
+  if (!ok)
+    remove(tname);
+  lua_pop(L, 1);  /* remove temporary name */
+}
+
+
+/*
+** Load module file 'filename' through the cache in directory 'dir'.
+*/
+static int bcload (lua_State *L, const char *filename, const char *dir) {
+  BCStats *st = getbcstats(L);
+  BCHeader h;
+  const char *cname;
+  int status;
+  if (!bcstamp(filename, &h))  /* cannot read source? */
+    return luaL_loadfile(L, filename);  /* let 'loadfile' report it */
+  cname = bcname(L, filename, dir);
+  if (bcread(L, cname, filename, &h) == LUA_OK) {
+    st->hits++;
+    lua_remove(L, -2);  /* remove cache name */
+    return LUA_OK;
+  }
+  st->misses++;
+  status = luaL_loadfile(L, filename);
+  if (status == LUA_OK)
+    bcwrite(L, cname, filename, &h, st);
+  lua_remove(L, -2);  /* remove cache name */
+  return status;
+}
+
+
+static int loadmodule (lua_State *L, const char *filename) {
+  int status;
+  if (lua_getfield(L, lua_upvalueindex(1), "bytecodecache") != LUA_TSTRING) {
+    lua_pop(L, 1);  /* cache not enabled */
+    return luaL_loadfile(L, filename);
+  }
+  status = bcload(L, filename, lua_tostring(L, -1));
+  lua_remove(L, -2);  /* remove cache directory */
+  return status;
+}
+
+
+static int ll_bytecodestats (lua_State *L) {
+  BCStats *st = getbcstats(L);
+  lua_pushinteger(L, st->hits);
+  lua_pushinteger(L, st->misses);
+  return 2;
+}
+
+
+static void createbcstats (lua_State *L) {
+  if (lua_getfield(L, LUA_REGISTRYINDEX, BCSTATS) == LUA_TNIL) {
+    BCStats *st = (BCStats *)lua_newuserdatauv(L, sizeof(BCStats), 0);
+    st->hits = st->misses = 0;
+    lua_setfield(L, LUA_REGISTRYINDEX, BCSTATS);
+  }
+  lua_pop(L, 1);
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** 'require' function
@@ -524,7 +797,7 @@ static int searcher_Lua (lua_State *L) {
   const char *name = luaL_checkstring(L, 1);
   filename = findfile(L, name, "path", LUA_LSUBSEP);
   if (filename == NULL) return 1;  /* module not found in this path */
-  return checkload(L, (luaL_loadfile(L, filename) == LUA_OK), filename);
+  return checkload(L, (loadmodule(L, filename) == LUA_OK), filename);
 }
 
 
@@ -667,6 +940,7 @@ static int ll_require (lua_State *L) {
 static const luaL_Reg pk_funcs[] = {
   {"loadlib", ll_loadlib},
   {"searchpath", ll_searchpath},
+  {"bytecodestats", ll_bytecodestats},
   /* placeholders */
   {"preload", NULL},
   {"cpath", NULL},
@@ -719,6 +993,7 @@ static void createclibstable (lua_State *L) {
 
 LUAMOD_API int luaopen_package (lua_State *L) {
   createclibstable(L);
+  createbcstats(L);
   luaL_newlib(L, pk_funcs);  /* create 'package' table */
   createsearcherstable(L);
   /* set paths */
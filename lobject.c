@@ -207,6 +207,63 @@ static int isneg (const char **s) {
 
 
 
+/*
+** {==================================================================
+** 64-bit arithmetic for the fast conversions between floats and
+** strings
+** ===================================================================
+*/
+
+#if defined(ULLONG_MAX) && LUA_FLOAT_TYPE == LUA_FLOAT_DOUBLE && \
+    FLT_RADIX == 2 && DBL_MANT_DIG == 53 && DBL_MAX_EXP == 1024
+#define IEEEDOUBLE	/* floats are IEEE doubles */
+#endif
+
+#if defined(ULLONG_MAX)
+typedef unsigned long long Word64;
+#endif
+
+
+#if defined(IEEEDOUBLE) && \
+    (!defined(LUA_NOFASTN2S) || !defined(LUA_NOFASTS2N))	/* { */
+
+/* 5^i for i <= 26 */
+static const Word64 pow5tab[] = {
+  1ull, 5ull, 25ull, 125ull, 625ull, 3125ull, 15625ull, 78125ull,
+  390625ull, 1953125ull, 9765625ull, 48828125ull, 244140625ull,
+  1220703125ull, 6103515625ull, 30517578125ull, 152587890625ull,
+  762939453125ull, 3814697265625ull, 19073486328125ull,
+  95367431640625ull, 476837158203125ull, 2384185791015625ull,
+  11920928955078125ull, 59604644775390625ull, 298023223876953125ull,
+  1490116119384765625ull
+};
+
+
+/* 128-bit product of 'a' and 'b'; returns the low half */
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 Word128;
+
+static Word64 mul128 (Word64 a, Word64 b, Word64 *hi) {
+  Word128 p = (Word128)a * b;
+  *hi = (Word64)(p >> 64);
+  return (Word64)p;
+}
+#else
+static Word64 mul128 (Word64 a, Word64 b, Word64 *hi) {
+  Word64 a0 = a & 0xffffffffu, a1 = a >> 32;
+  Word64 b0 = b & 0xffffffffu, b1 = b >> 32;
+  Word64 p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0;
+  Word64 mid = (p00 >> 32) + (p01 & 0xffffffffu) + (p10 & 0xffffffffu);
+  *hi = a1 * b1 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+  return (mid << 32) | (p00 & 0xffffffffu);
+}
+#endif
+
+#endif					/* } */
+
+/* }================================================================== */
+
+
 /*
 ** {==================================================================
 ** Lua's implementation for 'lua_strx2number'
@@ -281,6 +338,242 @@ static lua_Number lua_strx2number (const char *s, char **endptr) {
 #define L_MAXLENNUM	200
 #endif
 
+/*
+** {==================================================================
+** Fast conversion of decimal numerals to floats
+** ===================================================================
+*/
+
+#if !defined(LUA_NOFASTS2N) && defined(IEEEDOUBLE)	/* { */
+
+#define FASTS2N
+
+/*
+** Numerals with up to 19 significant digits (so that they fit in 64
+** bits) are converted with the Eisel-Lemire algorithm (Daniel Lemire,
+** "Number Parsing at a Gigabyte per Second", 2021), which multiplies
+** the digits by a truncated 128-bit approximation of the power of 10
+** and gives up when the truncated bits could change the rounding (very
+** rarely). Longer numerals are truncated to 19 digits, which works when
+** the truncated and the next 19-digit values round to the same float.
+** Numerals that this code does not handle go to 'strtod'.
+*/
+
+#define MAXSIGDIGITS	19
+#define DECEXPMIN	(-342)
+#define DECEXPMAX	308
+
+/*
+** The approximations of 10^q, normalized to [2^127, 2^128), are
+** computed from those for each multiple of POW10STEP (from POW10BASE)
+** times the exact powers in 'pow5tab', plus a 2-bit correction from
+** 'pow10corr'.
+*/
+#define POW10STEP	27
+#define POW10BASE	(-351)
+
+static const Word64 pow10base[][2] = {  /* {low, high} */
+  {0x205b896d777d6278ull, 0x8049a4ac0c5811aeull},
+  {0x52064cac828675b9ull, 0xcf42894a5dce35eaull},
+  {0xaf2af2b80af6f24eull, 0xa76c582338ed2621ull},
+  {0x5a7744a6e804a291ull, 0x873e4f75e2224e68ull},
+  {0xaf39a475506a899eull, 0xda7f5bf590966848ull},
+  {0xbd8d794d96aacfb3ull, 0xb080392cc4349decull},
+  {0x547eb47b7282ee9cull, 0x8e938662882af53eull},
+  {0x0cb4a5a3112a5112ull, 0xe65829b3046b0afaull},
+  {0x92f34d62616ce413ull, 0xba121a4650e4ddebull},
+  {0x3a6a07f8d510f86full, 0x964e858c91ba2655ull},
+  {0xfae27299423fb9c3ull, 0xf2d56790ab41c2a2ull},
+  {0xaa97e14c3c26b886ull, 0xc428d05aa4751e4cull},
+  {0x775ea264cf55347eull, 0x9e74d1b791e07e48ull},
+  {0x0000000000000000ull, 0x8000000000000000ull},
+  {0x0000000000000000ull, 0xcecb8f27f4200f3aull},
+  {0x999090b65f67d924ull, 0xa70c3c40a64e6c51ull},
+  {0x69a028bb3ded71a3ull, 0x86f0ac99b4e8dafdull},
+  {0xe80e6f4820cc9495ull, 0xda01ee641a708de9ull},
+  {0x5ec05dcff72e7f8full, 0xb01ae745b101e9e4ull},
+  {0x14588f13be847307ull, 0x8e41ade9fbebc27dull},
+  {0x8f1668c8a86da5faull, 0xe5d3ef282a242e81ull},
+  {0x6d953e2bd7173692ull, 0xb9a74a0637ce2ee1ull},
+  {0x4abdaf101564f98eull, 0x95f83d0a1fb69cd9ull},
+  {0xbc633b39673c8cecull, 0xf24a01a73cf2dccfull},
+  {0x0a862f80ec4700c8ull, 0xc3b8358109e84f07ull}
+};
+
+static const l_uint32 pow10corr[] = {
+  0x55555551, 0x15010004, 0x41450500, 0x00014000, 0x44541005,
+  0x95655559, 0x44544116, 0x41055405, 0x96525555, 0x10415515,
+  0x41054005, 0x40104044, 0x10040015, 0x00000000, 0x55400000,
+  0x95515569, 0x50401165, 0x00100000, 0x15051554, 0x45155441,
+  0x51054155, 0x00000040, 0x00000000, 0x00000000, 0x00000000,
+  0x00000000, 0x55590000, 0x969965a5, 0x55455505, 0x50501555,
+  0x14545511, 0x00105555, 0x00110100, 0x55155410, 0x45545455,
+  0x44150504, 0x00015414, 0x00100000, 0x00400000, 0x00000004,
+  0x00000000
+};
+
+
+/* number of leading zeros in 'x' */
+static int clz64 (Word64 x) {
+  int n = 0;
+  if ((x >> 32) == 0) { n += 32; x <<= 32; }
+  if ((x >> 48) == 0) { n += 16; x <<= 16; }
+  if ((x >> 56) == 0) { n += 8; x <<= 8; }
+  if ((x >> 60) == 0) { n += 4; x <<= 4; }
+  if ((x >> 62) == 0) { n += 2; x <<= 2; }
+  if ((x >> 63) == 0) n++;
+  return n;
+}
+
+
+/* normalized approximation of 10^q */
+static void pow10approx (int q, Word64 r[2]) {
+  int b = (q - POW10BASE) / POW10STEP;
+  int off = (q - POW10BASE) % POW10STEP;
+  if (off == 0) {
+    r[0] = pow10base[b][0]; r[1] = pow10base[b][1];
+  }
+  else {  /* r = top 128 bits of 'pow10base[b] * 5^off', plus correction */
+    Word64 h0, h1, mid, l0;
+    Word64 c = cast(Word64, (pow10corr[(q - DECEXPMIN) / 16] >>
+                             ((q - DECEXPMIN) % 16 * 2)) & 3);
+    int s;
+    l0 = mul128(pow5tab[off], pow10base[b][0], &h0);
+    mid = mul128(pow5tab[off], pow10base[b][1], &h1) + h0;
+    h1 += (mid < h0);  /* carry */
+    s = clz64(h1);  /* (h1 != 0) */
+    r[1] = (s == 0) ? h1 : (h1 << s) | (mid >> (64 - s));
+    r[0] = ((s == 0) ? mid : (mid << s) | (l0 >> (64 - s))) + c;
+    r[1] += (r[0] < c);
+  }
+}
+
+
+/*
+** Compute in '*res' the float nearest to w * 10^q, for w != 0 and q in
+** [DECEXPMIN, DECEXPMAX]. Return 0 if it cannot, because of precision
+** or because the result is subnormal.
+*/
+static int eisellemire (Word64 w, int q, lua_Number *res) {
+  Word64 t[2], lo, hi, mant, bits;
+  int lz, upper, p2;
+  pow10approx(q, t);
+  lz = clz64(w);
+  w <<= lz;
+  lo = mul128(w, t[1], &hi);
+  if ((hi & 0x1ff) == 0x1ff) {  /* rounding may depend on lower bits? */
+    Word64 hi2;
+    mul128(w, t[0], &hi2);
+    lo += hi2;
+    hi += (lo < hi2);
+    if (lo == ~cast(Word64, 0) && (q < -27 || q > 55))
+      return 0;  /* not enough precision to decide */
+  }
+  upper = cast_int(hi >> 63);
+  mant = hi >> (upper + 9);  /* 54 bits: mantissa plus rounding bit */
+  /* binary exponent: floor(log2(10^q)) + 63 + upper - lz + bias */
+  p2 = cast_int((217706 * cast(Word64, q + 32768)) >> 16) - 108853 +
+       63 + upper - lz + 1023;
+  if (p2 <= 0)
+    return 0;  /* subnormal */
+  if (lo <= 1 && -4 <= q && q <= 23 && (mant & 3) == 1 &&
+      (mant << (upper + 9)) == hi)  /* exactly halfway? */
+    mant &= ~cast(Word64, 1);  /* round to even (down) */
+  mant = (mant + (mant & 1)) >> 1;  /* round */
+  if (mant >= (cast(Word64, 2) << 52)) {  /* rounding overflowed? */
+    mant = cast(Word64, 1) << 52;
+    p2++;
+  }
+  if (p2 >= 0x7ff)
+    bits = cast(Word64, 0x7ff) << 52;  /* infinity */
+  else
+    bits = (mant & ~(cast(Word64, 1) << 52)) | (cast(Word64, p2) << 52);
+  memcpy(res, &bits, sizeof(bits));
+  return 1;
+}
+
+
+/*
+** Try to convert the decimal numeral 's', with a dot as its radix mark,
+** to a float. Return NULL if it is not a valid numeral or if it needs
+** the general conversion.
+*/
+static const char *l_str2dfast (const char *s, lua_Number *result) {
+  Word64 w = 0;  /* significant digits */
+  int nd = 0;  /* number of significant digits */
+  int e10 = 0;  /* decimal exponent */
+  int hasdot = 0;
+  int empty = 1;
+  int trunc = 0;  /* true if some nonzero digit was dropped */
+  int neg;
+  while (lisspace(cast_uchar(*s))) s++;  /* skip initial spaces */
+  neg = isneg(&s);
+  for (;; s++) {
+    if (*s == '.' && !hasdot)
+      hasdot = 1;
+    else if (lisdigit(cast_uchar(*s))) {
+      int d = *s - '0';
+      if (nd < MAXSIGDIGITS) {
+        if (w != 0 || d != 0) {  /* not a leading zero? */
+          w = w * 10 + cast(Word64, d);
+          nd++;
+        }
+        if (hasdot) e10--;
+      }
+      else {  /* too many digits; drop it */
+        if (!hasdot && e10 < 100000) e10++;
+        trunc |= (d != 0);
+      }
+      empty = 0;
+    }
+    else break;
+  }
+  if (empty) return NULL;
+  if (*s == 'e' || *s == 'E') {  /* exponent part? */
+    int ex = 0;
+    int eneg;
+    s++;
+    eneg = isneg(&s);
+    if (!lisdigit(cast_uchar(*s)))
+      return NULL;  /* invalid; must have at least one digit */
+    for (; lisdigit(cast_uchar(*s)); s++) {
+      if (ex < 100000)  /* avoid overflows */
+        ex = ex * 10 + (*s - '0');
+    }
+    e10 += (eneg) ? -ex : ex;
+  }
+  while (lisspace(cast_uchar(*s))) s++;  /* skip trailing spaces */
+  if (*s != '\0')
+    return NULL;
+  if (w == 0)
+    *result = l_mathop(0.0);
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  else if (w <= (cast(Word64, 1) << 53) && -22 <= e10 && e10 <= 22) {
+    /* both 'w' and 10^|e10| are exact; one operation rounds correctly */
+    static const lua_Number pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+      1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+      1e19, 1e20, 1e21, 1e22};
+    *result = cast_num(w);
+    if (e10 < 0) *result /= pow10[-e10];
+    else *result *= pow10[e10];
+  }
+#endif
+  else if (e10 < DECEXPMIN || e10 > DECEXPMAX || !eisellemire(w, e10, result))
+    return NULL;
+  else if (trunc) {  /* true value is between 'w' and 'w + 1' */
+    lua_Number r1;
+    if (!eisellemire(w + 1, e10, &r1) || r1 != *result)
+      return NULL;  /* they may round differently */
+  }
+  if (neg) *result = -*result;
+  return s;
+}
+
+#endif				/* } */
+
+/* }====================================================== */
+
+
 /*
 ** Convert string 's' to a Lua number (put in 'result'). Return NULL on
 ** fail or the address of the ending '\0' on success. ('mode' == 'x')
@@ -311,8 +604,14 @@ static const char *l_str2dloc (const char *s, lua_Number *result, int mode) {
 */
 static const char *l_str2d (const char *s, lua_Number *result) {
   const char *endptr;
-  const char *pmode = strpbrk(s, ".xXnN");  /* look for special chars */
-  int mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
+  const char *pmode;
+  int mode;
+#if defined(FASTS2N)
+  if ((endptr = l_str2dfast(s, result)) != NULL)
+    return endptr;  /* common case */
+#endif
+  pmode = strpbrk(s, ".xXnN");  /* look for special chars */
+  mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
   if (mode == 'n')  /* reject 'inf' and 'nan' */
     return NULL;
   endptr = l_str2dloc(s, result, mode);  /* try to convert */
@@ -411,24 +710,414 @@ int luaO_utf8esc (char *buff, unsigned long x) {
 #define MAXNUMBER2STR	(20 + l_floatatt(DIG))
 
 
+/*
+** {==================================================================
+** Fast conversion of numbers to strings
+** ===================================================================
+*/
+
+#if !defined(LUA_NOFASTN2S) && defined(ULLONG_MAX)	/* { */
+
+#define FASTI2S
+
+
+/* decimal digits of all numbers in [0, 99] */
+static const char digitpairs[] =
+  "00010203040506070809101112131415161718192021222324252627282930313233"
+  "34353637383940414243444546474849505152535455565758596061626364656667"
+  "6869707172737475767778798081828384858687888990919293949596979899";
+
+
+/*
+** Write the decimal digits of 'x' backwards from 'end'; return where
+** they start.
+*/
+static char *writedigits (char *end, Word64 x) {
+  while (x >= 100) {
+    unsigned d = cast_uint(x % 100) * 2;
+    x /= 100;
+    *--end = digitpairs[d + 1];
+    *--end = digitpairs[d];
+  }
+  if (x >= 10) {
+    unsigned d = cast_uint(x) * 2;
+    *--end = digitpairs[d + 1];
+    *--end = digitpairs[d];
+  }
+  else
+    *--end = cast_char('0' + cast_int(x));
+  return end;
+}
+
+
+static int tostringbuffInt (lua_Integer i, char *buff) {
+  char temp[MAXNUMBER2STR];
+  char *end = temp + MAXNUMBER2STR;
+  lua_Unsigned u = l_castS2U(i);
+  char *p = writedigits(end, (i < 0) ? 0u - u : u);
+  int len;
+  if (i < 0) *--p = '-';
+  len = cast_int(end - p);
+  memcpy(buff, p, cast_sizet(len));
+  buff[len] = '\0';
+  return len;
+}
+
+
+#if defined(IEEEDOUBLE)	/* { */
+
+/*
+** Shortest conversion of IEEE doubles, following the Ryu algorithm
+** (Ulf Adams, "Ryu: fast float-to-string conversion", PLDI 2018). It
+** finds the shortest decimal in the interval of reals that round to
+** the float (the one closest to it, when there are several) using
+** only 64-bit integer multiplications by 125-bit approximations of
+** powers of 5.
+*/
+
+#define FASTF2S
+
+#define MANTBITS	52
+#define EXPBIAS		1023
+#define POW5BITS	125	/* bits in the approximations of powers of 5 */
+
+/* ceil(log2(5^e)) for e > 0; 1 for e == 0 */
+#define pow5bits(e)	cast_int((cast_uint(e) * 1217359u >> 19) + 1)
+
+/* floor(log10(2^e)) for 0 <= e <= 1650 */
+#define log10pow2(e)	cast_int(cast_uint(e) * 78913u >> 18)
+
+/* floor(log10(5^e)) for 0 <= e <= 2620 */
+#define log10pow5(e)	cast_int(cast_uint(e) * 732923u >> 20)
+
+
+/*
+** The approximations of 5^i and of 2^k/5^i are computed from those for
+** each multiple of 'POW5STEP' times the exact powers in 'pow5tab',
+** plus a small correction (0-3) from 'pow5corr' and 'pow5invcorr',
+** with 2 bits for each 'i'.
+*/
+#define POW5STEP	26
+
+/* 5^i >> (pow5bits(i) - POW5BITS), for i multiple of POW5STEP */
+static const Word64 pow5base[][2] = {  /* {low, high} */
+  {0x0000000000000000ull, 0x1000000000000000ull},
+  {0x0000000000000000ull, 0x14adf4b7320334b9ull},
+  {0x0e549208b31adb10ull, 0x1aba4714957d300dull},
+  {0x6dc6ad264d8f0866ull, 0x1145b7e285bf98f5ull},
+  {0xeb1dbd923d8596caull, 0x1652efdc6018a1fcull},
+  {0xb4c1b80b22ae923cull, 0x1cda62055b2d9d83ull},
+  {0x5bb28b4e8f7e4c30ull, 0x12a5568b9f52f416ull},
+  {0xf08aed437682d4fbull, 0x1819651531f9e78full},
+  {0xb4ee134ad99bf150ull, 0x1f25c186a6f04c28ull},
+  {0x16499ecb70c25f03ull, 0x1420eb449c8842e6ull},
+  {0x85a56ead360865b0ull, 0x1a03fde214caf085ull},
+  {0x093db1d57999890bull, 0x10cfeb353a97dad8ull},
+  {0xcf38bb735e3f36acull, 0x15baaf44fa52673eull}
+};
+
+/* 2^(pow5bits(i) - 1 + POW5BITS) / 5^i + 1, for i multiple of POW5STEP */
+static const Word64 pow5invbase[][2] = {  /* {low, high} */
+  {0x0000000000000001ull, 0x2000000000000000ull},
+  {0x52a6c95fc0655034ull, 0x18c240c4aecb13bbull},
+  {0x7ca8d50071dfc806ull, 0x1327fc58da0f6ff5ull},
+  {0x6520247d3556476eull, 0x1da48ce468e7c702ull},
+  {0x6139cdd76802e6e9ull, 0x16ef5b40c2fc7779ull},
+  {0xf951a7ff43de8c79ull, 0x11bebdf578b2f391ull},
+  {0x7be8bee8d6e957e8ull, 0x1b758d848fac54b0ull},
+  {0x8bd3f9e999a423eaull, 0x153eda614071a3b7ull},
+  {0x0848f973cb3ee3ceull, 0x10701bd527b4978cull},
+  {0x153285ebb9efbfa2ull, 0x196fbb9bb44db44dull},
+  {0xadeee7f86c07b696ull, 0x13ae3591f5b4d936ull},
+  {0x4d686a4eaf182222ull, 0x1e74404f3daada91ull},
+  {0x98c0a106e09ebd9full, 0x17900ea4fda7c257ull}
+};
+
+static const l_uint32 pow5corr[] = {
+  0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x40000000,
+  0x59695995, 0x55545555, 0x56555515, 0x41150504, 0x40555410,
+  0x44555145, 0x44504540, 0x45555550, 0x40004000, 0x96440440,
+  0x55565565, 0x54454045, 0x40154151, 0x55559155, 0x51405555,
+  0x00000105
+};
+
+static const l_uint32 pow5invcorr[] = {
+  0x54544554, 0x04055545, 0x10041000, 0x00400414, 0x40010000,
+  0x41155555, 0x00000454, 0x00010044, 0x40000000, 0x44000041,
+  0x50454450, 0x55550054, 0x51655554, 0x40004000, 0x01000001,
+  0x00010500, 0x51515411, 0x05555554, 0x00000000
+};
+
+#define getcorr(t,i)	cast_int(((t)[(i) / 16] >> ((i) % 16 * 2)) & 3)
+
+
+/*
+** Set 'r' to (m * (x[1]:x[0])) >> s plus 'c', where 'm' < 2^64,
+** 0 < s < 64, and the result fits in 128 bits.
+*/
+static void mulshiftadd (Word64 m, const Word64 x[2], int s, int c,
+                         Word64 r[2]) {
+  Word64 h0, h1;
+  Word64 l0 = mul128(m, x[0], &h0);
+  Word64 mid = mul128(m, x[1], &h1) + h0;
+  h1 += (mid < h0);  /* carry */
+  r[0] = ((l0 >> s) | (mid << (64 - s))) + cast(Word64, c);
+  r[1] = ((mid >> s) | (h1 << (64 - s))) + (r[0] < cast(Word64, c));
+}
+
+
+/* approximation of 5^i */
+static void pow5 (int i, Word64 r[2]) {
+  int b = i / POW5STEP;
+  int off = i % POW5STEP;
+  if (off == 0) {
+    r[0] = pow5base[b][0]; r[1] = pow5base[b][1];
+  }
+  else
+    mulshiftadd(pow5tab[off], pow5base[b], pow5bits(i) - pow5bits(i - off),
+                getcorr(pow5corr, i), r);
+}
+
+
+/* approximation of 2^k/5^i */
+static void pow5inv (int i, Word64 r[2]) {
+  int b = (i + POW5STEP - 1) / POW5STEP;
+  int off = b * POW5STEP - i;
+  if (off == 0) {
+    r[0] = pow5invbase[b][0]; r[1] = pow5invbase[b][1];
+  }
+  else {
+    Word64 x[2];  /* pow5invbase[b] - 1 */
+    x[0] = pow5invbase[b][0] - 1;
+    x[1] = pow5invbase[b][1] - (pow5invbase[b][0] == 0);
+    mulshiftadd(pow5tab[off], x, pow5bits(b * POW5STEP) - pow5bits(i),
+                getcorr(pow5invcorr, i) + 1, r);
+  }
+}
+
+
+/* (m * (mul[1]:mul[0])) >> j, for 64 < j < 128 */
+static Word64 mulshift (Word64 m, const Word64 mul[2], int j) {
+  Word64 h0, h1;
+  Word64 mid;
+  mul128(m, mul[0], &h0);
+  mid = mul128(m, mul[1], &h1) + h0;
+  h1 += (mid < h0);  /* carry */
+  j -= 64;
+  return (mid >> j) | (h1 << (64 - j));
+}
+
+
+static int pow5factor (Word64 x) {
+  int n = 0;
+  while (x % 5 == 0) {
+    x /= 5;
+    n++;
+  }
+  return n;
+}
+
+#define multipleofpow5(x,p)	(pow5factor(x) >= (p))
+#define multipleofpow2(x,p)	(((x) & ((cast(Word64, 1) << (p)) - 1)) == 0)
+
+
+/*
+** Compute the shortest decimal 'digits' * 10^'*e10' that reads back as
+** the positive float with mantissa and exponent fields 'mant' and 'ex'.
+*/
+static Word64 shortestdec (Word64 mant, int ex, int *e10) {
+  int e2, q;
+  Word64 m2, mv, vr, vp, vm, mul[2];
+  int mmshift = (mant != 0 || ex <= 1);  /* lower gap is not smaller? */
+  int accept;  /* whether the ends of the interval read back as 'm2' */
+  int vmzeros = 0, vrzeros = 0;
+  int removed = 0;
+  int lastdigit = 0;
+  if (ex == 0) {  /* subnormal? */
+    e2 = 1 - EXPBIAS - MANTBITS - 2;
+    m2 = mant;
+  }
+  else {
+    e2 = ex - EXPBIAS - MANTBITS - 2;
+    m2 = (cast(Word64, 1) << MANTBITS) | mant;
+  }
+  accept = ((m2 & 1) == 0);  /* ties round to even */
+  /* the interval is [4*m2 - 1 - mmshift, 4*m2 + 2] * 2^e2 */
+  mv = 4 * m2;
+  if (e2 >= 0) {
+    int k;
+    q = log10pow2(e2) - (e2 > 3);
+    *e10 = q;
+    k = POW5BITS + pow5bits(q) - 1;
+    pow5inv(q, mul);
+    vr = mulshift(4 * m2, mul, -e2 + q + k);
+    vp = mulshift(4 * m2 + 2, mul, -e2 + q + k);
+    vm = mulshift(4 * m2 - 1 - cast(Word64, mmshift), mul, -e2 + q + k);
+    if (q <= 21) {  /* can interval ends be multiples of 10^q? */
+      if (mv % 5 == 0)
+        vrzeros = multipleofpow5(mv, q);
+      else if (accept)
+        vmzeros = multipleofpow5(mv - 1 - cast(Word64, mmshift), q);
+      else
+        vp -= multipleofpow5(mv + 2, q);
+    }
+  }
+  else {
+    int i, j;
+    q = log10pow5(-e2) - (-e2 > 1);
+    *e10 = q + e2;
+    i = -e2 - q;
+    j = q - (pow5bits(i) - POW5BITS);
+    pow5(i, mul);
+    vr = mulshift(4 * m2, mul, j);
+    vp = mulshift(4 * m2 + 2, mul, j);
+    vm = mulshift(4 * m2 - 1 - cast(Word64, mmshift), mul, j);
+    if (q <= 1) {  /* all of 'vr', 'vp', and 'vm' have trailing zeros */
+      vrzeros = 1;
+      if (accept)
+        vmzeros = mmshift;
+      else
+        vp--;
+    }
+    else if (q < 63)
+      vrzeros = multipleofpow2(mv, q);
+  }
+  if (vmzeros || vrzeros) {  /* general (rare) case */
+    while (vp / 10 > vm / 10) {
+      vmzeros &= (vm % 10 == 0);
+      vrzeros &= (lastdigit == 0);
+      lastdigit = cast_int(vr % 10);
+      vr /= 10; vp /= 10; vm /= 10;
+      removed++;
+    }
+    if (vmzeros) {
+      while (vm % 10 == 0) {
+        vrzeros &= (lastdigit == 0);
+        lastdigit = cast_int(vr % 10);
+        vr /= 10; vp /= 10; vm /= 10;
+        removed++;
+      }
+    }
+    if (vrzeros && lastdigit == 5 && vr % 2 == 0)
+      lastdigit = 4;  /* exactly halfway; round to even */
+    *e10 += removed;
+    return vr + ((vr == vm && (!accept || !vmzeros)) || lastdigit >= 5);
+  }
+  else {  /* common case */
+    int roundup = 0;
+    if (vp / 100 > vm / 100) {  /* remove two digits at a time */
+      roundup = (vr % 100 >= 50);
+      vr /= 100; vp /= 100; vm /= 100;
+      removed += 2;
+    }
+    while (vp / 10 > vm / 10) {
+      roundup = (vr % 10 >= 5);
+      vr /= 10; vp /= 10; vm /= 10;
+      removed++;
+    }
+    *e10 += removed;
+    return vr + (vr == vm || roundup);
+  }
+}
+
+
+/*
+** Convert a finite float to the shortest numeral that reads back as
+** the same float, laid out as format "%.Ng" would do it, where N is
+** the number of digits in LUA_NUMBER_FMT or LUA_NUMBER_FMT_N, the
+** first one that has enough digits.
+*/
+static int shortfloat (lua_Number n, char *buff) {
+  char digits[24];
+  char *end = digits + sizeof(digits);
+  char *d;
+  char *p = buff;
+  Word64 bits, v;
+  int e10, nd, x;
+  memcpy(&bits, &n, sizeof(bits));
+  if (bits >> 63)
+    *p++ = '-';
+  bits &= ~(cast(Word64, 1) << 63);
+  if (bits == 0) {  /* zero? */
+    *p++ = '0';
+    *p = '\0';
+    return cast_int(p - buff);
+  }
+  v = shortestdec(bits & ((cast(Word64, 1) << MANTBITS) - 1),
+                  cast_int(bits >> MANTBITS), &e10);
+  while (v % 10 == 0) {  /* remove trailing zeros */
+    v /= 10;
+    e10++;
+  }
+  d = writedigits(end, v);
+  nd = cast_int(end - d);
+  x = nd - 1 + e10;  /* exponent in scientific notation */
+  if (x < -4 || x >= (nd <= l_floatatt(DIG) ? l_floatatt(DIG)
+                                            : l_floatatt(DIG) + 2)) {
+    *p++ = *d++;  /* one digit before the point */
+    if (d < end) {
+      *p++ = lua_getlocaledecpoint();
+      while (d < end) *p++ = *d++;
+    }
+    *p++ = 'e';
+    *p++ = (x < 0) ? '-' : '+';
+    if (x < 0) x = -x;
+    if (x < 10) *p++ = '0';  /* at least two digits */
+    d = writedigits(end, cast(Word64, x));  /* ('digits' is free now) */
+    while (d < end) *p++ = *d++;
+  }
+  else if (x < 0) {  /* 0.00ddd */
+    *p++ = '0';
+    *p++ = lua_getlocaledecpoint();
+    while (++x < 0) *p++ = '0';
+    while (d < end) *p++ = *d++;
+  }
+  else {  /* ddd[.ddd] or ddd000 */
+    int i;
+    for (i = 0; i <= x; i++)
+      *p++ = (d < end) ? *d++ : '0';
+    if (d < end) {
+      *p++ = lua_getlocaledecpoint();
+      while (d < end) *p++ = *d++;
+    }
+  }
+  *p = '\0';
+  return cast_int(p - buff);
+}
+
+#endif				/* } */
+
+#endif				/* } */
+
+/* }================================================================== */
+
+
 /*
 ** Convert a float to a string, adding it to a buffer. First try with
 ** a not too large number of digits, to avoid noise (for instance,
 ** 1.1 going to "1.1000000000000001"). If that lose precision, so
 ** that reading the result back gives a different number, then do the
-** conversion again with extra precision. Moreover, if the numeral looks
-** like an integer (without a decimal point or an exponent), add ".0" to
-** its end.
+** conversion again with extra precision. ('shortfloat' does all that in
+** one step, for finite doubles.) Moreover, if the numeral looks like an
+** integer (without a decimal point or an exponent), add ".0" to its end.
 */
 static int tostringbuffFloat (lua_Number n, char *buff) {
-  /* first conversion */
-  int len = l_sprintf(buff, MAXNUMBER2STR, LUA_NUMBER_FMT,
+  int len;
+#if defined(FASTF2S)
+  if (n - n == 0)  /* finite? */
+    len = shortfloat(n, buff);
+  else
+#endif
+  {
+    /* first conversion */
+    lua_Number check;
+    len = l_sprintf(buff, MAXNUMBER2STR, LUA_NUMBER_FMT, (LUAI_UACNUMBER)n);
+    check = lua_str2number(buff, NULL);  /* read it back */
+    if (check != n) {  /* not enough precision? */
+      /* convert again with more precision */
+      len = l_sprintf(buff, MAXNUMBER2STR, LUA_NUMBER_FMT_N,
                             (LUAI_UACNUMBER)n);
-  lua_Number check = lua_str2number(buff, NULL);  /* read it back */
-  if (check != n) {  /* not enough precision? */
-    /* convert again with more precision */
-    len = l_sprintf(buff, MAXNUMBER2STR, LUA_NUMBER_FMT_N,
-                          (LUAI_UACNUMBER)n);
+    }
   }
   /* looks like an integer? */
   if (buff[strspn(buff, "-0123456789")] == '\0') {
@@ -446,7 +1135,11 @@ static unsigned tostringbuff (TValue *obj, char *buff) {
   int len;
   lua_assert(ttisnumber(obj));
   if (ttisinteger(obj))
+#if defined(FASTI2S)
+    len = tostringbuffInt(ivalue(obj), buff);
+#else
     len = lua_integer2str(buff, MAXNUMBER2STR, ivalue(obj));
+#endif
   else
     len = tostringbuffFloat(fltvalue(obj), buff);
   lua_assert(len < MAXNUMBER2STR);
@@ -566,6 +1259,7 @@ static void addnum2buff (BuffFS *buff, TValue *num) {
 const char *luaO_pushvfstring (lua_State *L, const char *fmt, va_list argp) {
   BuffFS buff;  /* holds last part of the result */
   const char *e;  /* points to next '%' */
+  TString *ts;
   buff.pushed = 0;  buff.blen = 0;
   buff.L = L;
   while ((e = strchr(fmt, '%')) != NULL) {
@@ -628,7 +1322,9 @@ const char *luaO_pushvfstring (lua_State *L, const char *fmt, va_list argp) {
   addstr2buff(&buff, fmt, strlen(fmt));  /* rest of 'fmt' */
   clearbuff(&buff);  /* empty buffer into the stack */
   lua_assert(buff.pushed == 1);
-  return getstr(tsvalue(s2v(L->top.p - 1)));
+  ts = tsvalue(s2v(L->top.p - 1));
+  luaS_seal(L, ts);  /* result may be the tip of a concatenation buffer */
+  return getstr(ts);
 }
 
 
@@ -397,6 +397,7 @@ typedef struct GCObject {
 #define LSTRREG		-1  /* regular long string */
 #define LSTRFIX		-2  /* fixed external long string */
 #define LSTRMEM		-3  /* external long string with deallocation */
+#define LSTRBUF		-4  /* long string in a concatenation buffer */
 
 
 /*
@@ -586,6 +587,24 @@ typedef struct AbsLineInfo {
 #define PF_FIXED	2  /* prototype has parts in fixed memory */
 
 
+/*
+** A fixed buffer with an owner (see 'lua_loadfixed'). Prototypes and
+** external strings that point into the buffer count as references;
+** 'falloc' releases the buffer when the last one goes away. The
+** structure itself is allocated directly with the state's allocator,
+** as it may be released without a 'lua_State'.
+*/
+typedef struct FixedBuf {
+  const char *buff;
+  size_t size;
+  l_obj nrefs;  /* number of references to the buffer */
+  lua_Alloc falloc;  /* function to release the buffer */
+  void *ud;  /* auxiliary data to 'falloc' */
+  lua_Alloc frealloc;  /* allocator for this structure */
+  void *fud;  /* auxiliary data to 'frealloc' */
+} FixedBuf;
+
+
 /*
 ** Function Prototypes
 */
@@ -611,7 +630,11 @@ typedef struct Proto {
   AbsLineInfo *abslineinfo;  /* idem */
   LocVar *locvars;  /* information about local variables (debug information) */
   TString  *source;  /* used for debug information */
+  FixedBuf *fixedbuf;  /* owned buffer with fixed parts (or NULL) */
   GCObject *gclist;
+#if defined(LUA_USE_FIELDCACHE)
+  unsigned *fcache;  /* hints for field accesses (one per instruction) */
+#endif
 } Proto;
 
 /* }================================================================== */
@@ -756,6 +756,7 @@ static void open_func (LexState *ls, FuncState *fs, BlockCnt *bl) {
   fs->firstlocal = ls->dyd->actvar.n;
   fs->firstlabel = ls->dyd->label.n;
   fs->bl = NULL;
+  fs->lastcons.endpc = -1;
   f->source = ls->source;
   luaC_objbarrier(ls->L, f, f->source);
   f->maxstacksize = 2;  /* registers 0/1 are always valid */
@@ -779,6 +780,9 @@ static void close_func (LexState *ls) {
   luaM_shrinkvector(L, f->p, f->sizep, fs->np, Proto *);
   luaM_shrinkvector(L, f->locvars, f->sizelocvars, fs->ndebugvars, LocVar);
   luaM_shrinkvector(L, f->upvalues, f->sizeupvalues, fs->nups, Upvaldesc);
+#if defined(LUA_USE_FIELDCACHE)
+  luaF_initfcache(L, f);
+#endif
   ls->fs = fs->prev;
   luaC_checkGC(L);
 }
@@ -972,6 +976,11 @@ static void constructor (LexState *ls, expdesc *t) {
   check_match(ls, '}', '{', line);
   lastlistfield(fs, &cc);
   luaK_settablesize(fs, pc, t->u.info, cc.na, cc.nh);
+  fs->lastcons.pc = pc;
+  fs->lastcons.endpc = fs->pc;
+  fs->lastcons.na = cc.na;
+  fs->lastcons.nh = cc.nh;
+  fs->lastcons.reg = cast_byte(t->u.info);
 }
 
 /* }====================================================================== */
@@ -1789,6 +1798,9 @@ static void localstat (LexState *ls) {
     adjust_assign(ls, nvars, nexps, &e);
     adjustlocalvars(ls, nvars);
   }
+  if (!(nvars == 1 && nexps == 1 && fs->lastcons.endpc == fs->pc &&
+        fs->lastcons.reg == fs->freereg - 1))
+    fs->lastcons.endpc = -1;  /* last constructor did not go to this local */
   checktoclose(fs, toclose);
 }
 
@@ -1820,12 +1832,39 @@ static void funcstat (LexState *ls, int line) {
 }
 
 
+/*
+** Check whether an assignment to 'v' adds a field to a table that has
+** just been created by a constructor (with no other code in between).
+** If so, correct the size of that table.
+*/
+static int growcons (FuncState *fs, expdesc *v) {
+  ConsDesc *cons = &fs->lastcons;
+  if (v->k == VINDEXSTR && cons->endpc == fs->pc &&
+      v->u.ind.t == cons->reg) {
+    cons->nh++;
+    luaK_settablesize(fs, cons->pc, cons->reg, cons->na, cons->nh);
+    return 1;
+  }
+  return 0;
+}
+
+
 static void exprstat (LexState *ls) {
   /* stat -> func | assignment */
   FuncState *fs = ls->fs;
   struct LHS_assign v;
   suffixedexp(ls, &v.v);
-  if (ls->t.token == '=' || ls->t.token == ',') { /* stat -> assignment ? */
+  if (ls->t.token == '=') {  /* stat -> single assignment ? */
+    int grown = growcons(fs, &v.v);
+    ConsDesc cons = fs->lastcons;  /* value may use other constructors */
+    v.prev = NULL;
+    restassign(ls, &v, 1);
+    if (grown) {  /* keep following this constructor */
+      fs->lastcons = cons;
+      fs->lastcons.endpc = fs->pc;
+    }
+  }
+  else if (ls->t.token == ',') { /* stat -> multiple assignment ? */
     v.prev = NULL;
     restassign(ls, &v, 1);
   }
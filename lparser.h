@@ -140,12 +140,27 @@ typedef struct Dyndata {
 struct BlockCnt;  /* defined in lparser.c */
 
 
+/*
+** Description of the last table constructor, used to size tables
+** built by a constructor assigned to a local variable followed by
+** assignments to fields of that variable ('local t = {}; t.x = 1').
+*/
+typedef struct ConsDesc {
+  int pc;  /* position of its OP_NEWTABLE instruction */
+  int endpc;  /* 'pc' after its last piece of code (-1 if none) */
+  int na;  /* number of array elements */
+  int nh;  /* number of hash elements */
+  lu_byte reg;  /* register holding the table */
+} ConsDesc;
+
+
 /* state needed to generate code for a given function */
 typedef struct FuncState {
   Proto *f;  /* current function header */
   struct FuncState *prev;  /* enclosing function */
   struct LexState *ls;  /* lexical state */
   struct BlockCnt *bl;  /* chain of current blocks */
+  ConsDesc lastcons;  /* last table constructor */
   int pc;  /* next position to code (equivalent to 'ncode') */
   int lasttarget;   /* 'label' of last 'jump label' */
   int previousline;  /* last line that was saved in 'lineinfo' */
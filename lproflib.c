@@ -0,0 +1,985 @@
+/*
+** $Id: lproflib.c $
+** Sampling profiler
+** See Copyright Notice in lua.h
+*/
+
+#define lproflib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+#include "llimits.h"
+
+
+/*
+** The profiler samples the stack of the running program at regular
+** intervals. Each thread runs a hook every few instructions; a timer
+** signal only sets a flag, which the hook of the running thread then
+** consumes to record its stack. (The signal also sets a hook on every
+** instruction in the main thread, as 'lua.c' does to stop the
+** interpreter, so that samples there are precise.) Coroutines inherit
+** the hook from the thread that creates them. Stacks are kept in
+** tables allocated when the library is opened, so that taking a sample
+** never allocates memory. The output uses the "folded stacks" format
+** of flame-graph tools: one line per distinct stack, with its frames
+** from the root to the leaf separated by semicolons, followed by the
+** number of samples with that stack.
+**
+** The memory profiler wraps the allocator of the state. It samples
+** allocated bytes at random, with a mean interval given by the user,
+** and marks each sampled block as pending. As the stack may be in an
+** inconsistent state inside the allocator, it only sets a hook on
+** every instruction in the main thread and in the last thread that ran
+** the hook; pending blocks go to the line running in the first thread
+** to run its hook, usually the thread that allocated them. Each
+** sample stands for an estimate of the bytes allocated around it;
+** sampled blocks stay in a table until they are freed, so that each
+** site knows how many of its bytes are still live. Each state can
+** have its own memory profiler.
+*/
+
+
+/* maximum number of frames recorded in a sample */
+#define PROFMAXDEPTH	64
+
+/* size of the frame table (a power of 2, not above USHRT_MAX) */
+#define PROFNFRAMES	4096
+
+/* size of the stack table (a power of 2) */
+#define PROFNSTACKS	8192
+
+/* total number of frames in all recorded stacks */
+#define PROFPOOL	(PROFNSTACKS * 16)
+
+/* maximum length of a frame label */
+#define PROFLABEL	96
+
+/* default interval between samples, in milliseconds */
+#define PROFINTERVAL	1.0
+
+/* size of the site table for memory samples (a power of 2) */
+#define MEMNSITES	1024
+
+/* size of the table of sampled blocks (a power of 2) */
+#define MEMNBLOCKS	16384
+
+/* maximum number of samples waiting for a site */
+#define MEMPENDING	64
+
+/* default mean interval between memory samples, in bytes */
+#define MEMRATE		(512.0 * 1024.0)
+
+/* number of sites in a report by default */
+#define MEMTOPN		20
+
+/* number of instructions between checks for a due sample */
+#define PROFCHECK	1000
+
+/* events that run the hook */
+#define PROFMASK  (LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE | LUA_MASKCOUNT)
+
+/* tables are never filled above 3/4 of their size */
+#define isfull(n,size)	((n) >= (size) / 4 * 3)
+
+
+typedef struct Frame {
+  unsigned int hash;
+  char label[PROFLABEL];  /* empty in a free entry */
+} Frame;
+
+
+typedef struct Stack {
+  unsigned int hash;
+  unsigned int count;  /* number of samples (0 in a free entry) */
+  unsigned int depth;  /* number of frames */
+  unsigned int start;  /* index of its frames in 'pool', leaf first */
+} Stack;
+
+
+typedef struct Profiler {
+  unsigned int nframes;  /* number of entries in use in 'frames' */
+  unsigned int nstacks;  /* number of entries in use in 'stacks' */
+  unsigned int npool;  /* number of entries in use in 'pool' */
+  lua_Integer nsamples;  /* number of samples recorded */
+  lua_Integer ndropped;  /* number of samples that did not fit */
+  Frame frames[PROFNFRAMES];
+  Stack stacks[PROFNSTACKS];
+  unsigned short pool[PROFPOOL];
+} Profiler;
+
+
+/* profiler that is running (there can be only one per process) */
+static Profiler *volatile runprof = NULL;
+
+/* state being profiled */
+static lua_State *volatile profL = NULL;
+
+
+static unsigned int hashbytes (unsigned int h, const void *b, size_t l) {
+  const unsigned char *s = (const unsigned char *)b;
+  for (; l > 0; l--)
+    h = (h ^ *(s++)) * 16777619u;
+  return h;
+}
+
+#define PROFSEED	2166136261u
+
+
+/*
+** Append string 's' to label 'b' with length 'n'. Semicolons separate
+** frames in the output, so they are changed into commas.
+*/
+static size_t addlabel (char *b, size_t n, const char *s) {
+  for (; *s != '\0' && n < PROFLABEL - 1; s++)
+    b[n++] = (*s == ';') ? ',' : *s;
+  b[n] = '\0';
+  return n;
+}
+
+
+/*
+** Label of a function: its name, followed by '@' and its source. If
+** 'line' is positive, it is appended to the source.
+*/
+static void framelabel (char *b, lua_Debug *ar, int line) {
+  size_t n;
+  if (ar->name != NULL)
+    n = addlabel(b, 0, ar->name);
+  else if (*ar->what == 'm')
+    n = addlabel(b, 0, "main chunk");
+  else
+    n = addlabel(b, 0, "?");
+  n = addlabel(b, n, "@");
+  n = addlabel(b, n, ar->short_src);
+  if (line > 0) {  /* add ':line' */
+    char num[16];
+    int i = (int)sizeof(num) - 1;
+    num[i] = '\0';
+    do {
+      num[--i] = cast_char('0' + line % 10);
+      line /= 10;
+    } while (line > 0);
+    num[--i] = ':';
+    addlabel(b, n, num + i);
+  }
+}
+
+
+/*
+** Get the index of the frame with label 'label', adding it if needed.
+** Returns -1 if the table is full.
+*/
+static int findframe (Profiler *p, const char *label) {
+  unsigned int h = hashbytes(PROFSEED, label, strlen(label));
+  unsigned int i = h;
+  for (;; i++) {
+    Frame *f = &p->frames[i & (PROFNFRAMES - 1)];
+    if (f->label[0] == '\0') {  /* free entry? */
+      if (isfull(p->nframes, PROFNFRAMES))
+        return -1;
+      p->nframes++;
+      f->hash = h;
+      strcpy(f->label, label);
+      return cast_int(i & (PROFNFRAMES - 1));
+    }
+    else if (f->hash == h && strcmp(f->label, label) == 0)
+      return cast_int(i & (PROFNFRAMES - 1));
+  }
+}
+
+
+/*
+** Count one more sample for the stack with frames 'fr[0..n-1]', adding
+** it if needed. Returns 0 if there is no space for a new stack.
+*/
+static int addstack (Profiler *p, const unsigned short *fr, unsigned n) {
+  size_t sz = n * sizeof(fr[0]);
+  unsigned int h = hashbytes(PROFSEED, fr, sz);
+  unsigned int i = h;
+  for (;; i++) {
+    Stack *s = &p->stacks[i & (PROFNSTACKS - 1)];
+    if (s->count == 0) {  /* free entry? */
+      if (isfull(p->nstacks, PROFNSTACKS) || p->npool + n > PROFPOOL)
+        return 0;
+      p->nstacks++;
+      s->hash = h;
+      s->count = 1;
+      s->depth = n;
+      s->start = p->npool;
+      memcpy(p->pool + p->npool, fr, sz);
+      p->npool += n;
+      return 1;
+    }
+    else if (s->hash == h && s->depth == n &&
+             memcmp(p->pool + s->start, fr, sz) == 0) {
+      s->count++;
+      return 1;
+    }
+  }
+}
+
+
+static void takesample (lua_State *L, Profiler *p) {
+  unsigned short fr[PROFMAXDEPTH];
+  char label[PROFLABEL];
+  lua_Debug ar;
+  unsigned n = 0;
+  int f;
+  while (n < PROFMAXDEPTH && lua_getstack(L, cast_int(n), &ar)) {
+    lua_getinfo(L, "Sn", &ar);
+    framelabel(label, &ar, ar.linedefined);
+    if ((f = findframe(p, label)) < 0)
+      goto dropped;
+    fr[n++] = cast(unsigned short, f);
+  }
+  if (n == PROFMAXDEPTH && lua_getstack(L, cast_int(n), &ar)) {
+    /* stack too deep; replace its outermost frame with a mark */
+    if ((f = findframe(p, "...")) < 0)
+      goto dropped;
+    fr[n - 1] = cast(unsigned short, f);
+  }
+  if (n == 0 || !addstack(p, fr, n))
+    goto dropped;
+  p->nsamples++;
+  return;
+ dropped:
+  p->ndropped++;
+}
+
+
+/*
+** {======================================================
+** Timers
+** 'l_starttimer' starts marking samples as due at intervals; it
+** returns 0 in case of errors. 'l_sampledue' tells whether a sample
+** is due in a call to 'profhook' in thread 'L', and 'l_samplereset'
+** marks it as taken.
+** =======================================================
+*/
+
+static void profhook (lua_State *L, lua_Debug *ar);
+
+
+#if !defined(l_starttimer)	/* { */
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <signal.h>
+#include <sys/time.h>
+
+#define l_sampledue(L)	((void)(L), sampledue != 0)
+
+#define l_samplereset()	(sampledue = 0)
+
+static struct sigaction oldaction;  /* previous handler for SIGPROF */
+
+static volatile sig_atomic_t sampledue = 0;
+
+
+/*
+** As 'lua.c', only set a hook in the signal handler. If a coroutine is
+** running, its own hook takes the sample.
+*/
+static void profaction (int i) {
+  lua_State *L = profL;
+  (void)i;  /* unused arg. */
+  if (L != NULL) {
+    lua_Hook h = lua_gethook(L);
+    sampledue = 1;
+    if (h == NULL || h == profhook)
+      lua_sethook(L, profhook, PROFMASK, 1);
+  }
+}
+
+
+static int l_starttimer (lua_State *L, double ms) {
+  struct sigaction sa;
+  struct itimerval it;
+  long us = (long)(ms * 1000.0);
+  (void)L;  /* unused arg. */
+  if (us < 1) us = 1;
+  sa.sa_handler = profaction;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, &oldaction) != 0)
+    return 0;
+  it.it_interval.tv_sec = us / 1000000;
+  it.it_interval.tv_usec = us % 1000000;
+  it.it_value = it.it_interval;
+  if (setitimer(ITIMER_PROF, &it, NULL) != 0) {
+    sigaction(SIGPROF, &oldaction, NULL);
+    return 0;
+  }
+  return 1;
+}
+
+
+static void l_stoptimer (lua_State *L) {
+  struct itimerval it;
+  (void)L;  /* unused arg. */
+  memset(&it, 0, sizeof(it));
+  setitimer(ITIMER_PROF, &it, NULL);
+  sigaction(SIGPROF, &oldaction, NULL);
+}
+
+#else				/* }{ */
+
+/*
+** Without timers, sample every so many checks for a due sample, which
+** happen every PROFCHECK instructions.
+*/
+
+#define l_sampledue(L)  \
+	(lua_gethookcount(L) == PROFCHECK && ++profticks >= profmaxticks)
+
+#define l_samplereset()	(profticks = 0)
+
+/* rough number of instructions per millisecond */
+#define PROFCOUNT	10000
+
+static unsigned int profticks = 0;  /* checks since the last sample */
+static unsigned int profmaxticks;  /* checks between samples */
+
+static int l_starttimer (lua_State *L, double ms) {
+  double n = ms * PROFCOUNT / PROFCHECK;
+  (void)L;  /* unused arg. */
+  profmaxticks = (n >= UINT_MAX) ? UINT_MAX : (n < 1) ? 1 : (unsigned)n;
+  profticks = 0;
+  return 1;
+}
+
+#define l_stoptimer(L)	((void)(L))
+
+#endif				/* } */
+
+#endif				/* } */
+
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Memory profiler
+** 'memalloc' is the allocation function while the profiler runs; all
+** its allocations go to the original allocator. The type breakdown
+** uses the tag that Lua passes as the old size of a new block.
+** =======================================================
+*/
+
+/* 'site' of a block waiting for the hook */
+#define MEMWAITING	(-1)
+
+/* number of entries for tags: basic types, upvalues, prototypes, rest */
+#define MEMNTAGS	(LUA_NUMTYPES + 3)
+
+
+typedef struct Site {
+  unsigned int hash;
+  char label[PROFLABEL];  /* empty in a free entry */
+  double nallocs;  /* estimated number of allocations */
+  double allocated;  /* estimated number of bytes allocated */
+  double live;  /* estimated number of those bytes still in use */
+} Site;
+
+
+typedef struct Block {
+  void *ptr;  /* NULL in a free entry */
+  double weight;  /* number of bytes that its sample stands for */
+  int site;  /* index in 'sites' or MEMWAITING */
+} Block;
+
+
+typedef struct MemProf {
+  lua_Alloc f;  /* original allocator */
+  void *ud;  /* its user data */
+  lua_State *L;  /* main thread */
+  lua_State *running;  /* last thread to run the hook */
+  int bgsweep;  /* whether background sweeping was on */
+  double rate;  /* mean interval between samples, in bytes */
+  double next;  /* bytes until the next sample */
+  l_uint32 seed;  /* state of the random generator */
+  int unknown;  /* site for samples without a location */
+  unsigned int nsites;  /* number of entries in use in 'sites' */
+  unsigned int nblocks;  /* number of entries in use in 'blocks' */
+  unsigned int nwaiting;  /* number of entries in use in 'waiting' */
+  lua_Integer nsamples;  /* number of samples recorded */
+  lua_Integer ndropped;  /* number of samples that did not fit */
+  double wnallocs, wallocated, wfreed;  /* totals for waiting samples */
+  lua_Integer tcount[MEMNTAGS];  /* number of new blocks for each tag */
+  double tbytes[MEMNTAGS];  /* size of new blocks for each tag */
+  void *waiting[MEMPENDING];  /* sampled blocks without a site */
+  Site *order[MEMNSITES];  /* to sort sites for a report */
+  Site sites[MEMNSITES];
+  Block blocks[MEMNBLOCKS];
+} MemProf;
+
+
+static unsigned int blockhash (void *p) {
+  unsigned int h = point2uint(p) * 2654435761u;
+  return (h ^ (h >> 15)) & (MEMNBLOCKS - 1);
+}
+
+
+/* Index of block 'p' in the table of sampled blocks, or -1 if absent. */
+static int findblock (MemProf *m, void *p) {
+  unsigned int i = blockhash(p);
+  for (;; i = (i + 1) & (MEMNBLOCKS - 1)) {
+    if (m->blocks[i].ptr == p)
+      return cast_int(i);
+    else if (m->blocks[i].ptr == NULL)
+      return -1;
+  }
+}
+
+
+static void insertblock (MemProf *m, const Block *b) {
+  unsigned int i = blockhash(b->ptr);
+  while (m->blocks[i].ptr != NULL)
+    i = (i + 1) & (MEMNBLOCKS - 1);
+  m->blocks[i] = *b;
+  m->nblocks++;
+}
+
+
+/*
+** Remove entry 'i', moving back the entries after it that would not be
+** found otherwise (the table uses linear probing without tombstones).
+*/
+static void removeblock (MemProf *m, unsigned int i) {
+  unsigned int j = i;
+  for (;;) {
+    unsigned int k;
+    j = (j + 1) & (MEMNBLOCKS - 1);
+    if (m->blocks[j].ptr == NULL)
+      break;
+    k = blockhash(m->blocks[j].ptr);
+    if ((i < j) ? (k <= i || k > j) : (k <= i && k > j)) {
+      m->blocks[i] = m->blocks[j];  /* move entry 'j' to the hole */
+      i = j;
+    }
+  }
+  m->blocks[i].ptr = NULL;
+  m->nblocks--;
+}
+
+
+/*
+** Get the index of the site with label 'label', adding it if needed.
+** Returns the index of the unknown site if the table is full.
+*/
+static int findsite (MemProf *m, const char *label) {
+  unsigned int h = hashbytes(PROFSEED, label, strlen(label));
+  unsigned int i = h;
+  for (;; i++) {
+    Site *s = &m->sites[i & (MEMNSITES - 1)];
+    if (s->label[0] == '\0') {  /* free entry? */
+      if (isfull(m->nsites, MEMNSITES))
+        return m->unknown;
+      m->nsites++;
+      s->hash = h;
+      strcpy(s->label, label);
+      return cast_int(i & (MEMNSITES - 1));
+    }
+    else if (s->hash == h && strcmp(s->label, label) == 0)
+      return cast_int(i & (MEMNSITES - 1));
+  }
+}
+
+
+/* Give all waiting samples to site 's'. */
+static void settle (MemProf *m, int s) {
+  Site *site = &m->sites[s];
+  unsigned int i;
+  for (i = 0; i < m->nwaiting; i++) {
+    int b = findblock(m, m->waiting[i]);
+    if (b >= 0 && m->blocks[b].site == MEMWAITING)
+      m->blocks[b].site = s;
+  }
+  site->nallocs += m->wnallocs;
+  site->allocated += m->wallocated;
+  site->live += m->wallocated - m->wfreed;
+  m->wnallocs = m->wallocated = m->wfreed = 0;
+  m->nwaiting = 0;
+}
+
+
+/*
+** Give the waiting samples to the innermost active line. A function
+** being called has not run yet, so the hook skips it.
+*/
+static void memhook (lua_State *L, MemProf *m, lua_Debug *ar) {
+  char label[PROFLABEL];
+  lua_Debug fr;
+  int level = (ar->event == LUA_HOOKCALL || ar->event == LUA_HOOKTAILCALL);
+  for (; lua_getstack(L, level, &fr); level++) {
+    lua_getinfo(L, "Sln", &fr);
+    if (fr.currentline > 0) {
+      framelabel(label, &fr, fr.currentline);
+      settle(m, findsite(m, label));
+      return;
+    }
+  }
+  settle(m, m->unknown);
+}
+
+
+/* Random interval until the next sample (exponential distribution) */
+static double nextgap (MemProf *m) {
+  l_uint32 x = m->seed;
+  x ^= (x << 13) & 0xffffffffu;
+  x ^= x >> 17;
+  x ^= (x << 5) & 0xffffffffu;
+  m->seed = x;
+  return -log(((double)(x >> 8) + 1.0) / 16777216.0) * m->rate;
+}
+
+
+/* Make thread 'L' run the hook on its next instruction */
+static void wakeup (lua_State *L) {
+  lua_Hook h = lua_gethook(L);
+  if (h == NULL || h == profhook)
+    lua_sethook(L, profhook, PROFMASK, 1);
+}
+
+
+/*
+** Sample new block 'p' with 'size' bytes. A block is sampled with
+** probability 1 - exp(-size/rate), so it stands for 'size' divided by
+** that probability to give unbiased estimates.
+*/
+static void sampleblock (MemProf *m, void *p, size_t size) {
+  double s = (double)size;
+  Block b;
+  m->next = nextgap(m);
+  if (m->nwaiting == MEMPENDING || isfull(m->nblocks, MEMNBLOCKS)) {
+    m->ndropped++;
+    return;
+  }
+  b.ptr = p;
+  b.weight = s / (1.0 - exp(-s / m->rate));
+  b.site = MEMWAITING;
+  insertblock(m, &b);
+  m->waiting[m->nwaiting++] = p;
+  m->wnallocs += b.weight / s;
+  m->wallocated += b.weight;
+  m->nsamples++;
+  wakeup(m->L);
+  wakeup(m->running);
+}
+
+
+/* Sampled block 'b' was freed */
+static void freeblock (MemProf *m, int b) {
+  Block *bl = &m->blocks[b];
+  if (bl->site == MEMWAITING)
+    m->wfreed += bl->weight;
+  else
+    m->sites[bl->site].live -= bl->weight;
+  removeblock(m, cast_uint(b));
+}
+
+
+/* Sampled block 'b' was moved to 'p' */
+static void moveblock (MemProf *m, int b, void *p) {
+  Block bl = m->blocks[b];
+  if (bl.site == MEMWAITING) {  /* correct its entry in 'waiting' */
+    unsigned int i;
+    for (i = 0; i < m->nwaiting; i++) {
+      if (m->waiting[i] == bl.ptr)
+        m->waiting[i] = p;
+    }
+  }
+  removeblock(m, cast_uint(b));
+  bl.ptr = p;
+  insertblock(m, &bl);
+}
+
+
+static void *memalloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  MemProf *m = (MemProf *)ud;
+  int b = (ptr != NULL && m->nblocks > 0) ? findblock(m, ptr) : -1;
+  void *res = m->f(m->ud, ptr, osize, nsize);
+  size_t grown;
+  if (ptr == NULL) {  /* new block? ('osize' is its tag) */
+    int t = (osize < MEMNTAGS) ? cast_int(osize) : MEMNTAGS - 1;
+    if (res == NULL)
+      return NULL;
+    m->tcount[t]++;
+    m->tbytes[t] += (double)nsize;
+    grown = nsize;
+  }
+  else {
+    if (b >= 0) {  /* sampled block? */
+      if (nsize == 0)
+        freeblock(m, b);
+      else if (res != NULL && res != ptr)
+        moveblock(m, b, res);
+    }
+    if (res == NULL || nsize <= osize)
+      return res;
+    grown = nsize - osize;
+  }
+  if ((m->next -= (double)grown) <= 0)
+    sampleblock(m, res, nsize);
+  return res;
+}
+
+
+/*
+** Keep 'L' as the thread running Lua code, anchored in the registry
+** so that it is not collected while 'm' refers to it.
+*/
+static void setrunning (lua_State *L, MemProf *m) {
+  lua_pushthread(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, m);
+  m->running = L;
+}
+
+
+/* Memory profiler running in the state of 'L', if any */
+static MemProf *runmemprof (lua_State *L) {
+  void *ud;
+  return (lua_getallocf(L, &ud) == memalloc) ? (MemProf *)ud : NULL;
+}
+
+/* }====================================================== */
+
+
+/*
+** Make thread 'L' check for due samples (and so the coroutines it
+** creates), unless it has another hook.
+*/
+static void waitsamples (lua_State *L) {
+  lua_Hook h = lua_gethook(L);
+  if (h == NULL || h == profhook)
+    lua_sethook(L, profhook, LUA_MASKCOUNT, PROFCHECK);
+}
+
+
+/* Check whether 'L' is a thread of the state with main thread 'L1' */
+static int instate (lua_State *L, lua_State *L1) {
+  lua_State *mainth;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+  mainth = lua_tothread(L, -1);
+  lua_pop(L, 1);
+  return (mainth == L1);
+}
+
+
+static void profhook (lua_State *L, lua_Debug *ar) {
+  Profiler *p = runprof;
+  MemProf *m = runmemprof(L);
+  if (p == NULL && m == NULL) {  /* profilers stopped? */
+    lua_sethook(L, NULL, 0, 0);  /* reset hook */
+    return;
+  }
+  if (p != NULL && l_sampledue(L) && instate(L, profL)) {
+    l_samplereset();
+    takesample(L, p);
+  }
+  if (m != NULL) {
+    if (m->running != L)
+      setrunning(L, m);
+    if (m->nwaiting > 0)
+      memhook(L, m, ar);
+  }
+  if (lua_gethookmask(L) != LUA_MASKCOUNT)
+    waitsamples(L);  /* back to checking every PROFCHECK instructions */
+}
+
+
+static Profiler *getprof (lua_State *L) {
+  return (Profiler *)lua_touserdata(L, lua_upvalueindex(1));
+}
+
+
+/*
+** Remove the hooks of thread 'L' and of main thread 'mainth'. Other
+** threads remove their hooks the next time they run them.
+*/
+static void stopwaiting (lua_State *L, lua_State *mainth) {
+  if (lua_gethook(L) == profhook)
+    lua_sethook(L, NULL, 0, 0);
+  if (lua_gethook(mainth) == profhook)
+    lua_sethook(mainth, NULL, 0, 0);
+}
+
+
+static void stopprof (lua_State *L) {
+  lua_State *mainth = profL;
+  l_stoptimer(mainth);
+  profL = NULL;
+  runprof = NULL;
+  if (runmemprof(L) == NULL)
+    stopwaiting(L, mainth);
+}
+
+
+static void stopmem (lua_State *L, MemProf *m) {
+  lua_setallocf(L, m->f, m->ud);
+  settle(m, m->unknown);  /* hook will not run for these samples */
+  lua_pushnil(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, m);  /* release 'running' */
+  if (m->bgsweep == 1)
+    lua_gc(L, LUA_GCBGSWEEP, 1);
+  if (profL != m->L)  /* no profiler running in this state? */
+    stopwaiting(L, m->L);
+}
+
+
+static int prof_start (lua_State *L) {
+  Profiler *p = getprof(L);
+  double ms = (double)luaL_optnumber(L, 1, PROFINTERVAL);
+  lua_State *mainth;
+  luaL_argcheck(L, ms > 0, 1, "interval must be positive");
+  if (runprof != NULL)
+    return luaL_error(L, "profiler already running");
+  memset(p, 0, sizeof(Profiler));
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+  mainth = lua_tothread(L, -1);
+  lua_pop(L, 1);
+  waitsamples(mainth);
+  waitsamples(L);
+  runprof = p;
+  profL = mainth;
+  if (!l_starttimer(mainth, ms)) {
+    runprof = NULL;  /* hooks will remove themselves */
+    profL = NULL;
+    return luaL_error(L, "cannot start profiler timer");
+  }
+  return 0;
+}
+
+
+static int prof_stop (lua_State *L) {
+  Profiler *p = getprof(L);
+  if (runprof == p)
+    stopprof(L);
+  lua_pushinteger(L, p->nsamples);
+  lua_pushinteger(L, p->ndropped);
+  return 2;
+}
+
+
+static void addstackline (luaL_Buffer *b, Profiler *p, Stack *s) {
+  unsigned int i;
+  for (i = s->depth; i > 0; i--) {  /* from root to leaf */
+    luaL_addstring(b, p->frames[p->pool[s->start + i - 1]].label);
+    luaL_addchar(b, (i > 1) ? ';' : ' ');
+  }
+  lua_pushinteger(b->L, (lua_Integer)s->count);
+  luaL_addvalue(b);
+  luaL_addchar(b, '\n');
+}
+
+
+static int prof_dump (lua_State *L) {
+  Profiler *p = getprof(L);
+  const char *fname = luaL_optstring(L, 1, NULL);
+  luaL_Buffer b;
+  unsigned int i;
+  lua_settop(L, 1);
+  luaL_buffinit(L, &b);
+  for (i = 0; i < PROFNSTACKS; i++) {
+    if (p->stacks[i].count > 0)
+      addstackline(&b, p, &p->stacks[i]);
+  }
+  luaL_pushresult(&b);
+  if (fname == NULL)
+    return 1;  /* return the result */
+  else {
+    size_t len;
+    const char *res = lua_tolstring(L, -1, &len);
+    FILE *f = fopen(fname, "w");
+    int ok = (f != NULL && fwrite(res, 1, len, f) == len);
+    if (f != NULL)
+      ok = (fclose(f) == 0) && ok;
+    return luaL_fileresult(L, ok, fname);
+  }
+}
+
+
+/*
+** The memory profiler is created on first use and kept as the user
+** value of the profiler.
+*/
+static MemProf *getmemprof (lua_State *L, int create) {
+  MemProf *m;
+  lua_getiuservalue(L, lua_upvalueindex(1), 1);
+  m = (MemProf *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (m == NULL && create) {
+    m = (MemProf *)lua_newuserdatauv(L, sizeof(MemProf), 0);
+    lua_setiuservalue(L, lua_upvalueindex(1), 1);
+  }
+  return m;
+}
+
+
+static int prof_memstart (lua_State *L) {
+  double rate = (double)luaL_optnumber(L, 1, MEMRATE);
+  MemProf *m;
+  luaL_argcheck(L, rate > 0, 1, "rate must be positive");
+  if (runmemprof(L) != NULL)
+    return luaL_error(L, "memory profiler already running");
+  m = getmemprof(L, 1);
+  memset(m, 0, sizeof(MemProf));
+  m->f = lua_getallocf(L, &m->ud);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+  m->L = lua_tothread(L, -1);
+  lua_pop(L, 1);
+  m->rate = rate;
+  m->seed = 0x2545f491u;
+  m->next = nextgap(m);
+  m->unknown = findsite(m, "?");
+  /* 'memalloc' cannot run in another thread */
+  m->bgsweep = lua_gc(L, LUA_GCBGSWEEP, 0);
+  setrunning(L, m);
+  lua_setallocf(L, memalloc, m);
+  waitsamples(m->L);
+  waitsamples(L);
+  return 0;
+}
+
+
+static int prof_memstop (lua_State *L) {
+  MemProf *m = getmemprof(L, 0);
+  if (m == NULL)
+    return 0;
+  if (runmemprof(L) == m)
+    stopmem(L, m);
+  lua_pushinteger(L, m->nsamples);
+  lua_pushinteger(L, m->ndropped);
+  return 2;
+}
+
+
+static int sitecmp (const void *a, const void *b) {
+  const Site *s1 = *(Site *const *)a;
+  const Site *s2 = *(Site *const *)b;
+  if (s1->live != s2->live)
+    return (s1->live < s2->live) ? 1 : -1;
+  else if (s1->allocated != s2->allocated)
+    return (s1->allocated < s2->allocated) ? 1 : -1;
+  else
+    return strcmp(s1->label, s2->label);
+}
+
+
+/* Add numbers 'n[0..k-1]' and a label as a line of a report. */
+static void addreportline (luaL_Buffer *b, const double *n, int k,
+                           const char *label) {
+  char buff[16];
+  int i;
+  for (i = 0; i < k; i++) {
+    int l = l_sprintf(buff, sizeof(buff), "%14.0f ", n[i]);
+    luaL_addlstring(b, buff, cast_sizet(l));
+  }
+  luaL_addchar(b, ' ');
+  luaL_addstring(b, label);
+  luaL_addchar(b, '\n');
+}
+
+
+static const char *tagname (lua_State *L, int t) {
+  if (t > 0 && t < LUA_NUMTYPES)
+    return lua_typename(L, t);
+  else if (t == LUA_NUMTYPES)
+    return "upvalue";
+  else if (t == LUA_NUMTYPES + 1)
+    return "proto";
+  else
+    return "other";  /* not an object */
+}
+
+
+static int prof_memreport (lua_State *L) {
+  MemProf *m = getmemprof(L, 0);
+  lua_Integer topn = luaL_optinteger(L, 1, MEMTOPN);
+  luaL_Buffer b;
+  unsigned int i, n = 0;
+  int t;
+  luaL_buffinit(L, &b);
+  if (m == NULL) {
+    luaL_pushresult(&b);
+    return 1;
+  }
+  for (i = 0; i < MEMNSITES; i++) {
+    Site *s = &m->sites[i];
+    if (s->label[0] != '\0' && s->nallocs > 0)
+      m->order[n++] = s;
+  }
+  qsort(m->order, n, sizeof(m->order[0]), sitecmp);
+  luaL_addstring(&b, "-- sites\n"
+      "     allocated           live         allocs  site\n");
+  for (i = 0; i < n && (lua_Integer)i < topn; i++) {
+    Site *s = m->order[i];
+    double nums[3];
+    nums[0] = s->allocated; nums[2] = s->nallocs;
+    nums[1] = (s->live > 0) ? s->live : 0;  /* may be < 0 by rounding */
+    addreportline(&b, nums, 3, s->label);
+  }
+  luaL_addstring(&b, "-- types\n"
+      "     allocated         allocs  type\n");
+  for (t = 0; t < MEMNTAGS; t++) {
+    if (m->tcount[t] > 0) {
+      double nums[2];
+      nums[0] = m->tbytes[t]; nums[1] = (double)m->tcount[t];
+      addreportline(&b, nums, 2, tagname(L, t));
+    }
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+
+static int prof_gc (lua_State *L) {
+  MemProf *m;
+  if (runprof == (Profiler *)lua_touserdata(L, 1))
+    stopprof(L);  /* do not sample a dead state */
+  lua_getiuservalue(L, 1, 1);
+  m = (MemProf *)lua_touserdata(L, -1);
+  if (m != NULL && runmemprof(L) == m) {
+    m->bgsweep = 0;  /* state may be closing; keep sweeping off */
+    stopmem(L, m);  /* restore the original allocator */
+  }
+  return 0;
+}
+
+
+static const luaL_Reg prof_funcs[] = {
+  {"start", prof_start},
+  {"stop", prof_stop},
+  {"dump", prof_dump},
+  {"memstart", prof_memstart},
+  {"memstop", prof_memstop},
+  {"memreport", prof_memreport},
+  {NULL, NULL}
+};
+
+
+LUAMOD_API int luaopen_profiler (lua_State *L) {
+  luaL_newlibtable(L, prof_funcs);
+  lua_newuserdatauv(L, sizeof(Profiler), 1);
+  memset(lua_touserdata(L, -1), 0, sizeof(Profiler));
+  lua_createtable(L, 0, 1);  /* metatable for the profiler */
+  lua_pushcfunction(L, prof_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+  luaL_setfuncs(L, prof_funcs, 1);  /* profiler as upvalue */
+  return 1;
+}
+
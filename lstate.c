@@ -382,6 +382,15 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, unsigned seed) {
   g->totalobjs = 1;
   g->marked = 0;
   g->GCdebt = 0;
+#if defined(LUA_USE_FIELDCACHE)
+  g->fchits = g->fcmisses = 0;
+#endif
+#if defined(LUA_USE_PARALLELMARK)
+  g->workers = NULL;
+#endif
+#if defined(LUA_USE_BGSWEEP)
+  g->bgsweep = g->bgdefer = NULL;
+#endif
   setivalue(&g->nilvalue, 0);  /* to signal that state is not yet built */
   setgcparam(g, PAUSE, LUAI_GCPAUSE);
   setgcparam(g, STEPMUL, LUAI_GCMUL);
@@ -389,6 +398,7 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, unsigned seed) {
   setgcparam(g, MINORMUL, LUAI_GENMINORMUL);
   setgcparam(g, MINORMAJOR, LUAI_MINORMAJOR);
   setgcparam(g, MAJORMINOR, LUAI_MAJORMINOR);
+  g->gcparams[LUA_GCPWORKERS] = 0;  /* a plain number, not a percentage */
   for (i=0; i < LUA_NUMTYPES; i++) g->mt[i] = NULL;
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
     /* memory allocation error: free partial state */
@@ -413,6 +423,29 @@ void luaE_warning (lua_State *L, const char *msg, int tocont) {
 }
 
 
+#if defined(LUA_USE_CONCATBUF)
+/*
+** Warn with a string that may lack its ending '\0', up to its first
+** zero. (Called after errors in finalizers, so it cannot allocate.)
+*/
+static void warnstring (lua_State *L, TString *ts) {
+  char buff[LUAI_MAXSHORTLEN + 1];
+  size_t len;
+  const char *s = getlstr(ts, len);
+  const char *z = cast_charp(memchr(s, '\0', len));
+  if (z != NULL)
+    len = ct_diff2sz(z - s);
+  while (len > 0) {
+    size_t n = (len < LUAI_MAXSHORTLEN) ? len : LUAI_MAXSHORTLEN;
+    memcpy(buff, s, n * sizeof(char));
+    buff[n] = '\0';
+    luaE_warning(L, buff, 1);
+    s += n; len -= n;
+  }
+}
+#endif
+
+
 /*
 ** Generate a warning from an error message
 */
@@ -425,6 +458,12 @@ void luaE_warnerror (lua_State *L, const char *where) {
   luaE_warning(L, "error in ", 1);
   luaE_warning(L, where, 1);
   luaE_warning(L, " (", 1);
+#if defined(LUA_USE_CONCATBUF)
+  if (ttisstring(errobj) && luaS_noend(tsvalue(errobj))) {
+    warnstring(L, tsvalue(errobj));
+    msg = "";  /* already sent */
+  }
+#endif
   luaE_warning(L, msg, 1);
   luaE_warning(L, ")", 0);
 }
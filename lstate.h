@@ -317,6 +317,17 @@ typedef struct global_State {
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
   lua_WarnFunction warnf;  /* warning function */
   void *ud_warn;         /* auxiliary data to 'warnf' */
+#if defined(LUA_USE_FIELDCACHE)
+  lu_mem fchits;  /* number of hits in field caches */
+  lu_mem fcmisses;  /* number of misses in field caches */
+#endif
+#if defined(LUA_USE_PARALLELMARK)
+  struct GCWorkers *workers;  /* helper threads for marking */
+#endif
+#if defined(LUA_USE_BGSWEEP)
+  struct BGSweep *bgsweep;  /* thread that frees dead objects */
+  struct BGSweep *bgdefer;  /* 'bgsweep' while sweeping, otherwise NULL */
+#endif
 } global_State;
 
 
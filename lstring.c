@@ -50,6 +50,83 @@ int luaS_eqlngstr (TString *a, TString *b) {
 }
 
 
+#if defined(LUA_USE_FASTHASH) && defined(ULLONG_MAX)	/* { */
+
+/*
+** Word-at-a-time hash, after xxHash64. Two independent lanes consume
+** 16 bytes per step; the rest goes in words of 8 and 4 bytes and then
+** single bytes. Unaligned words are read with 'memcpy', which compilers
+** turn into plain loads.
+*/
+
+typedef unsigned long long HWord;
+
+#define HP1	0x9E3779B185EBCA87ull
+#define HP2	0xC2B2AE3D27D4EB4Full
+#define HP3	0x165667B19E3779F9ull
+#define HP4	0x85EBCA77C2B2AE63ull
+#define HP5	0x27D4EB2F165667C5ull
+
+#define rotl64(x,n)	(((x) << (n)) | ((x) >> (64 - (n))))
+
+
+static HWord hround (HWord acc, HWord w) {
+  acc += w * HP2;
+  acc = rotl64(acc, 31);
+  return acc * HP1;
+}
+
+
+static HWord getword (const char *s) {
+  HWord w;
+  memcpy(&w, s, sizeof(w));
+  return w;
+}
+
+
+unsigned luaS_hash (const char *str, size_t l, unsigned seed) {
+  const char *e = str + l;
+  HWord h;
+  if (l >= 16) {
+    HWord a = seed + HP1 + HP2;
+    HWord b = seed + HP2;
+    do {
+      a = hround(a, getword(str));
+      b = hround(b, getword(str + 8));
+      str += 16;
+    } while (e - str >= 16);
+    h = rotl64(a, 1) + rotl64(b, 7);
+    h = (h ^ hround(0, a)) * HP1 + HP4;
+    h = (h ^ hround(0, b)) * HP1 + HP4;
+  }
+  else
+    h = seed + HP5;
+  h += l;
+  for (; e - str >= 8; str += 8) {
+    h ^= hround(0, getword(str));
+    h = rotl64(h, 27) * HP1 + HP4;
+  }
+  if (e - str >= 4) {
+    l_uint32 w;
+    memcpy(&w, str, sizeof(w));
+    h ^= (HWord)w * HP1;
+    h = rotl64(h, 23) * HP2 + HP3;
+    str += 4;
+  }
+  for (; str < e; str++) {
+    h ^= cast_byte(*str) * HP5;
+    h = rotl64(h, 11) * HP1;
+  }
+  h ^= h >> 33;  /* final avalanche */
+  h *= HP2;
+  h ^= h >> 29;
+  h *= HP3;
+  h ^= h >> 32;
+  return cast_uint(h);
+}
+
+#else					/* }{ */
+
 unsigned luaS_hash (const char *str, size_t l, unsigned seed) {
   unsigned int h = seed ^ cast_uint(l);
   for (; l > 0; l--)
@@ -57,6 +134,8 @@ unsigned luaS_hash (const char *str, size_t l, unsigned seed) {
   return h;
 }
 
+#endif					/* } */
+
 
 unsigned luaS_hashlongstr (TString *ts) {
   lua_assert(ts->tt == LUA_VLNGSTR);
@@ -154,8 +233,8 @@ size_t luaS_sizelngstr (size_t len, int kind) {
     case LSTRFIX:  /* fixed external long string */
       /* don't need 'falloc'/'ud' */
       return offsetof(TString, falloc);
-    default:  /* external long string with deallocation */
-      lua_assert(kind == LSTRMEM);
+    default:  /* external long string or string in a buffer */
+      lua_assert(kind == LSTRMEM || kind == LSTRBUF);
       return sizeof(TString);
   }
 }
@@ -357,3 +436,113 @@ TString *luaS_newextlstr (lua_State *L,
 }
 
 
+#if defined(LUA_USE_CONCATBUF)
+/*
+** {==================================================================
+** Concatenation buffers
+** A concatenation that extends a long string ('luaS_extend') puts its
+** result in a buffer with room to grow. When that result is extended
+** in turn, the new string shares the buffer, which gets the new bytes
+** after the old ones; so, a loop like 's = s .. x' copies each byte a
+** bounded number of times. Bytes already in a buffer never change,
+** but only its longest string (its "tip") is followed by a '\0'. A
+** string that needs its '\0' ('luaS_seal') either stops the growth of
+** its buffer, if it is the tip, or moves to a buffer of its own.
+** ===================================================================
+*/
+
+typedef struct StrBuf {
+  l_obj nrefs;  /* number of strings using this buffer */
+  size_t size;  /* size of 'buff' */
+  size_t n;  /* length of the tip */
+  size_t lim;  /* maximum length for a new tip */
+  char buff[1];
+} StrBuf;
+
+
+#define sizestrbuf(size)	(offsetof(StrBuf, buff) + (size))
+
+#define tsbuf(ts)	cast(StrBuf *, (ts)->ud)
+
+
+static StrBuf *newstrbuf (lua_State *L, size_t size) {
+  StrBuf *b = cast(StrBuf *, luaM_newblock(L, sizestrbuf(size)));
+  b->nrefs = 0;
+  b->size = size;
+  b->n = 0;
+  b->lim = size - 1;
+  return b;
+}
+
+
+static void releasebuf (lua_State *L, StrBuf *b) {
+  if (--b->nrefs == 0)
+    luaM_freemem(L, b, sizestrbuf(b->size));
+}
+
+
+/* make 'ts' the new tip of buffer 'b', with length 'l' */
+static void settip (TString *ts, StrBuf *b, size_t l) {
+  ts->shrlen = LSTRBUF;
+  ts->u.lnglen = l;
+  ts->contents = b->buff;
+  ts->falloc = NULL;
+  ts->ud = b;
+  b->nrefs++;
+  b->n = l;
+  b->buff[l] = '\0';
+}
+
+
+/*
+** Create a string with length 'l' whose first bytes are the contents
+** of 'a'. The caller fills in the rest.
+*/
+TString *luaS_extend (lua_State *L, TString *a, size_t l) {
+  size_t la = tsslen(a);
+  StrBuf *b;
+  TString *ts;
+  lua_assert(la < l);
+  if (a->shrlen == LSTRBUF && tsbuf(a)->n == la && l <= tsbuf(a)->lim) {
+    b = tsbuf(a);  /* 'a' is a tip with room: share its buffer */
+    ts = createstrobj(L, luaS_sizelngstr(0, LSTRBUF), LUA_VLNGSTR,
+                      G(L)->seed);
+  }
+  else {  /* copy 'a' to a new buffer with room to grow */
+    struct NewExt ne;
+    size_t size = (l < (MAX_SIZE - 1) / 3 * 2) ? l + l / 2 + 1 : l + 1;
+    b = newstrbuf(L, size);
+    memcpy(b->buff, getstr(a), la * sizeof(char));
+    ne.kind = LSTRBUF;
+    if (luaD_rawrunprotected(L, f_newext, &ne) != LUA_OK) {  /* error? */
+      luaM_freemem(L, b, sizestrbuf(size));
+      luaM_error(L);  /* re-raise memory error */
+    }
+    ts = ne.ts;
+  }
+  settip(ts, b, l);
+  return ts;
+}
+
+
+void luaS_seal_ (lua_State *L, TString *ts) {
+  StrBuf *b = tsbuf(ts);
+  size_t l = ts->u.lnglen;
+  if (b->n == l)  /* tip? */
+    b->lim = l;  /* buffer cannot grow anymore */
+  else if (ts->contents[l] != '\0') {  /* no ending zero? */
+    StrBuf *nb = newstrbuf(L, l + 1);  /* move it to its own buffer */
+    memcpy(nb->buff, ts->contents, l * sizeof(char));
+    releasebuf(L, b);
+    settip(ts, nb, l);
+    nb->lim = l;
+  }
+}
+
+
+void luaS_freebuf (lua_State *L, TString *ts) {
+  releasebuf(L, tsbuf(ts));
+}
+
+/* }================================================================== */
+#endif
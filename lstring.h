@@ -70,4 +70,30 @@ LUAI_FUNC TString *luaS_newextlstr (lua_State *L,
 		const char *s, size_t len, lua_Alloc falloc, void *ud);
 LUAI_FUNC size_t luaS_sizelngstr (size_t len, int kind);
 
+
+#if defined(LUA_USE_CONCATBUF)
+
+/*
+** ensure that a string keeps a '\0' after its contents
+*/
+#define luaS_seal(L,ts)  \
+	((ts)->shrlen == LSTRBUF ? luaS_seal_(L,ts) : (void)0)
+
+/*
+** test whether a string may lack its ending '\0'
+*/
+#define luaS_noend(ts)  \
+	((ts)->shrlen == LSTRBUF && (ts)->contents[(ts)->u.lnglen] != '\0')
+
+LUAI_FUNC TString *luaS_extend (lua_State *L, TString *a, size_t l);
+LUAI_FUNC void luaS_seal_ (lua_State *L, TString *ts);
+LUAI_FUNC void luaS_freebuf (lua_State *L, TString *ts);
+
+#else
+
+#define luaS_seal(L,ts)		((void)(L), (void)(ts))
+#define luaS_noend(ts)		0
+
+#endif
+
 #endif
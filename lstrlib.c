@@ -20,6 +20,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "lua.h"
 
 #include "lauxlib.h"
@@ -94,13 +98,85 @@ static int str_sub (lua_State *L) {
 }
 
 
+/*
+** {======================================================
+** Byte kernels for 'reverse', 'lower', and 'upper'
+** =======================================================
+*/
+
+/* put in 'p' the 'l' bytes of 's' in reverse order */
+static void revbytes (char *p, const char *s, size_t l) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; l - i >= 16; i += 16) {
+    __m128i c = _mm_loadu_si128((const __m128i *)(s + l - i - 16));
+    c = _mm_or_si128(_mm_slli_epi16(c, 8), _mm_srli_epi16(c, 8));
+    c = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0x1B), 0x1B);
+    c = _mm_shuffle_epi32(c, 0x4E);  /* swap halves */
+    _mm_storeu_si128((__m128i *)(p + i), c);
+  }
+#endif
+  for (; i < l; i++)
+    p[i] = s[l - i - 1];
+}
+
+
+/*
+** Check whether character classes come from the "C" locale, where
+** only ASCII letters change case.
+*/
+static int clocale (void) {
+  const char *loc = setlocale(LC_CTYPE, NULL);
+  return (loc != NULL &&
+          (strcmp(loc, "C") == 0 || strcmp(loc, "POSIX") == 0));
+}
+
+
+/*
+** Copy the 'l' bytes of 's' to 'p', flipping the case of the ASCII
+** letters in ['first', 'first' + 25] (upper or lower case letters).
+*/
+static void flipcase (char *p, const char *s, size_t l, int first) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i lo = _mm_set1_epi8(cast_char(first - 1));
+  const __m128i hi = _mm_set1_epi8(cast_char(first + 26));
+  const __m128i bit = _mm_set1_epi8(0x20);
+  for (; l - i >= 16; i += 16) {  /* (non-ASCII bytes are negative) */
+    __m128i c = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i m = _mm_and_si128(_mm_cmpgt_epi8(c, lo), _mm_cmpgt_epi8(hi, c));
+    _mm_storeu_si128((__m128i *)(p + i),
+                     _mm_xor_si128(c, _mm_and_si128(m, bit)));
+  }
+#else
+  const size_t ones = ~(size_t)0 / 0xFF;  /* 0x01 in each byte */
+  for (; l - i >= sizeof(size_t); i += sizeof(size_t)) {
+    size_t w, h, m;
+    memcpy(&w, s + i, sizeof(w));
+    h = w & (ones * 0x7F);  /* clear high bits, so no carries below */
+    /* high bit of each byte: 'h' >= 'first' xor 'h' > 'first' + 25 */
+    m = (h + ones * cast_sizet(0x80 - first)) ^
+        (h + ones * cast_sizet(0x7F - (first + 25)));
+    m &= ~w & (ones * 0x80);  /* only for ASCII bytes */
+    w ^= m >> 2;  /* flip bit 0x20 of letters */
+    memcpy(p + i, &w, sizeof(w));
+  }
+#endif
+  for (; i < l; i++) {
+    int c = cast_uchar(s[i]);
+    p[i] = cast_char((first <= c && c <= first + 25) ? c ^ 0x20 : c);
+  }
+}
+
+/* }====================================================== */
+
+
 static int str_reverse (lua_State *L) {
-  size_t l, i;
+  size_t l;
   luaL_Buffer b;
   const char *s = luaL_checklstring(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
-  for (i = 0; i < l; i++)
-    p[i] = s[l - i - 1];
+  revbytes(p, s, l);
   luaL_pushresultsize(&b, l);
   return 1;
 }
@@ -112,8 +188,12 @@ static int str_lower (lua_State *L) {
   luaL_Buffer b;
   const char *s = luaL_checklstring(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
-  for (i=0; i<l; i++)
-    p[i] = cast_char(tolower(cast_uchar(s[i])));
+  if (clocale())
+    flipcase(p, s, l, 'A');
+  else {
+    for (i=0; i<l; i++)
+      p[i] = cast_char(tolower(cast_uchar(s[i])));
+  }
   luaL_pushresultsize(&b, l);
   return 1;
 }
@@ -125,13 +205,21 @@ static int str_upper (lua_State *L) {
   luaL_Buffer b;
   const char *s = luaL_checklstring(L, 1, &l);
   char *p = luaL_buffinitsize(L, &b, l);
-  for (i=0; i<l; i++)
-    p[i] = cast_char(toupper(cast_uchar(s[i])));
+  if (clocale())
+    flipcase(p, s, l, 'a');
+  else {
+    for (i=0; i<l; i++)
+      p[i] = cast_char(toupper(cast_uchar(s[i])));
+  }
   luaL_pushresultsize(&b, l);
   return 1;
 }
 
 
+/*
+** Copies are made by doubling: after the first copy of 's' followed by
+** 'sep', each 'memcpy' duplicates everything written so far.
+*/
 static int str_rep (lua_State *L) {
   size_t l, lsep;
   const char *s = luaL_checklstring(L, 1, &l);
@@ -143,16 +231,20 @@ static int str_rep (lua_State *L) {
     return luaL_error(L, "resulting string too large");
   else {
     size_t totallen = ((size_t)n * (l + lsep)) - lsep;
+    size_t done;  /* number of bytes already written */
     luaL_Buffer b;
     char *p = luaL_buffinitsize(L, &b, totallen);
-    while (n-- > 1) {  /* first n-1 copies (followed by separator) */
-      memcpy(p, s, l * sizeof(char)); p += l;
-      if (lsep > 0) {  /* empty 'memcpy' is not that cheap */
-        memcpy(p, sep, lsep * sizeof(char));
-        p += lsep;
-      }
+    memcpy(p, s, l * sizeof(char));  /* first copy */
+    done = l;
+    if (n > 1 && lsep > 0) {
+      memcpy(p + l, sep, lsep * sizeof(char));
+      done += lsep;
+    }
+    while (done < totallen) {  /* double what is written */
+      size_t k = (done < totallen - done) ? done : totallen - done;
+      memcpy(p + done, p, k * sizeof(char));
+      done += k;
     }
-    memcpy(p, s, l * sizeof(char));  /* last copy (not followed by separator) */
     luaL_pushresultsize(&b, totallen);
   }
   return 1;
@@ -335,6 +427,287 @@ static const luaL_Reg stringmetamethods[] = {
 
 /* }====================================================== */
 
+/*
+** {======================================================
+** PLAIN SEARCH
+** =======================================================
+*/
+
+/*
+** Needles up to this length are searched by filtering candidate
+** positions on two of their bytes; longer ones use the Two-Way
+** algorithm, which is linear in the worst case.
+*/
+#if !defined(MAXSHORTNEEDLE)
+#define MAXSHORTNEEDLE	32
+#endif
+
+
+/*
+** Rank of each byte by its frequency in text and source code (0 is
+** the rarest), measured over the sources and tests of Lua itself.
+*/
+static const lu_byte byterank[256] = {
+    0,   1,   2,   3,   4,   5,   6,   7,
+    8, 193, 247,   9,  10,  11,  12,  13,
+   14,  15,  16,  17,  18,  19,  20,  21,
+   22,  23,  24,  25,  26,  27,  28,  29,
+  255, 169, 225, 199, 164, 176, 187, 217,
+  239, 240, 235, 194, 237, 226, 227, 224,
+  219, 222, 211, 195, 185, 181, 175, 173,
+  178, 172, 189, 228, 184, 242, 209, 170,
+  206, 213, 192, 203, 182, 204, 191, 188,
+  171, 208, 160, 179, 229, 190, 205, 202,
+  196, 161, 201, 210, 212, 207, 180, 167,
+  174, 165, 163, 198, 183, 200, 166, 230,
+  157, 252, 231, 244, 241, 254, 238, 232,
+  236, 250, 186, 218, 245, 233, 251, 246,
+  234, 168, 248, 249, 253, 243, 223, 214,
+  216, 215, 197, 221, 177, 220, 162,  30,
+   31, 106,  32,  33, 107,  34, 108,  35,
+   36, 140, 109,  37,  38,  39, 110,  40,
+   41,  42, 111, 133,  43,  44,  45, 147,
+  112,  46,  47,  48, 129,  49, 113,  50,
+  137, 158, 143, 114, 115, 130, 134, 148,
+  131, 155, 116, 117, 118, 154,  51,  52,
+   53, 150, 119, 141,  54, 120, 121, 122,
+   55,  56, 151, 132, 142,  57,  58,  59,
+   60, 144,  61, 159,  62,  63,  64, 123,
+   65, 138,  66,  67,  68,  69, 135, 124,
+   70,  71,  72,  73,  74,  75,  76,  77,
+   78,  79,  80,  81,  82,  83,  84,  85,
+   86, 149,  87, 125,  88, 145, 152, 126,
+  127, 153, 136,  89,  90, 139,  91,  92,
+  156,  93,  94, 146,  95,  96,  97,  98,
+   99, 100, 128, 101, 102, 103, 104, 105,
+};
+
+
+/*
+** Find in needle 'p' (with length 'lp' > 1) the positions of its two
+** rarest bytes, preferring two different bytes.
+*/
+static void rarepair (const char *p, size_t lp, size_t *r1, size_t *r2) {
+  size_t i;
+  size_t i1 = 0, i2 = 1;
+  if (byterank[cast_uchar(p[1])] < byterank[cast_uchar(p[0])]) {
+    i1 = 1; i2 = 0;
+  }
+  for (i = 2; i < lp; i++) {
+    lu_byte r = byterank[cast_uchar(p[i])];
+    if (r < byterank[cast_uchar(p[i1])]) {
+      i2 = i1; i1 = i;
+    }
+    else if (p[i] != p[i1] &&
+             (p[i2] == p[i1] || r < byterank[cast_uchar(p[i2])]))
+      i2 = i;
+  }
+  *r1 = i1; *r2 = i2;
+}
+
+
+#if defined(__SSE2__)
+
+#if defined(__GNUC__)
+#define lowbit(m)	cast_uint(__builtin_ctz(m))
+#else
+static unsigned lowbit (unsigned m) {
+  unsigned i = 0;
+  while (!(m & 1u)) { m >>= 1; i++; }
+  return i;
+}
+#endif
+
+#endif
+
+
+/*
+** Search for a short needle 'p' (1 < lp <= ls): only positions where
+** its two rarest bytes match are compared in full. 'memchr' skips to
+** the next occurrence of the rarest byte; with SSE2, the 16 positions
+** from there are then filtered at once.
+*/
+static const char *shortfind (const char *s, size_t ls,
+                              const char *p, size_t lp) {
+  size_t i1, i2;
+  const char *last = s + (ls - lp);  /* last possible start */
+  rarepair(p, lp, &i1, &i2);
+#if defined(__SSE2__)
+  {
+    __m128i c1 = _mm_set1_epi8(p[i1]);
+    __m128i c2 = _mm_set1_epi8(p[i2]);
+    while (last - s >= 15) {  /* at least 16 positions to check? */
+      __m128i b1, b2;
+      unsigned m;
+      const char *c = (const char *)memchr(s + i1, p[i1],
+                                           ct_diff2sz(last - s) + 1);
+      if (c == NULL)
+        return NULL;
+      s = c - i1;  /* skip positions without the rarest byte */
+      if (last - s < 15)
+        break;
+      b1 = _mm_loadu_si128((const __m128i *)(s + i1));
+      b2 = _mm_loadu_si128((const __m128i *)(s + i2));
+      m = cast_uint(_mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(b1, c1), _mm_cmpeq_epi8(b2, c2))));
+      while (m != 0) {  /* compare candidates in full */
+        c = s + lowbit(m);
+        if (memcmp(c, p, lp) == 0)
+          return c;
+        m &= m - 1u;
+      }
+      s += 16;
+    }
+  }
+#endif
+  while (s <= last) {
+    const char *c = (const char *)memchr(s + i1, p[i1],
+                                         ct_diff2sz(last - s) + 1);
+    if (c == NULL)
+      return NULL;
+    c -= i1;  /* candidate start */
+    if (c[i2] == p[i2] && memcmp(c, p, lp) == 0)
+      return c;
+    s = c + 1;
+  }
+  return NULL;
+}
+
+
+/*
+** Compute the maximal suffix of needle 'p' under byte order 'rev'
+** (reverse order if true). Return its start minus one (as an unsigned,
+** so -1 wraps around) and put its period in '*per'.
+*/
+static size_t maxsuffix (const unsigned char *p, size_t lp, int rev,
+                         size_t *per) {
+  size_t ip = ~(size_t)0;  /* start of suffix minus one */
+  size_t jp = 0;  /* candidate suffix being compared */
+  size_t k = 1, pp = 1;  /* offset inside comparison and period */
+  while (jp + k < lp) {
+    unsigned char a = p[ip + k], b = p[jp + k];
+    if (a == b) {
+      if (k == pp) { jp += pp; k = 1; }
+      else k++;
+    }
+    else if (rev ? a < b : a > b) {  /* candidate is smaller suffix */
+      jp += k; k = 1; pp = jp - ip;
+    }
+    else {  /* candidate is the new maximal suffix */
+      ip = jp++; k = pp = 1;
+    }
+  }
+  *per = pp;
+  return ip;
+}
+
+
+/* maximum credit for short skips in 'twoway' */
+#define MAXSKIPCREDIT	16
+
+
+/*
+** Two-Way search (Crochemore and Perrin) for a long needle 'p'
+** (lp <= ls). The needle is split at a critical factorization: the
+** right part is compared left to right, and then the left part right
+** to left; the shift after a mismatch never misses an occurrence.
+** Before that, the window skips to the next occurrence of the rarest
+** byte of the needle (unless part of it is known to match), and a
+** mismatch at its last byte shifts it as in Horspool's algorithm.
+** Skips that are too short use up a credit; when it ends, the rarest
+** byte is too common in the subject and skipping stops.
+*/
+static const char *twoway (const char *s, size_t ls,
+                           const char *p, size_t lp) {
+  const unsigned char *h = (const unsigned char *)s;
+  const unsigned char *n = (const unsigned char *)p;
+  size_t shift[256];  /* 1 + last position of each byte in the needle */
+  size_t ms, per, per1, i, k;
+  size_t r = 0;  /* position of the rarest byte in the needle */
+  int credit = MAXSKIPCREDIT;
+  size_t mem = 0;  /* prefix of the window already known to match */
+  size_t mem0;  /* value of 'mem' after a full-period shift */
+  size_t left = ls - lp;  /* shifts left before window leaves 's' */
+  memset(shift, 0, sizeof(shift));
+  for (i = 0; i < lp; i++) {
+    shift[n[i]] = i + 1;
+    if (byterank[n[i]] < byterank[n[r]])
+      r = i;
+  }
+  ms = maxsuffix(n, lp, 0, &per);
+  i = maxsuffix(n, lp, 1, &per1);
+  if (i + 1 > ms + 1) {  /* reverse order gives a longer suffix? */
+    ms = i; per = per1;
+  }
+  if (memcmp(n, n + per, ms + 1) != 0) {  /* non-periodic needle? */
+    per = ((ms > lp - ms - 1) ? ms : lp - ms - 1) + 1;
+    mem0 = 0;
+  }
+  else  /* periodic needle */
+    mem0 = lp - per;
+  for (;;) {
+    size_t step, sh;
+    if (mem == 0 && credit > 0) {  /* skip to next rarest byte */
+      const unsigned char *c = (const unsigned char *)memchr(h + r, n[r],
+                                                             left + 1);
+      if (c == NULL)
+        return NULL;
+      step = ct_diff2sz(c - (h + r));
+      if (step < lp)
+        credit--;
+      else if (credit < MAXSKIPCREDIT)
+        credit++;
+      left -= step;
+      h += step;
+    }
+    sh = shift[h[lp - 1]];
+    if (sh != lp) {  /* last byte of window does not match? */
+      step = lp - sh;
+      if (step < mem) step = mem;
+      mem = 0;
+    }
+    else {
+      for (k = (ms + 1 > mem) ? ms + 1 : mem; k < lp && n[k] == h[k]; k++);
+      if (k < lp) {  /* mismatch in the right part? */
+        step = k - ms;
+        mem = 0;
+      }
+      else {
+        for (k = ms + 1; k > mem && n[k - 1] == h[k - 1]; k--);
+        if (k <= mem)
+          return (const char *)h;  /* found it */
+        step = per;
+        mem = mem0;
+      }
+    }
+    if (step > left)
+      return NULL;  /* window would leave the subject */
+    left -= step;
+    h += step;
+  }
+}
+
+
+/*
+** Find the first occurrence of 's2' (with length 'l2') in 's1' (with
+** length 'l1').
+*/
+static const char *lmemfind (const char *s1, size_t l1,
+                             const char *s2, size_t l2) {
+  if (l2 == 0) return s1;  /* empty strings are everywhere */
+  else if (l2 > l1) return NULL;  /* avoids a negative 'l1' */
+  else if (l2 == 1)
+    return (const char *)memchr(s1, *s2, l1);
+  else if (l2 <= MAXSHORTNEEDLE)
+    return shortfind(s1, l1, s2, l2);
+  else
+    return twoway(s1, l1, s2, l2);
+}
+
+/* }====================================================== */
+
+
+
 /*
 ** {======================================================
 ** PATTERN MATCHING
@@ -353,6 +726,9 @@ typedef struct MatchState {
   lua_State *L;
   int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
   int level;  /* total number of captures (finished or unfinished) */
+  int memoslot;  /* stack index to keep 'memo', or 0 */
+  unsigned char *memo;  /* bitmap of failed states (compiled patterns) */
+  size_t nbt;  /* number of backtracks (compiled patterns) */
   struct {
     const char *init;
     ptrdiff_t len;  /* length or special value (CAP_*) */
@@ -391,19 +767,22 @@ static int capture_to_close (MatchState *ms) {
 }
 
 
-static const char *classend (MatchState *ms, const char *p) {
+/*
+** Return the end of the class at 'p', or NULL if it is malformed.
+*/
+static const char *classlimit (const char *p, const char *p_end) {
   switch (*p++) {
     case L_ESC: {
-      if (l_unlikely(p == ms->p_end))
-        luaL_error(ms->L, "malformed pattern (ends with '%%')");
+      if (l_unlikely(p == p_end))
+        return NULL;  /* pattern ends with '%' */
       return p+1;
     }
     case '[': {
       if (*p == '^') p++;
       do {  /* look for a ']' */
-        if (l_unlikely(p == ms->p_end))
-          luaL_error(ms->L, "malformed pattern (missing ']')");
-        if (*(p++) == L_ESC && p < ms->p_end)
+        if (l_unlikely(p == p_end))
+          return NULL;  /* missing ']' */
+        if (*(p++) == L_ESC && p < p_end)
           p++;  /* skip escapes (e.g. '%]') */
       } while (*p != ']');
       return p+1;
@@ -415,6 +794,18 @@ static const char *classend (MatchState *ms, const char *p) {
 }
 
 
+static const char *classend (MatchState *ms, const char *p) {
+  const char *ep = classlimit(p, ms->p_end);
+  if (l_unlikely(ep == NULL)) {
+    if (*p == L_ESC)
+      luaL_error(ms->L, "malformed pattern (ends with '%%')");
+    else
+      luaL_error(ms->L, "malformed pattern (missing ']')");
+  }
+  return ep;
+}
+
+
 static int match_class (int c, int cl) {
   int res;
   switch (tolower(cl)) {
@@ -474,26 +865,30 @@ static int singlematch (MatchState *ms, const char *s, const char *p,
 }
 
 
-static const char *matchbalance (MatchState *ms, const char *s,
-                                   const char *p) {
-  if (l_unlikely(p >= ms->p_end - 1))
-    luaL_error(ms->L, "malformed pattern (missing arguments to '%%b')");
-  if (*s != *p) return NULL;
+/* match a balanced string delimited by 'b' and 'e' */
+static const char *balance (MatchState *ms, const char *s, int b, int e) {
+  if (s >= ms->src_end || cast_uchar(*s) != b) return NULL;
   else {
-    int b = *p;
-    int e = *(p+1);
     int cont = 1;
     while (++s < ms->src_end) {
-      if (*s == e) {
+      if (cast_uchar(*s) == e) {
         if (--cont == 0) return s+1;
       }
-      else if (*s == b) cont++;
+      else if (cast_uchar(*s) == b) cont++;
     }
   }
   return NULL;  /* string ends out of balance */
 }
 
 
+static const char *matchbalance (MatchState *ms, const char *s,
+                                   const char *p) {
+  if (l_unlikely(p >= ms->p_end - 1))
+    luaL_error(ms->L, "malformed pattern (missing arguments to '%%b')");
+  return balance(ms, s, cast_uchar(*p), cast_uchar(*(p+1)));
+}
+
+
 static const char *max_expand (MatchState *ms, const char *s,
                                  const char *p, const char *ep) {
   ptrdiff_t i = 0;  /* counts maximum expand for item */
@@ -661,28 +1056,721 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
 
 
 
-static const char *lmemfind (const char *s1, size_t l1,
-                               const char *s2, size_t l2) {
-  if (l2 == 0) return s1;  /* empty strings are everywhere */
-  else if (l2 > l1) return NULL;  /* avoids a negative 'l1' */
+/*
+** {======================================================
+** COMPILED PATTERNS
+** =======================================================
+*/
+
+/*
+** Patterns used by 'find', 'match', 'gmatch', and 'gsub' are decoded
+** once into a list of items, kept in a cache table shared by those
+** functions (with weak values, so that programs go away with garbage
+** collection). Malformed patterns are not compiled; the interpreter
+** above raises their errors when it reaches them. Classes become
+** bitmaps, so programs that use classes such as '%a' depend on the
+** locale; the cache keeps the name of the locale where it was built
+** (at index 1), and it is cleared when the locale changes.
+*/
+
+/* kinds of items */
+#define PI_END		0	/* end of pattern */
+#define PI_EOS		1	/* '$' at the end of the pattern */
+#define PI_STR		2	/* literal string */
+#define PI_CHAR		3	/* single character */
+#define PI_ANY		4	/* '.' */
+#define PI_SET		5	/* class or set */
+#define PI_OPENCAP	6	/* '(' */
+#define PI_POSCAP	7	/* '()' */
+#define PI_CLOSECAP	8	/* ')' */
+#define PI_BALANCE	9	/* '%bxy' */
+#define PI_FRONTIER	10	/* '%f[set]' */
+#define PI_BACKREF	11	/* '%1'-'%9' */
+
+
+typedef struct CharSet {
+  unsigned char bits[(UCHAR_MAX + 1) / CHAR_BIT];
+} CharSet;
+
+
+typedef struct PatItem {
+  lu_byte op;  /* kind of item (PI_*) */
+  lu_byte rep;  /* repetition suffix ('*', '+', '-', '?'), or 0 */
+  unsigned char c[2];  /* character (CHAR); delimiters (BALANCE) */
+  int n;  /* length (STR); capture character (BACKREF) */
+  const CharSet *set;  /* set (SET, FRONTIER) */
+  const char *str;  /* contents (STR) */
+} PatItem;
+
+
+typedef struct PatProg {
+  const PatItem *items;  /* items, ending with PI_END */
+  int nitems;  /* number of items */
+  int backref;  /* pattern has back references */
+  int locdep;  /* program depends on the locale */
+} PatProg;
+
+
+#define inset(cs,c)	(((cs)->bits[(c) / CHAR_BIT] >> ((c) % CHAR_BIT)) & 1)
+
+
+/*
+** The compiler runs twice over a pattern: first only counting items,
+** sets, and characters ('items' is NULL), then filling the program.
+*/
+typedef struct PatState {
+  PatItem *items;
+  CharSet *sets;
+  char *chars;
+  int nitems;
+  int nsets;
+  size_t nchars;
+  PatItem *str;  /* literal string being built, if any */
+  int locdep;  /* pattern uses classes */
+  int backref;  /* pattern has back references */
+  PatItem dummyitem;  /* item filled while counting */
+  CharSet dummyset;  /* set filled while counting */
+} PatState;
+
+
+static PatItem *newitem (PatState *ps, int op) {
+  PatItem *it = (ps->items) ? &ps->items[ps->nitems] : &ps->dummyitem;
+  ps->nitems++;
+  ps->str = NULL;
+  it->op = cast_byte(op);
+  it->rep = 0;
+  it->n = 0;
+  it->set = NULL;
+  it->str = NULL;
+  return it;
+}
+
+
+static CharSet *newset (PatState *ps) {
+  CharSet *cs = (ps->sets) ? &ps->sets[ps->nsets] : &ps->dummyset;
+  ps->nsets++;
+  memset(cs, 0, sizeof(CharSet));
+  return cs;
+}
+
+
+static void addlitchar (PatState *ps, char c) {
+  if (ps->str == NULL) {  /* start a new string? */
+    PatItem *it = newitem(ps, PI_STR);
+    if (ps->chars)
+      it->str = ps->chars + ps->nchars;
+    ps->str = it;
+  }
+  if (ps->chars)
+    ps->chars[ps->nchars] = c;
+  ps->nchars++;
+  ps->str->n++;
+}
+
+
+#define setbit(cs,c)	((cs)->bits[(c) / CHAR_BIT] |= \
+				cast_byte(1u << ((c) % CHAR_BIT)))
+
+
+/* is 'cl' (after a '%') a class, instead of a literal character? */
+static int isclass (int cl) {
+  return (cl != '\0' && strchr("acdglpsuwxz", tolower(cl)) != NULL);
+}
+
+
+static void addclass (PatState *ps, CharSet *cs, int cl) {
+  int c;
+  if (isclass(cl))
+    ps->locdep = 1;
+  for (c = 0; c <= UCHAR_MAX; c++)
+    if (match_class(c, cl)) setbit(cs, c);
+}
+
+
+/* compile set from '[' at 'p' to ']' at 'ec' (see 'matchbracketclass') */
+static void addbracket (PatState *ps, CharSet *cs, const char *p,
+                                                   const char *ec) {
+  int neg = 0;
+  size_t i;
+  if (*(p+1) == '^') {
+    neg = 1;
+    p++;  /* skip the '^' */
+  }
+  while (++p < ec) {
+    if (*p == L_ESC) {
+      p++;
+      addclass(ps, cs, cast_uchar(*p));
+    }
+    else if ((*(p+1) == '-') && (p+2 < ec)) {
+      int c;
+      p+=2;
+      for (c = cast_uchar(*(p-2)); c <= cast_uchar(*p); c++)
+        setbit(cs, c);
+    }
+    else setbit(cs, cast_uchar(*p));
+  }
+  if (neg) {
+    for (i = 0; i < sizeof(cs->bits); i++)
+      cs->bits[i] = cast_byte(~cs->bits[i]);
+  }
+}
+
+
+/*
+** Compile pattern 'p' (without its anchor). Return false if the
+** pattern is malformed.
+*/
+static int compile (PatState *ps, const char *p, const char *p_end) {
+  while (p < p_end) {
+    switch (*p) {
+      case '(': {
+        if (*(p + 1) == ')') {  /* position capture? */
+          newitem(ps, PI_POSCAP);
+          p += 2;
+        }
+        else {
+          newitem(ps, PI_OPENCAP);
+          p++;
+        }
+        continue;
+      }
+      case ')': {
+        newitem(ps, PI_CLOSECAP);
+        p++;
+        continue;
+      }
+      case '$': {
+        if ((p + 1) != p_end)  /* is the '$' the last char in pattern? */
+          goto dflt;
+        newitem(ps, PI_EOS);
+        p++;
+        continue;
+      }
+      case L_ESC: {
+        switch (*(p + 1)) {
+          case 'b': {
+            PatItem *it;
+            if (p + 3 >= p_end)
+              return 0;  /* missing arguments to '%b' */
+            it = newitem(ps, PI_BALANCE);
+            it->c[0] = cast_uchar(*(p + 2));
+            it->c[1] = cast_uchar(*(p + 3));
+            p += 4;
+            continue;
+          }
+          case 'f': {
+            const char *ep;
+            CharSet *cs;
+            p += 2;
+            if (*p != '[' || (ep = classlimit(p, p_end)) == NULL)
+              return 0;  /* missing '[' or ']' */
+            cs = newset(ps);
+            addbracket(ps, cs, p, ep - 1);
+            newitem(ps, PI_FRONTIER)->set = cs;
+            p = ep;
+            continue;
+          }
+          case '0': case '1': case '2': case '3':
+          case '4': case '5': case '6': case '7':
+          case '8': case '9': {
+            newitem(ps, PI_BACKREF)->n = cast_uchar(*(p + 1));
+            ps->backref = 1;
+            p += 2;
+            continue;
+          }
+          default: goto dflt;
+        }
+      }
+      default: dflt: {
+        const char *ep = classlimit(p, p_end);
+        PatItem *it;
+        int rep;
+        if (ep == NULL)
+          return 0;  /* malformed class */
+        rep = (*ep == '*' || *ep == '+' || *ep == '-' || *ep == '?')
+                ? cast_uchar(*ep) : 0;
+        if (*p == '.')
+          it = newitem(ps, PI_ANY);
+        else if (*p == '[' || (*p == L_ESC && isclass(cast_uchar(p[1])))) {
+          CharSet *cs = newset(ps);
+          if (*p == '[') addbracket(ps, cs, p, ep - 1);
+          else addclass(ps, cs, cast_uchar(p[1]));
+          it = newitem(ps, PI_SET);
+          it->set = cs;
+        }
+        else {  /* single character */
+          char c = (*p == L_ESC) ? p[1] : p[0];
+          if (rep == 0) {  /* part of a literal string? */
+            addlitchar(ps, c);
+            p = ep;
+            continue;
+          }
+          it = newitem(ps, PI_CHAR);
+          it->c[0] = cast_uchar(c);
+        }
+        it->rep = cast_byte(rep);
+        p = (rep != 0) ? ep + 1 : ep;
+        continue;
+      }
+    }
+  }
+  newitem(ps, PI_END);
+  return 1;
+}
+
+
+/*
+** Check whether the cache was built in the current locale. If not,
+** clear it and record the new locale.
+*/
+static int samelocale (lua_State *L) {
+  const char *loc = setlocale(LC_CTYPE, NULL);
+  const char *cacheloc;
+  int cache = lua_upvalueindex(1);
+  if (loc == NULL) loc = "";
+  lua_rawgeti(L, cache, 1);
+  cacheloc = lua_tostring(L, -1);
+  lua_pop(L, 1);
+  if (cacheloc != NULL && strcmp(cacheloc, loc) == 0)
+    return 1;
+  lua_pushnil(L);
+  while (lua_next(L, cache)) {  /* clear the cache */
+    lua_pop(L, 1);  /* remove value */
+    lua_pushvalue(L, -1);  /* key */
+    lua_pushnil(L);
+    lua_rawset(L, cache);  /* cache[key] = nil */
+  }
+  lua_pushstring(L, loc);
+  lua_rawseti(L, cache, 1);
+  return 0;
+}
+
+
+/*
+** Get the program for the pattern at stack index 2 (string 'p' with
+** length 'lp'), compiling it if it is not in the cache, and push it.
+** For a malformed pattern, push nil and return NULL.
+*/
+static const PatProg *getprog (lua_State *L, const char *p, size_t lp) {
+  PatState ps;
+  PatProg *prog;
+  int anchor = (*p == '^');
+  lua_pushvalue(L, 2);
+  if (lua_rawget(L, lua_upvalueindex(1)) != LUA_TNIL) {
+    prog = (PatProg *)lua_touserdata(L, -1);
+    if (!prog->locdep || samelocale(L))
+      return prog;
+  }
+  lua_pop(L, 1);
+  samelocale(L);  /* new program will be in the current locale */
+  memset(&ps, 0, sizeof(ps));
+  if (!compile(&ps, p + anchor, p + lp)) {  /* counting pass */
+    lua_pushnil(L);
+    return NULL;
+  }
+  prog = (PatProg *)lua_newuserdatauv(L, sizeof(PatProg) +
+             cast_sizet(ps.nitems) * sizeof(PatItem) +
+             cast_sizet(ps.nsets) * sizeof(CharSet) + ps.nchars, 0);
+  ps.items = (PatItem *)(prog + 1);
+  ps.sets = (CharSet *)(ps.items + ps.nitems);
+  ps.chars = (char *)(ps.sets + ps.nsets);
+  ps.nitems = ps.nsets = 0; ps.nchars = 0;
+  compile(&ps, p + anchor, p + lp);  /* filling pass */
+  prog->items = ps.items;
+  prog->nitems = ps.nitems;
+  prog->backref = ps.backref;
+  prog->locdep = ps.locdep;
+  lua_pushvalue(L, 2);
+  lua_pushvalue(L, -2);
+  lua_rawset(L, lua_upvalueindex(1));  /* cache[p] = prog */
+  return prog;
+}
+
+
+static int csinglematch (MatchState *ms, const char *s, const PatItem *pi) {
+  if (s >= ms->src_end)
+    return 0;
   else {
-    const char *init;  /* to search for a '*s2' inside 's1' */
-    l2--;  /* 1st char will be checked by 'memchr' */
-    l1 = l1-l2;  /* 's2' cannot be found after that */
-    while (l1 > 0 && (init = (const char *)memchr(s1, *s2, l1)) != NULL) {
-      init++;   /* 1st char is already checked */
-      if (memcmp(init, s2+1, l2) == 0)
-        return init-1;
-      else {  /* correct 'l1' and 's1' to try again */
-        l1 -= ct_diff2sz(init - s1);
-        s1 = init;
+    int c = cast_uchar(*s);
+    switch (pi->op) {
+      case PI_ANY: return 1;
+      case PI_CHAR: return (pi->c[0] == c);
+      default: return inset(pi->set, c);
+    }
+  }
+}
+
+
+/* can an item that starts with a literal not match at 's'? */
+static int cannotstart (MatchState *ms, const char *s, const PatItem *pi) {
+  if (pi->op == PI_STR)
+    return (s >= ms->src_end || *s != pi->str[0]);
+  else if (pi->op == PI_CHAR && (pi->rep == 0 || pi->rep == '+'))
+    return (s >= ms->src_end || cast_uchar(*s) != pi->c[0]);
+  else
+    return 0;
+}
+
+
+/*
+** The matcher below does what 'match' does, but instead of recursion
+** it keeps an explicit stack of backtrack entries: choice points for
+** repetitions and optional items, and entries to undo changes to
+** captures. The stack starts in the C stack and moves to a userdata
+** when it grows (kept on the Lua stack while matching). When matching
+** backtracks too much, and the pattern has no back references (so
+** that whether a match from an item at a position fails does not
+** depend on how the matcher got there), it also keeps a bitmap of
+** such failed states, so that it does not try them again; that makes
+** the cost polynomial instead of exponential in the number of items.
+** The bitmap is valid for all matches of a pattern over a subject, so
+** it is kept at 'ms->memoslot', provided by the caller. When it cannot
+** use a bitmap, it limits the number of alternatives it tries instead.
+*/
+
+/* initial size of the backtrack stack */
+#if !defined(BTINITSIZE)
+#define BTINITSIZE	32
+#endif
+
+/* maximum size (in bits) for the bitmap of failed states */
+#if !defined(MAXMEMOBITS)
+#define MAXMEMOBITS	(cast_sizet(1) << 26)
+#endif
+
+
+/*
+** When it cannot use the bitmap, matching tries at most this many
+** alternatives per byte of the subject, or MAXMEMOBITS alternatives,
+** whichever is more, before it gives up.
+*/
+#if !defined(BTPERBYTE)
+#define BTPERBYTE	64
+#endif
+
+
+/* kinds of backtrack entries */
+#define BT_OPENCAP	0	/* undo the opening of a capture */
+#define BT_CLOSECAP	1	/* undo the closing of capture 'i' */
+#define BT_MAX		2	/* greedy repetition; next count is 'i' */
+#define BT_MIN		3	/* lazy repetition; next try at 's' */
+#define BT_OPT		4	/* optional item; next alternative is 'i' */
+
+
+typedef struct BTEntry {
+  int kind;
+  const PatItem *pi;  /* item of a choice point */
+  const char *start;  /* where item started */
+  const char *s;  /* where repetitions start */
+  const char *last;  /* where the current alternative started */
+  ptrdiff_t i;
+} BTEntry;
+
+
+typedef struct Matcher {
+  MatchState *ms;
+  const PatProg *prog;
+  BTEntry *stack;
+  int size;  /* size of 'stack' */
+  int n;  /* number of entries in 'stack' */
+  int base;  /* top of the Lua stack before the matcher used it */
+  int stackidx;  /* Lua stack index of 'stack', if it is a userdata */
+  size_t maxbt;  /* limit for 'ms->nbt' without a bitmap, or 0 */
+  BTEntry init[BTINITSIZE];
+} Matcher;
+
+
+static void pushluastack (Matcher *m) {
+  if (m->base < 0)
+    m->base = lua_gettop(m->ms->L);
+  luaL_checkstack(m->ms->L, 1, "too complex");
+}
+
+
+static void pushbt (Matcher *m, int kind, const PatItem *pi,
+                    const char *start, const char *s, ptrdiff_t i) {
+  BTEntry *e;
+  if (l_unlikely(m->n == m->size)) {  /* stack is full? */
+    lua_State *L = m->ms->L;
+    BTEntry *newstack;
+    if (m->size >= INT_MAX / 2 ||
+        cast_sizet(m->size) * 2 >= MAX_SIZET / sizeof(BTEntry))
+      luaL_error(L, "pattern too complex");
+    pushluastack(m);
+    newstack = (BTEntry *)lua_newuserdatauv(L,
+                      cast_sizet(m->size) * 2 * sizeof(BTEntry), 0);
+    memcpy(newstack, m->stack, cast_sizet(m->n) * sizeof(BTEntry));
+    if (m->stackidx == 0)
+      m->stackidx = lua_gettop(L);
+    else
+      lua_replace(L, m->stackidx);  /* old stack is garbage */
+    m->stack = newstack;
+    m->size *= 2;
+  }
+  e = &m->stack[m->n++];
+  e->kind = kind; e->pi = pi; e->start = start; e->s = s; e->i = i;
+}
+
+
+/* index of the state for item 'pi' at position 's' */
+#define stateidx(m,pi,s)  \
+  (cast_sizet((pi) - (m)->prog->items) * \
+     (ct_diff2sz((m)->ms->src_end - (m)->ms->src_init) + 1) + \
+   ct_diff2sz((s) - (m)->ms->src_init))
+
+#define isfailed(m,pi,s)  ((m)->ms->memo != NULL && \
+  ((m)->ms->memo[stateidx(m,pi,s) / CHAR_BIT] >> \
+     (stateidx(m,pi,s) % CHAR_BIT)) & 1)
+
+
+/* number of bits in a bitmap of failed states for 'prog' */
+#define memobits(ms,prog)  (cast_sizet((prog)->nitems) *  \
+  (ct_diff2sz((ms)->src_end - (ms)->src_init) + 1))
+
+
+/*
+** Limit for the number of alternatives tried when matching 'prog'
+** cannot use a bitmap, or 0 if it can. Without the bitmap, that number
+** can be exponential in the number of items.
+*/
+static size_t maxbacktracks (MatchState *ms, const PatProg *prog) {
+  size_t ls = ct_diff2sz(ms->src_end - ms->src_init);
+  if (ms->memoslot != 0 && !prog->backref &&
+      memobits(ms, prog) <= MAXMEMOBITS)
+    return 0;  /* bitmap keeps the cost polynomial */
+  else
+    return (ls < MAXMEMOBITS / BTPERBYTE) ? MAXMEMOBITS : ls * BTPERBYTE;
+}
+
+
+/* count 'k' more alternatives, when there is a limit for them */
+#define addsteps(m,k)  \
+  ((m)->maxbt != 0 && ((m)->ms->nbt += (k)) > (m)->maxbt  \
+     ? (void)luaL_error((m)->ms->L, "pattern too complex") : (void)0)
+
+
+static void setfailed (Matcher *m, const PatItem *pi, const char *s) {
+  MatchState *ms = m->ms;
+  if (ms->memo != NULL) {
+    size_t i = stateidx(m, pi, s);
+    ms->memo[i / CHAR_BIT] |= cast_byte(1u << (i % CHAR_BIT));
+  }
+  else if (m->maxbt == 0 &&  /* can use a bitmap? */
+           ++ms->nbt > ct_diff2sz(ms->src_end - ms->src_init) * 4 + 256) {
+    size_t sz = memobits(ms, m->prog) / CHAR_BIT + 1;  /* start memo */
+    luaL_checkstack(ms->L, 1, "too complex");
+    ms->memo = (unsigned char *)lua_newuserdatauv(ms->L, sz, 0);
+    memset(ms->memo, 0, sz);
+    lua_replace(ms->L, ms->memoslot);
+    setfailed(m, pi, s);
+  }
+}
+
+
+/*
+** Move the choice point at the top of the stack to its next
+** alternative, setting '*ps' and '*ppi' to where matching goes on. If
+** there are no more alternatives, remove the entry and return false.
+*/
+static int nextalt (Matcher *m, const char **ps, const PatItem **ppi) {
+  BTEntry *e = &m->stack[m->n - 1];
+  const PatItem *next = e->pi + 1;
+  MatchState *ms = m->ms;
+  const char *t;
+  for (;;) {
+    addsteps(m, 1);
+    switch (e->kind) {
+      case BT_MAX: {
+        if (e->i < 0) goto done;
+        t = e->s + e->i--;  /* one repetition less */
+        break;
+      }
+      case BT_MIN: {
+        if (e->i) {  /* not the first try? */
+          if (!csinglematch(ms, e->s, e->pi)) goto done;
+          e->s++;  /* one more repetition */
+        }
+        e->i = 1;
+        t = e->s;
+        break;
+      }
+      default: {  /* BT_OPT */
+        lua_assert(e->kind == BT_OPT);
+        if (e->i == 2) goto done;
+        t = (e->i++ == 0) ? e->s + 1 : e->s;  /* with item, then without */
+        break;
+      }
+    }
+    if (!cannotstart(ms, t, next) && !isfailed(m, next, t)) {
+      e->last = t;
+      *ps = t; *ppi = next;
+      return 1;
+    }
+  }
+ done:
+  setfailed(m, e->pi, e->start);  /* no match from this item */
+  m->n--;  /* remove exhausted choice point */
+  return 0;
+}
+
+
+static const char *endmatcher (Matcher *m, const char *res) {
+  if (m->base >= 0)  /* used the Lua stack? */
+    lua_settop(m->ms->L, m->base);
+  return res;
+}
+
+
+static const char *cmatch (MatchState *ms, const char *s,
+                           const PatProg *prog) {
+  Matcher m;
+  const PatItem *pi = prog->items;
+  m.ms = ms; m.prog = prog;
+  m.stack = m.init; m.size = BTINITSIZE; m.n = 0;
+  m.base = -1; m.stackidx = 0;
+  m.maxbt = maxbacktracks(ms, prog);
+  for (;;) {
+    switch (pi->op) {
+      case PI_END:
+        return endmatcher(&m, s);
+      case PI_EOS: {
+        if (s != ms->src_end) goto fail;  /* check end of string */
+        pi++; continue;
+      }
+      case PI_STR: {
+        size_t n = cast_sizet(pi->n);
+        if (ct_diff2sz(ms->src_end - s) < n || memcmp(s, pi->str, n) != 0)
+          goto fail;
+        s += n; pi++; continue;
+      }
+      case PI_OPENCAP: case PI_POSCAP: {
+        int level = ms->level;
+        if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
+        ms->capture[level].init = s;
+        ms->capture[level].len = (pi->op == PI_POSCAP) ? CAP_POSITION
+                                                       : CAP_UNFINISHED;
+        ms->level = level+1;
+        pushbt(&m, BT_OPENCAP, pi, s, s, 0);
+        pi++; continue;
+      }
+      case PI_CLOSECAP: {
+        int l = capture_to_close(ms);
+        ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
+        pushbt(&m, BT_CLOSECAP, pi, s, s, l);
+        pi++; continue;
+      }
+      case PI_BALANCE: {
+        s = balance(ms, s, pi->c[0], pi->c[1]);
+        if (s == NULL) goto fail;
+        pi++; continue;
+      }
+      case PI_FRONTIER: {
+        char previous = (s == ms->src_init) ? '\0' : *(s - 1);
+        if (inset(pi->set, cast_uchar(previous)) ||
+            !inset(pi->set, cast_uchar(*s)))
+          goto fail;
+        pi++; continue;
+      }
+      case PI_BACKREF: {
+        s = match_capture(ms, s, pi->n);
+        if (s == NULL) goto fail;
+        pi++; continue;
+      }
+      default: {  /* single-char item plus optional suffix */
+        const char *start = s;
+        if (pi->rep != 0 && isfailed(&m, pi, s))
+          goto fail;  /* already known not to match */
+        if (!csinglematch(ms, s, pi)) {
+          if (pi->rep == '*' || pi->rep == '?' || pi->rep == '-') {
+            pi++; continue;  /* accept empty */
+          }
+          goto fail;  /* '+' or no suffix */
+        }
+        switch (pi->rep) {  /* matched once; handle optional suffix */
+          case '?': {
+            pushbt(&m, BT_OPT, pi, start, s, 0);
+            break;
+          }
+          case '+':  /* 1 or more repetitions */
+            s++;  /* 1 match already done */
+            /* FALLTHROUGH */
+          case '*': {  /* 0 or more repetitions */
+            ptrdiff_t i = 0;  /* counts maximum expand for item */
+            if (pi->op == PI_ANY)
+              i = ms->src_end - s;
+            else {
+              while (csinglematch(ms, s + i, pi))
+                i++;
+              addsteps(&m, cast_sizet(i));
+            }
+            pushbt(&m, BT_MAX, pi, start, s, i);
+            break;
+          }
+          case '-': {  /* 0 or more repetitions (minimum) */
+            pushbt(&m, BT_MIN, pi, start, s, 0);
+            break;
+          }
+          default: {  /* no suffix */
+            s++; pi++; continue;
+          }
+        }
+        if (nextalt(&m, &s, &pi))
+          continue;
+        goto fail;
+      }
+    }
+   fail:  /* backtrack to the last choice point with alternatives */
+    for (;;) {
+      BTEntry *e;
+      if (m.n == 0)
+        return endmatcher(&m, NULL);
+      e = &m.stack[m.n - 1];
+      if (e->kind == BT_OPENCAP) {
+        ms->level--;  /* undo capture */
+        m.n--;
+      }
+      else if (e->kind == BT_CLOSECAP) {
+        ms->capture[e->i].len = CAP_UNFINISHED;  /* undo capture */
+        m.n--;
+      }
+      else {
+        setfailed(&m, e->pi + 1, e->last);
+        if (nextalt(&m, &s, &pi))
+          break;
       }
     }
-    return NULL;  /* not found */
   }
 }
 
 
+/*
+** Try to match at 's', with the program 'prog' if there is one or
+** else interpreting pattern 'p'.
+*/
+static const char *domatch (MatchState *ms, const char *s, const char *p,
+                            const PatProg *prog) {
+  return (prog != NULL) ? cmatch(ms, s, prog) : match(ms, s, p);
+}
+
+
+/*
+** Return the first position from 's' where a match can start, given
+** the pattern's first item, or NULL if there is none.
+*/
+static const char *firststart (MatchState *ms, const char *s,
+                               const PatProg *prog) {
+  if (prog == NULL || prog->items[0].op != PI_STR || s > ms->src_end)
+    return s;
+  return lmemfind(s, ct_diff2sz(ms->src_end - s), prog->items[0].str,
+                  cast_sizet(prog->items[0].n));
+}
+
+/* }====================================================== */
+
+
+
+
+
 /*
 ** get information about the i-th capture. If there are no captures
 ** and 'i==0', return information about the whole match, which
@@ -746,6 +1834,16 @@ static int nospecials (const char *p, size_t l) {
 }
 
 
+/*
+** check whether pattern matches only itself. An unmatched ')' is not
+** special for 'find', which always searched for it, but it is an
+** error in other functions.
+*/
+static int isliteral (const char *p, size_t l) {
+  return nospecials(p, l) && memchr(p, ')', l) == NULL;
+}
+
+
 static void prepstate (MatchState *ms, lua_State *L,
                        const char *s, size_t ls, const char *p, size_t lp) {
   ms->L = L;
@@ -753,6 +1851,9 @@ static void prepstate (MatchState *ms, lua_State *L,
   ms->src_init = s;
   ms->src_end = s + ls;
   ms->p_end = p + lp;
+  ms->memoslot = 0;
+  ms->memo = NULL;
+  ms->nbt = 0;
 }
 
 
@@ -772,10 +1873,14 @@ static int str_find_aux (lua_State *L, int find) {
     return 1;
   }
   /* explicit request or no special characters? */
-  if (find && (lua_toboolean(L, 4) || nospecials(p, lp))) {
+  if (find ? (lua_toboolean(L, 4) || nospecials(p, lp)) : isliteral(p, lp)) {
     /* do a plain search */
     const char *s2 = lmemfind(s + init, ls - init, p, lp);
     if (s2) {
+      if (!find) {
+        lua_settop(L, 2);
+        return 1;  /* the match is the pattern itself */
+      }
       lua_pushinteger(L, ct_diff2S(s2 - s) + 1);
       lua_pushinteger(L, cast_st2S(ct_diff2sz(s2 - s) + lp));
       return 2;
@@ -784,15 +1889,22 @@ static int str_find_aux (lua_State *L, int find) {
   else {
     MatchState ms;
     const char *s1 = s + init;
+    const PatProg *prog = getprog(L, p, lp);
     int anchor = (*p == '^');
     if (anchor) {
       p++; lp--;  /* skip anchor character */
     }
     prepstate(&ms, L, s, ls, p, lp);
+    if (prog != NULL) {
+      lua_pushnil(L);  /* slot for bitmap of failed states */
+      ms.memoslot = lua_gettop(L);
+    }
     do {
       const char *res;
+      if (!anchor && (s1 = firststart(&ms, s1, prog)) == NULL)
+        break;  /* no more places where a match can start */
       reprepstate(&ms);
-      if ((res=match(&ms, s1, p)) != NULL) {
+      if ((res=domatch(&ms, s1, p, prog)) != NULL) {
         if (find) {
           lua_pushinteger(L, ct_diff2S(s1 - s) + 1);  /* start */
           lua_pushinteger(L, ct_diff2S(res - s));   /* end */
@@ -823,6 +1935,8 @@ typedef struct GMatchState {
   const char *src;  /* current position */
   const char *p;  /* pattern */
   const char *lastmatch;  /* end of last match */
+  int plain;  /* pattern is a non-empty literal */
+  const PatProg *prog;  /* compiled pattern, or NULL */
   MatchState ms;  /* match state */
 } GMatchState;
 
@@ -831,10 +1945,23 @@ static int gmatch_aux (lua_State *L) {
   GMatchState *gm = (GMatchState *)lua_touserdata(L, lua_upvalueindex(3));
   const char *src;
   gm->ms.L = L;
+  if (gm->plain) {  /* search for the next occurrence of the literal */
+    size_t lp = ct_diff2sz(gm->ms.p_end - gm->p);
+    if (gm->src > gm->ms.src_end ||
+        (src = lmemfind(gm->src, ct_diff2sz(gm->ms.src_end - gm->src),
+                        gm->p, lp)) == NULL)
+      return 0;  /* not found */
+    gm->src = gm->lastmatch = src + lp;
+    lua_pushvalue(L, lua_upvalueindex(2));  /* the match is the pattern */
+    return 1;
+  }
   for (src = gm->src; src <= gm->ms.src_end; src++) {
     const char *e;
+    if ((src = firststart(&gm->ms, src, gm->prog)) == NULL)
+      break;  /* no more places where a match can start */
     reprepstate(&gm->ms);
-    if ((e = match(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
+    if ((e = domatch(&gm->ms, src, gm->p, gm->prog)) != NULL &&
+        e != gm->lastmatch) {
       gm->src = gm->lastmatch = e;
       return push_captures(&gm->ms, src, e);
     }
@@ -855,7 +1982,15 @@ static int gmatch (lua_State *L) {
     init = ls + 1;  /* avoid overflows in 's + init' */
   prepstate(&gm->ms, L, s, ls, p, lp);
   gm->src = s + init; gm->p = p; gm->lastmatch = NULL;
-  lua_pushcclosure(L, gmatch_aux, 3);
+  gm->plain = (lp > 0 && isliteral(p, lp));
+  if (gm->plain || *p == '^')  /* ('^' is not an anchor here) */
+    gm->prog = NULL;
+  else {
+    gm->prog = getprog(L, p, lp);  /* keep program on closure, too */
+    gm->ms.memoslot = lua_upvalueindex(5);
+  }
+  lua_settop(L, 5);  /* 5th upvalue keeps bitmap of failed states */
+  lua_pushcclosure(L, gmatch_aux, 5);
   return 1;
 }
 
@@ -940,6 +2075,9 @@ static int str_gsub (lua_State *L) {
   /* max replacements */
   lua_Integer max_s = luaL_optinteger(L, 4, cast_st2S(srcl) + 1);
   int anchor = (*p == '^');
+  int plain = (!anchor && lp > 0 && isliteral(p, lp));
+  const PatProg *prog = NULL;
+  int memoslot = 0;
   lua_Integer n = 0;  /* replacement count */
   int changed = 0;  /* change flag */
   MatchState ms;
@@ -947,23 +2085,49 @@ static int str_gsub (lua_State *L) {
   luaL_argexpected(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
                       "string/function/table");
+  if (!plain) {  /* (before the buffer uses the stack) */
+    prog = getprog(L, p, lp);
+    lua_pushnil(L);  /* slot for bitmap of failed states */
+    memoslot = lua_gettop(L);
+  }
   luaL_buffinit(L, &b);
   if (anchor) {
     p++; lp--;  /* skip anchor character */
   }
   prepstate(&ms, L, src, srcl, p, lp);
-  while (n < max_s) {
-    const char *e;
-    reprepstate(&ms);  /* (re)prepare state for new match */
-    if ((e = match(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
+  ms.memoslot = memoslot;
+  if (plain) {  /* literal pattern? */
+    reprepstate(&ms);  /* no captures */
+    while (n < max_s) {
+      const char *e = lmemfind(src, ct_diff2sz(ms.src_end - src), p, lp);
+      if (e == NULL) break;
+      luaL_addlstring(&b, src, ct_diff2sz(e - src));
       n++;
-      changed = add_value(&ms, &b, src, e, tr) | changed;
-      src = lastmatch = e;
+      changed = add_value(&ms, &b, e, e + lp, tr) | changed;
+      src = e + lp;
+    }
+  }
+  else {
+    while (n < max_s) {
+      const char *e;
+      if (!anchor) {  /* skip places where a match cannot start */
+        const char *s1 = firststart(&ms, src, prog);
+        if (s1 == NULL) break;
+        luaL_addlstring(&b, src, ct_diff2sz(s1 - src));
+        src = s1;
+      }
+      reprepstate(&ms);  /* (re)prepare state for new match */
+      if ((e = domatch(&ms, src, p, prog)) != NULL &&
+          e != lastmatch) {  /* match? */
+        n++;
+        changed = add_value(&ms, &b, src, e, tr) | changed;
+        src = lastmatch = e;
+      }
+      else if (src < ms.src_end)  /* otherwise, skip one character */
+        luaL_addchar(&b, *src++);
+      else break;  /* end of subject */
+      if (anchor) break;
     }
-    else if (src < ms.src_end)  /* otherwise, skip one character */
-      luaL_addchar(&b, *src++);
-    else break;  /* end of subject */
-    if (anchor) break;
   }
   if (!changed)  /* no changes? */
     lua_pushvalue(L, 1);  /* return original string */
@@ -975,6 +2139,135 @@ static int str_gsub (lua_State *L) {
   return 2;
 }
 
+
+/* state for 'split' and 'iterlines' */
+typedef struct SplitState {
+  const char *src;  /* start of next field (NULL after the last one) */
+  const char *p;  /* separator */
+  size_t lp;  /* separator length */
+  int plain;  /* separator is a literal */
+  const PatProg *prog;  /* compiled separator, or NULL */
+  MatchState ms;  /* match state */
+} SplitState;
+
+
+/*
+** Prepare 'ss' to split 's' by separator 'p'. Pushes the compiled
+** separator (or nil), which the caller must keep.
+*/
+static void prepsplit (lua_State *L, SplitState *ss, const char *s,
+                       size_t ls, const char *p, size_t lp, int plain) {
+  luaL_argcheck(L, lp > 0, 2, "empty separator");
+  prepstate(&ss->ms, L, s, ls, p, lp);
+  ss->src = s; ss->p = p; ss->lp = lp;
+  ss->plain = plain || isliteral(p, lp);
+  if (ss->plain || *p == '^') {  /* ('^' is not an anchor here) */
+    ss->prog = NULL;
+    lua_pushnil(L);
+  }
+  else
+    ss->prog = getprog(L, p, lp);
+}
+
+
+/*
+** Find the next separator after 'ss->src'. Return its start and put
+** its end in '*e', or return NULL if there are no more separators.
+** (Empty matches are not separators.)
+*/
+static const char *nextsep (SplitState *ss, const char **e) {
+  const char *s = ss->src;
+  if (ss->plain) {
+    s = lmemfind(s, ct_diff2sz(ss->ms.src_end - s), ss->p, ss->lp);
+    if (s != NULL)
+      *e = s + ss->lp;
+    return s;
+  }
+  for (; s < ss->ms.src_end; s++) {
+    if ((s = firststart(&ss->ms, s, ss->prog)) == NULL)
+      break;  /* no more places where a match can start */
+    reprepstate(&ss->ms);
+    if ((*e = domatch(&ss->ms, s, ss->p, ss->prog)) != NULL && *e != s)
+      return s;
+  }
+  return NULL;
+}
+
+
+static int str_split (lua_State *L) {
+  size_t ls, lp;
+  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *p = luaL_checklstring(L, 2, &lp);
+  int plain = lua_toboolean(L, 3);
+  lua_Integer max = luaL_optinteger(L, 4, LUA_MAXINTEGER);  /* max fields */
+  lua_Integer n = 0;  /* number of fields */
+  const char *sep, *e;
+  SplitState ss;
+  luaL_argcheck(L, max > 0, 4, "out of range");
+  lua_settop(L, 4);
+  prepsplit(L, &ss, s, ls, p, lp, plain);
+  lua_pushnil(L);  /* slot for bitmap of failed states */
+  ss.ms.memoslot = lua_gettop(L);
+  if (ss.plain) {  /* count fields to preallocate the result */
+    const char *s1 = s;
+    while (n < max - 1 && n < INT_MAX - 1 &&
+           (s1 = lmemfind(s1, ct_diff2sz(ss.ms.src_end - s1), p, lp))
+              != NULL) {
+      n++;
+      s1 += lp;
+    }
+    lua_createtable(L, cast_uint(n + 1), 0);
+    n = 0;
+  }
+  else
+    lua_newtable(L);
+  while (n < max - 1 && (sep = nextsep(&ss, &e)) != NULL) {
+    lua_pushlstring(L, ss.src, ct_diff2sz(sep - ss.src));
+    lua_rawseti(L, -2, ++n);
+    ss.src = e;
+  }
+  lua_pushlstring(L, ss.src, ct_diff2sz(ss.ms.src_end - ss.src));
+  lua_rawseti(L, -2, ++n);  /* last field */
+  return 1;
+}
+
+
+static int iterlines_aux (lua_State *L) {
+  SplitState *ss = (SplitState *)lua_touserdata(L, lua_upvalueindex(3));
+  const char *start = ss->src;
+  const char *sep, *e;
+  if (start == NULL)
+    return 0;  /* no more fields */
+  ss->ms.L = L;
+  if ((sep = nextsep(ss, &e)) != NULL)
+    ss->src = e;
+  else {  /* last field */
+    sep = ss->ms.src_end;
+    ss->src = NULL;
+    if (sep == start)
+      return 0;  /* do not produce an empty last field */
+  }
+  lua_pushinteger(L, ct_diff2S(start - ss->ms.src_init) + 1);
+  lua_pushinteger(L, ct_diff2S(sep - ss->ms.src_init));
+  return 2;
+}
+
+
+static int iterlines (lua_State *L) {
+  size_t ls, lp;
+  const char *s = luaL_checklstring(L, 1, &ls);
+  const char *p = luaL_optlstring(L, 2, "\n", &lp);
+  int plain = lua_toboolean(L, 3);
+  SplitState *ss;
+  lua_settop(L, 2);  /* keep strings on closure to avoid being collected */
+  ss = (SplitState *)lua_newuserdatauv(L, sizeof(SplitState), 0);
+  prepsplit(L, ss, s, ls, p, lp, plain);  /* program is 4th upvalue */
+  ss->ms.memoslot = lua_upvalueindex(5);
+  lua_pushnil(L);  /* 5th upvalue keeps bitmap of failed states */
+  lua_pushcclosure(L, iterlines_aux, 5);
+  return 1;
+}
+
 /* }====================================================== */
 
 
@@ -1842,11 +3135,13 @@ static const luaL_Reg strlib[] = {
   {"format", str_format},
   {"gmatch", gmatch},
   {"gsub", str_gsub},
+  {"iterlines", iterlines},
   {"len", str_len},
   {"lower", str_lower},
   {"match", str_match},
   {"rep", str_rep},
   {"reverse", str_reverse},
+  {"split", str_split},
   {"sub", str_sub},
   {"upper", str_upper},
   {"pack", str_pack},
@@ -1874,7 +3169,13 @@ static void createmetatable (lua_State *L) {
 ** Open string library
 */
 LUAMOD_API int luaopen_string (lua_State *L) {
-  luaL_newlib(L, strlib);
+  luaL_newlibtable(L, strlib);
+  lua_newtable(L);  /* cache of compiled patterns */
+  lua_createtable(L, 0, 1);  /* its metatable */
+  lua_pushliteral(L, "v");
+  lua_setfield(L, -2, "__mode");  /* metatable.__mode = "v" */
+  lua_setmetatable(L, -2);
+  luaL_setfuncs(L, strlib, 1);  /* cache is an upvalue of all functions */
   createmetatable(L);
   return 1;
 }
@@ -21,12 +21,22 @@
 ** in its main position (i.e. the 'original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** Alternatively (LUA_USE_SWISSHASH), the hash part can use open
+** addressing guided by an array of control bytes (see below).
 */
 
 #include <math.h>
 #include <limits.h>
 #include <string.h>
 
+#if defined(LUA_USE_SWISSHASH)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#endif
+
 #include "lua.h"
 
 #include "ldebug.h"
@@ -49,13 +59,15 @@
 #define LIMFORLAST    2  /* log2 of real limit */
 
 /*
-** The union 'Limbox' stores 'lastfree' and ensures that what follows it
-** is properly aligned to store a Node.
+** The union 'Limbox' stores 'lastfree' (or, with control bytes, the
+** number of free slots left) and ensures that what follows it is
+** properly aligned to store a Node.
 */
 typedef struct { Node *dummy; Node follows_pNode; } Limbox_aux;
 
 typedef union {
   Node *lastfree;
+  unsigned growth;
   char padding[offsetof(Limbox_aux, follows_pNode)];
 } Limbox;
 
@@ -99,6 +111,8 @@ typedef union {
 #define MAXHSIZE	luaM_limitN(1u << MAXHBITS, Node)
 
 
+#if !defined(LUA_USE_SWISSHASH)
+
 /*
 ** When the original hash value is good, hashing by a power of 2
 ** avoids the cost of '%'.
@@ -126,10 +140,13 @@ static const Node dummynode_ = {
    LUA_VNIL, 0, {NULL}}  /* key type, next, and key value */
 };
 
+#endif
+
 
 static const TValue absentkey = {ABSTKEYCONSTANT};
 
 
+#if !defined(LUA_USE_SWISSHASH)
 /*
 ** Hash for integers. To allow a good hash, use the remainder operator
 ** ('%'). If integer fits as a non-negative int, compute an int
@@ -143,6 +160,7 @@ static Node *hashint (const Table *t, lua_Integer i) {
   else
     return hashmod(t, ui);
 }
+#endif
 
 
 /*
@@ -175,6 +193,8 @@ static unsigned l_hashfloat (lua_Number n) {
 #endif
 
 
+#if !defined(LUA_USE_SWISSHASH)
+
 /*
 ** returns the 'main' position of an element in a table (that is,
 ** the index of its hash value).
@@ -223,6 +243,230 @@ l_sinline Node *mainpositionfromnode (const Table *t, Node *nd) {
   return mainpositionTV(t, &key);
 }
 
+#else
+
+/*
+** {=============================================================
+** Hash part with control bytes
+** ==============================================================
+*/
+
+/*
+** With LUA_USE_SWISSHASH, the hash part uses open addressing. Besides
+** the nodes, it has an array of control bytes, one per node: a free
+** node has CTRLEMPTY; a used node (even if its value was removed) has
+** the lower 7 bits of its key's hash. Nodes are probed in groups of
+** SWGROUP, and all control bytes of a group are compared with the
+** hash of the searched key in one step, so that most nodes with other
+** keys are never touched. A search stops at the first group with a
+** free node. Groups are visited in a triangular sequence, which covers
+** all of them, as their number is a power of 2. Tables smaller than a
+** group pad their control bytes with CTRLPAD, which matches nothing.
+** Nodes are never freed until a rehash (as with the chained layout),
+** so there are no tombstones. To keep searches short, large tables
+** are never filled above 7/8 of their size; the header of the node
+** block ('Limbox') counts how many nodes can still be used.
+** The 'next' field of nodes is not used.
+*/
+
+#define SWLGGROUP	4
+#define SWGROUP		(1u << SWLGGROUP)
+
+#define CTRLEMPTY	0x80
+#define CTRLPAD		0xFE
+
+/* control bytes of table 't' (just after its nodes) */
+#define getctrl(t)	cast(lu_byte *, gnode(t, sizenode(t)))
+
+/* number of control bytes for a hash part of size 'size' */
+#define ctrlsize(size)	((size) < SWGROUP ? SWGROUP : (size))
+
+/* number of groups in table 't' */
+#define swngroups(t)  \
+	((t)->lsizenode <= SWLGGROUP ? 1u : sizenode(t) >> SWLGGROUP)
+
+/* maximum number of used nodes for a hash part of size 'size' */
+#define swmaxuse(size)	((size) <= SWGROUP ? (size) : (size) - (size) / 8)
+
+#define getgrowth(t)	((cast(Limbox *, (t)->node) - 1)->growth)
+
+
+/*
+** The dummy node needs a group of (empty) control bytes after it.
+*/
+static const struct {
+  Node n;
+  lu_byte ctrl[SWGROUP];
+} dummynode_ = {
+  {{{NULL}, LUA_VEMPTY,  /* value's value and type */
+    LUA_VNIL, 0, {NULL}}},  /* key type, next, and key value */
+  {CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY,
+   CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY,
+   CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY,
+   CTRLEMPTY, CTRLEMPTY, CTRLEMPTY, CTRLEMPTY}
+};
+
+#define dummynode	(&dummynode_.n)
+
+
+/*
+** Returns a bit mask with the positions in the group starting at 'c'
+** whose control bytes are equal to 'b'.
+*/
+#if defined(__SSE2__)
+
+l_sinline unsigned swmatch (const lu_byte *c, lu_byte b) {
+  __m128i g = _mm_loadu_si128(cast(const __m128i *, c));
+  __m128i eq = _mm_cmpeq_epi8(g, _mm_set1_epi8(cast_char(b)));
+  return cast_uint(_mm_movemask_epi8(eq));
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+l_sinline unsigned swmatch (const lu_byte *c, lu_byte b) {
+  static const uint8_t bits[16] =
+    {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  uint8x16_t eq = vceqq_u8(vld1q_u8(c), vdupq_n_u8(b));
+  uint8x16_t m = vandq_u8(eq, vld1q_u8(bits));
+  return cast_uint(vaddv_u8(vget_low_u8(m))) |
+         (cast_uint(vaddv_u8(vget_high_u8(m))) << 8);
+}
+
+#else
+
+l_sinline unsigned swmatch (const lu_byte *c, lu_byte b) {
+  unsigned m = 0;
+  unsigned i;
+  for (i = 0; i < SWGROUP; i++) {
+    if (c[i] == b)
+      m |= 1u << i;
+  }
+  return m;
+}
+
+#endif
+
+
+/* index of the lowest 1 bit in a non-zero mask */
+#if defined(__GNUC__)
+#define lowbit(m)	cast_uint(__builtin_ctz(m))
+#else
+static unsigned lowbit (unsigned m) {
+  unsigned i = 0;
+  while (!(m & 1u)) { m >>= 1; i++; }
+  return i;
+}
+#endif
+
+
+/*
+** Mix the bits of a hash, as the raw hashes of integers and pointers
+** are not random at all in their lower bits.
+*/
+l_sinline unsigned swmix (unsigned h) {
+  h ^= h >> 16;
+  h *= 0x45d9f3bu;
+  h ^= h >> 16;
+  return h;
+}
+
+
+#define hashbyte(h)	cast_byte((h) & 0x7fu)
+#define firstgroup(t,h)	(((h) >> 7) & (swngroups(t) - 1u))
+
+
+static unsigned hashint (lua_Integer i) {
+  lua_Unsigned ui = l_castS2U(i);
+  return swmix(cast_uint(ui ^ (ui >> 31 >> 1)));
+}
+
+
+#define hashstr(str)	swmix((str)->hash)
+
+
+static unsigned hashTV (const TValue *key) {
+  unsigned h;
+  switch (ttypetag(key)) {
+    case LUA_VNUMINT: return hashint(ivalue(key));
+    case LUA_VNUMFLT: h = l_hashfloat(fltvalue(key)); break;
+    case LUA_VSHRSTR: return hashstr(tsvalue(key));
+    case LUA_VLNGSTR: h = luaS_hashlongstr(tsvalue(key)); break;
+    case LUA_VFALSE: h = 0; break;
+    case LUA_VTRUE: h = 1; break;
+    case LUA_VLIGHTUSERDATA: h = point2uint(pvalue(key)); break;
+    case LUA_VLCF: h = point2uint(fvalue(key)); break;
+    default: h = point2uint(gcvalue(key)); break;
+  }
+  return swmix(h);
+}
+
+
+/*
+** Search for a node in table 't' with hash 'h' satisfying condition
+** 'eq' (which refers to the candidate node as 'n'). Leaves the node
+** found in 'res', or NULL if there is none.
+*/
+#define swsearch(t,h,res,eq)  { \
+  unsigned gmask_ = swngroups(t) - 1u; \
+  unsigned g_ = firstgroup(t, h); \
+  unsigned step_ = 0; \
+  lu_byte hb_ = hashbyte(h); \
+  res = NULL; \
+  for (;;) { \
+    const lu_byte *c_ = getctrl(t) + g_ * SWGROUP; \
+    unsigned m_ = swmatch(c_, hb_); \
+    while (m_ != 0) { \
+      Node *n = gnode(t, g_ * SWGROUP + lowbit(m_)); \
+      if (eq) { res = n; break; } \
+      m_ &= m_ - 1u; \
+    } \
+    if (res != NULL || swmatch(c_, CTRLEMPTY) != 0 || step_++ == gmask_) \
+      break; \
+    g_ = (g_ + step_) & gmask_; \
+  } }
+
+
+/*
+** Find a free node for a new key with hash 'h', marking it as used.
+** Returns NULL if the table cannot grow without a rehash.
+*/
+static Node *swnewpos (Table *t, unsigned h) {
+  unsigned gmask = swngroups(t) - 1u;
+  unsigned g = firstgroup(t, h);
+  unsigned step = 0;
+  if (isdummy(t) || getgrowth(t) == 0)
+    return NULL;
+  for (;;) {  /* there must be a free node, as 'growth' > 0 */
+    lu_byte *c = getctrl(t) + g * SWGROUP;
+    unsigned m = swmatch(c, CTRLEMPTY);
+    if (m != 0) {
+      unsigned i = lowbit(m);
+      c[i] = hashbyte(h);
+      getgrowth(t)--;
+      return gnode(t, g * SWGROUP + i);
+    }
+    lua_assert(step < gmask);
+    step++;
+    g = (g + step) & gmask;
+  }
+}
+
+
+#if defined(LUA_DEBUG)
+/*
+** For debugging purposes: the first node of the first group probed
+** for a key.
+*/
+static Node *mainpositionTV (const Table *t, const TValue *key) {
+  unsigned h = hashTV(key);
+  return gnode(t, firstgroup(t, h) * SWGROUP);
+}
+#endif
+
+/* }============================================================= */
+
+#endif
+
 
 /*
 ** Check whether key 'k1' is equal to the key in node 'n2'. This
@@ -328,6 +572,7 @@ static unsigned int setlimittosize (Table *t) {
 ** See explanation about 'deadok' in function 'equalkey'.
 */
 static const TValue *getgeneric (Table *t, const TValue *key, int deadok) {
+#if !defined(LUA_USE_SWISSHASH)
   Node *n = mainpositionTV(t, key);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     if (equalkey(key, n, deadok))
@@ -339,6 +584,17 @@ static const TValue *getgeneric (Table *t, const TValue *key, int deadok) {
       n += nx;
     }
   }
+#else
+  /* A table may have a dead key and a live copy of that same key,
+     inserted after it died; the live one must be preferred. (With
+     chains, the live key always comes first.) */
+  unsigned h = hashTV(key);
+  Node *res;
+  swsearch(t, h, res, equalkey(key, n, 0));
+  if (res == NULL && deadok)
+    swsearch(t, h, res, equalkey(key, n, 1));
+  return (res != NULL) ? gval(res) : &absentkey;
+#endif
 }
 
 
@@ -379,7 +635,17 @@ static unsigned findindex (lua_State *L, Table *t, TValue *key,
 
 int luaH_next (lua_State *L, Table *t, StkId key) {
   unsigned int asize = luaH_realasize(t);
-  unsigned int i = findindex(L, t, s2v(key), asize);  /* find original key */
+  unsigned int i;
+  if (isvector(t)) {  /* vector has only t[1 .. len] */
+    VecInfo *vi = getvecinfo(t);
+    i = findindex(L, t, s2v(key), vi->len);
+    if (i >= vi->len)
+      return 0;  /* no more elements */
+    setivalue(s2v(key), cast_int(i) + 1);
+    farr2val(t, i, vi->tag, s2v(key + 1));
+    return 1;
+  }
+  i = findindex(L, t, s2v(key), asize);  /* find original key */
   for (; i < asize; i++) {  /* try first array part */
     lu_byte tag = *getArrTag(t, i);
     if (!tagisempty(tag)) {  /* a non-empty entry? */
@@ -404,10 +670,15 @@ static void freehash (lua_State *L, Table *t) {
   if (!isdummy(t)) {
     size_t bsize = sizenode(t) * sizeof(Node);  /* 'node' size in bytes */
     char *arr = cast_charp(t->node);
+#if !defined(LUA_USE_SWISSHASH)
     if (haslastfree(t)) {
       bsize += sizeof(Limbox);
       arr -= sizeof(Limbox);
     }
+#else
+    bsize += sizeof(Limbox) + ctrlsize(sizenode(t));
+    arr -= sizeof(Limbox);
+#endif
     luaM_freearray(L, arr, bsize);
   }
 }
@@ -619,9 +890,14 @@ static void setnodevector (lua_State *L, Table *t, unsigned size) {
   else {
     int i;
     int lsize = luaO_ceillog2(size);
+#if defined(LUA_USE_SWISSHASH)
+    if (twoto(lsize) > SWGROUP && size > swmaxuse(twoto(lsize)))
+      lsize++;  /* keep load factor below its maximum */
+#endif
     if (lsize > MAXHBITS || (1u << lsize) > MAXHSIZE)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
+#if !defined(LUA_USE_SWISSHASH)
     if (lsize <= LIMFORLAST)  /* no 'lastfree' field? */
       t->node = luaM_newvector(L, size, Node);
     else {
@@ -630,6 +906,18 @@ static void setnodevector (lua_State *L, Table *t, unsigned size) {
       t->node = cast(Node *, node + sizeof(Limbox));
       getlastfree(t) = gnode(t, size);  /* all positions are free */
     }
+#else
+    {  /* header + nodes + control bytes */
+      size_t bsize = sizeof(Limbox) + size * sizeof(Node) + ctrlsize(size);
+      char *node = luaM_newblock(L, bsize);
+      lu_byte *ctrl;
+      t->node = cast(Node *, node + sizeof(Limbox));
+      getgrowth(t) = swmaxuse(size);
+      ctrl = cast(lu_byte *, gnode(t, size));
+      memset(ctrl, CTRLEMPTY, size);
+      memset(ctrl + size, CTRLPAD, ctrlsize(size) - size);
+    }
+#endif
     t->lsizenode = cast_byte(lsize);
     setnodummy(t);
     for (i = 0; i < cast_int(size); i++) {
@@ -687,16 +975,21 @@ static void exchangehashpart (Table *t1, Table *t2) {
 static void reinsertOldSlice (lua_State *L, Table *t, unsigned oldasize,
                                             unsigned newasize) {
   unsigned i;
+  Table ot;  /* to keep the old array */
+  ot.array = t->array;
   t->alimit = newasize;  /* pretend array has new size... */
+  if (newasize == 0)
+    t->array = NULL;  /* ...(and do not look like a vector) */
   for (i = newasize; i < oldasize; i++) {  /* traverse vanishing slice */
-    lu_byte tag = *getArrTag(t, i);
+    lu_byte tag = *getArrTag(&ot, i);
     if (!tagisempty(tag)) {  /* a non-empty entry? */
       TValue aux;
-      farr2val(t, i, tag, &aux);  /* copy entry into 'aux' */
+      farr2val(&ot, i, tag, &aux);  /* copy entry into 'aux' */
       /* re-insert it into the table */
       luaH_setint(L, t, cast_int(i) + 1, &aux);
     }
   }
+  t->array = ot.array;
   t->alimit = oldasize;  /* restore current size... */
 }
 
@@ -710,6 +1003,173 @@ static void clearNewSlice (Table *t, unsigned oldasize, unsigned newasize) {
 }
 
 
+/*
+** {=============================================================
+** Vectors
+** ==============================================================
+*/
+
+/*
+** A vector keeps its values in 1..len, all with the same tag. Setting
+** a value of that tag at 'len + 1' appends it, doubling the block when
+** full; removing the last value (setting it to nil) shrinks 'len'. Any
+** other change that would break these invariants (a value with another
+** tag, a hole, a key outside 1..len+1) first turns the vector into a
+** regular table, with an array part of the same size.
+*/
+
+
+/* size of the block of a vector with 'size' slots */
+static size_t vecblocksize (unsigned size) {
+  return size * sizeof(Value) + sizeof(VecInfo);
+}
+
+
+/*
+** Allocate a block with 'size' slots for vector 't', moving into it
+** the values from the old block (if any), which is freed.
+*/
+static void setvecblock (lua_State *L, Table *t, lu_byte tag,
+                                       unsigned size) {
+  Value *np = cast(Value *, luaM_newblock(L, vecblocksize(size))) + size;
+  VecInfo *vi = cast(VecInfo *, np);
+  if (t->array == NULL) {  /* new vector? */
+    vi->len = 0;
+    vi->tag = tag;
+  }
+  else {
+    VecInfo *ovi = getvecinfo(t);
+    *vi = *ovi;
+    memcpy(np - vi->len, t->array - vi->len, vi->len * sizeof(Value));
+    luaM_freemem(L, t->array - ovi->size, vecblocksize(ovi->size));
+  }
+  vi->size = size;
+  t->array = np;
+}
+
+
+/*
+** Turn the empty table 't' into a vector for values with tag 'tag',
+** with room for 'size' values.
+*/
+void luaH_setvector (lua_State *L, Table *t, lu_byte tag, unsigned size) {
+  lua_assert(t->array == NULL && isdummy(t));
+  lua_assert(tag == LUA_VNUMINT || tag == LUA_VNUMFLT);
+  if (size > MAXASIZE)
+    luaG_runerror(L, "table overflow");
+  t->alimit = 0;
+  setrealasize(t);
+  setvecblock(L, t, tag, size);
+}
+
+
+/* grow the block of vector 't', doubling it, to at least 'need' slots */
+static void growvec (lua_State *L, Table *t, lua_Unsigned need) {
+  unsigned size = getvecinfo(t)->size;
+  if (need > MAXASIZE)
+    luaG_runerror(L, "table overflow");
+  if (size < 4)
+    size = 4;
+  while (size < need)
+    size = (size <= MAXASIZE / 2) ? size * 2 : MAXASIZE;
+  setvecblock(L, t, getvecinfo(t)->tag, size);
+}
+
+
+/* append 'val' (with the right tag) to vector 't' */
+static void vecappend (lua_State *L, Table *t, const TValue *val) {
+  VecInfo *vi = getvecinfo(t);
+  if (vi->len == vi->size) {  /* block is full? */
+    growvec(L, t, cast(lua_Unsigned, vi->len) + 1u);
+    vi = getvecinfo(t);
+  }
+  *getArrVal(t, vi->len) = val->value_;
+  vi->len++;
+}
+
+
+/*
+** Move the 'n' values from vector 'src', starting at C index 'f', to
+** vector 'dst', starting at C index 't', if both vectors have the same
+** tag, the source range is inside 'src', and the destination range
+** starts inside 'dst' or right after it (so that 'dst' is still a
+** vector). Otherwise, return false.
+*/
+static int vecmove (lua_State *L, Table *src, lua_Unsigned f,
+                    lua_Unsigned n, Table *dst, lua_Unsigned t) {
+  VecInfo *svi = getvecinfo(src);
+  VecInfo *dvi = getvecinfo(dst);
+  if (svi->tag != dvi->tag || f >= svi->len || n > svi->len - f ||
+      t > dvi->len || n > MAXASIZE - t)
+    return 0;
+  if (t + n > dvi->size) {
+    growvec(L, dst, t + n);
+    dvi = getvecinfo(dst);
+  }
+  memmove(getArrVal(dst, t + n - 1), getArrVal(src, f + n - 1),
+          cast_sizet(n) * sizeof(Value));
+  if (t + n > dvi->len)
+    dvi->len = cast_uint(t + n);
+  return 1;
+}
+
+
+/*
+** Turn vector 't' into a regular table, with an array part with the
+** size of the vector's block.
+*/
+static void vectotable (lua_State *L, Table *t) {
+  VecInfo vi = *getvecinfo(t);
+  Value *op = t->array;
+  unsigned i;
+  if (vi.size == 0)
+    t->array = NULL;
+  else {
+    Value *np = cast(Value *, luaM_newblock(L, concretesize(vi.size)));
+    t->array = np + vi.size;
+    memcpy(t->array - vi.len, op - vi.len, vi.len * sizeof(Value));
+    for (i = 0; i < vi.len; i++)
+      *getArrTag(t, i) = vi.tag;
+    for (; i < vi.size; i++)
+      *getArrTag(t, i) = LUA_VEMPTY;
+  }
+  t->alimit = vi.size;  /* (and it is the real size) */
+  luaM_freemem(L, op - vi.size, vecblocksize(vi.size));
+}
+
+
+/*
+** Try to set 't[key] = val' in vector 't', where 'key' is present
+** (that is, in 1..len). A vector without a metatable (and so without
+** '__newindex') can also append to its block, when it has room.
+*/
+static int vecpsetint (Table *t, lua_Integer key, TValue *val) {
+  VecInfo *vi = getvecinfo(t);
+  lua_Unsigned u = l_castS2U(key) - 1u;
+  if (u >= vi->len) {
+    if (u == vi->len && vi->len < vi->size && t->metatable == NULL &&
+        ttypetag(val) == vi->tag) {
+      *getArrVal(t, u) = val->value_;
+      vi->len++;
+      return HOK;
+    }
+    return HNOTFOUND;
+  }
+  else if (ttypetag(val) == vi->tag) {
+    *getArrVal(t, u) = val->value_;
+    return HOK;
+  }
+  else if (ttisnil(val) && u == vi->len - 1) {  /* removing last value? */
+    vi->len--;
+    return HOK;
+  }
+  else
+    return HVECTOR;  /* vector cannot keep new value */
+}
+
+/* }============================================================= */
+
+
 /*
 ** Resize table 't' for the new given sizes. Both allocations (for
 ** the hash part and for the array part) can fail, which creates some
@@ -726,8 +1186,11 @@ static void clearNewSlice (Table *t, unsigned oldasize, unsigned newasize) {
 void luaH_resize (lua_State *L, Table *t, unsigned newasize,
                                           unsigned nhsize) {
   Table newt;  /* to keep the new hash part */
-  unsigned int oldasize = setlimittosize(t);
+  unsigned int oldasize;
   Value *newarray;
+  if (isvector(t))
+    vectotable(L, t);
+  oldasize = setlimittosize(t);
   if (newasize > MAXASIZE)
     luaG_runerror(L, "table overflow");
   /* create new hash part with appropriate size into 'newt' */
@@ -786,6 +1249,55 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
 }
 
 
+/*
+** Check whether all 'asize' slots in the array part of 't' are
+** non-empty. The test on the last slot rejects most sparse arrays
+** at once; the blocks keep the inner loop free of branches.
+*/
+static int arrayisfull (const Table *t, unsigned asize) {
+  const lu_byte *tag = getArrTag(t, 0);
+  unsigned i = 0;
+  if (asize > 0 && tagisempty(tag[asize - 1]))
+    return 0;
+  while (i < asize) {
+    unsigned lim = (asize - i > 256) ? i + 256 : asize;
+    int full = 1;
+    for (; i < lim; i++)
+      full &= !tagisempty(tag[i]);
+    if (!full)
+      return 0;
+  }
+  return 1;
+}
+
+
+/*
+** When integer 'key' comes right after a full array part (as in
+** 't[#t + 1] = v'), grow that part to the smallest power of 2 that
+** holds the new key. If the hash part has no integer keys, those are
+** the sizes 'rehash' would compute, without counting the keys in the
+** array part. Return true if the table grew.
+*/
+static int growarray (lua_State *L, Table *t, lua_Integer key) {
+  unsigned asize = luaH_realasize(t);
+  unsigned nums[MAXABITS + 1];
+  unsigned na = 0;  /* number of integer keys in the hash part */
+  unsigned nh, nsize;
+  int i;
+  if (l_castS2U(key) - 1u != asize || asize == 0 || asize >= MAXASIZE)
+    return 0;
+  nsize = 1u << luaO_ceillog2(asize + 1);
+  if (nsize > MAXASIZE || !arrayisfull(t, asize))
+    return 0;
+  for (i = 0; i <= MAXABITS; i++) nums[i] = 0;
+  nh = numusehash(t, nums, &na);
+  if (na > 0)  /* integer keys in the hash part? */
+    return 0;  /* let 'rehash' count them */
+  luaH_resize(L, t, nsize, nh);
+  return 1;
+}
+
+
 
 /*
 ** }=============================================================
@@ -810,11 +1322,18 @@ Table *luaH_new (lua_State *L) {
 void luaH_free (lua_State *L, Table *t) {
   unsigned int realsize = luaH_realasize(t);
   freehash(L, t);
-  resizearray(L, t, realsize, 0);
+  if (isvector(t)) {
+    unsigned size = getvecinfo(t)->size;
+    luaM_freemem(L, t->array - size, vecblocksize(size));
+  }
+  else
+    resizearray(L, t, realsize, 0);
   luaM_free(L, t);
 }
 
 
+#if !defined(LUA_USE_SWISSHASH)
+
 static Node *getfreepos (Table *t) {
   if (haslastfree(t)) {  /* does it have 'lastfree' information? */
     /* look for a spot before 'lastfree', updating 'lastfree' */
@@ -837,6 +1356,8 @@ static Node *getfreepos (Table *t) {
   return NULL;  /* could not find a free place */
 }
 
+#endif
+
 
 
 /*
@@ -864,6 +1385,30 @@ static void luaH_newkey (lua_State *L, Table *t, const TValue *key,
   }
   if (ttisnil(value))
     return;  /* do not insert nil values */
+  if (isvector(t)) {
+    VecInfo *vi = getvecinfo(t);
+    if (ttisinteger(key) && l_castS2U(ivalue(key)) - 1u == vi->len &&
+        ttypetag(value) == vi->tag) {
+      vecappend(L, t, value);
+      return;
+    }
+    vectotable(L, t);
+    luaH_set(L, t, key, value);  /* key may be in the new array part */
+    return;
+  }
+  if (ttisinteger(key) && growarray(L, t, ivalue(key))) {
+    luaH_set(L, t, key, value);  /* key is in the new array part */
+    return;
+  }
+#if defined(LUA_USE_SWISSHASH)
+  mp = swnewpos(t, hashTV(key));
+  if (mp == NULL) {  /* no free place? */
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' takes care of TM cache */
+    luaH_set(L, t, key, value);  /* insert key into grown table */
+    return;
+  }
+#else
   mp = mainpositionTV(t, key);
   if (!isempty(gval(mp)) || isdummy(t)) {  /* main position is taken? */
     Node *othern;
@@ -897,6 +1442,7 @@ static void luaH_newkey (lua_State *L, Table *t, const TValue *key,
       mp = f;
     }
   }
+#endif
   setnodekey(L, mp, key);
   luaC_barrierback(L, obj2gco(t), key);
   lua_assert(isempty(gval(mp)));
@@ -905,6 +1451,7 @@ static void luaH_newkey (lua_State *L, Table *t, const TValue *key,
 
 
 static const TValue *getintfromhash (Table *t, lua_Integer key) {
+#if !defined(LUA_USE_SWISSHASH)
   Node *n = hashint(t, key);
   lua_assert(l_castS2U(key) - 1u >= luaH_realasize(t));
   for (;;) {  /* check whether 'key' is somewhere in the chain */
@@ -917,6 +1464,12 @@ static const TValue *getintfromhash (Table *t, lua_Integer key) {
     }
   }
   return &absentkey;
+#else
+  Node *res;
+  lua_assert(l_castS2U(key) - 1u >= luaH_realasize(t));
+  swsearch(t, hashint(key), res, keyisinteger(n) && keyival(n) == key);
+  return (res != NULL) ? gval(res) : &absentkey;
+#endif
 }
 
 
@@ -941,6 +1494,14 @@ lu_byte luaH_getint (Table *t, lua_Integer key, TValue *res) {
       farr2val(t, key - 1, tag, res);
     return tag;
   }
+  else if (isvector(t)) {
+    VecInfo *vi = getvecinfo(t);
+    if (l_castS2U(key) - 1u < vi->len) {
+      farr2val(t, key - 1, vi->tag, res);
+      return vi->tag;
+    }
+    return LUA_VABSTKEY;
+  }
   else
     return finishnodeget(getintfromhash(t, key), res);
 }
@@ -950,6 +1511,7 @@ lu_byte luaH_getint (Table *t, lua_Integer key, TValue *res) {
 ** search function for short strings
 */
 const TValue *luaH_Hgetshortstr (Table *t, TString *key) {
+#if !defined(LUA_USE_SWISSHASH)
   Node *n = hashstr(t, key);
   lua_assert(key->tt == LUA_VSHRSTR);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
@@ -962,6 +1524,13 @@ const TValue *luaH_Hgetshortstr (Table *t, TString *key) {
       n += nx;
     }
   }
+#else
+  Node *res;
+  lua_assert(key->tt == LUA_VSHRSTR);
+  swsearch(t, hashstr(key), res,
+           keyisshrstr(n) && eqshrstr(keystrval(n), key));
+  return (res != NULL) ? gval(res) : &absentkey;
+#endif
 }
 
 
@@ -970,6 +1539,42 @@ lu_byte luaH_getshortstr (Table *t, TString *key, TValue *res) {
 }
 
 
+#if defined(LUA_USE_FIELDCACHE)
+
+/*
+** Search for a short string using '*hint' as a guess for the index of
+** its node. The guess is checked against the key in that node, so it
+** needs no invalidation when the table is resized or rehashed; an
+** out-of-date hint is simply a miss. (Dead keys never match, as their
+** tags are not strings.) On a miss, do a regular search and, if the
+** key is present, update the hint.
+*/
+static const TValue *Hgetshortstrc (lua_State *L, Table *t, TString *key,
+                                                   unsigned *hint) {
+  unsigned i = *hint;
+  const TValue *slot;
+  if (i < sizenode(t)) {
+    Node *n = gnode(t, i);
+    if (keyisshrstr(n) && eqshrstr(keystrval(n), key)) {
+      G(L)->fchits++;
+      return gval(n);
+    }
+  }
+  G(L)->fcmisses++;
+  slot = luaH_Hgetshortstr(t, key);
+  if (!isabstkey(slot))
+    *hint = cast_uint(nodefromval(slot) - t->node);
+  return slot;
+}
+
+
+lu_byte luaH_getshortstrc (lua_State *L, Table *t, TString *key,
+                                         TValue *res, unsigned *hint) {
+  return finishnodeget(Hgetshortstrc(L, t, key, hint), res);
+}
+#endif
+
+
 static const TValue *Hgetstr (Table *t, TString *key) {
   if (key->tt == LUA_VSHRSTR)
     return luaH_Hgetshortstr(t, key);
@@ -1055,6 +1660,8 @@ int luaH_psetint (Table *t, lua_Integer key, TValue *val) {
     else
       return ~cast_int(key - 1);  /* empty slot in the array part */
   }
+  else if (isvector(t))
+    return vecpsetint(t, key, val);
   else
     return finishnodeset(t, getintfromhash(t, key), val);
 }
@@ -1070,6 +1677,14 @@ int luaH_psetstr (Table *t, TString *key, TValue *val) {
 }
 
 
+#if defined(LUA_USE_FIELDCACHE)
+int luaH_psetshortstrc (lua_State *L, Table *t, TString *key,
+                                      TValue *val, unsigned *hint) {
+  return finishnodeset(t, Hgetshortstrc(L, t, key, hint), val);
+}
+#endif
+
+
 int luaH_pset (Table *t, const TValue *key, TValue *val) {
   switch (ttypetag(key)) {
     case LUA_VSHRSTR: return luaH_psetshortstr(t, tsvalue(key), val);
@@ -1100,6 +1715,10 @@ void luaH_finishset (lua_State *L, Table *t, const TValue *key,
   if (hres == HNOTFOUND) {
     luaH_newkey(L, t, key, value);
   }
+  else if (hres == HVECTOR) {
+    vectotable(L, t);
+    luaH_set(L, t, key, value);
+  }
   else if (hres > 0) {  /* regular Node? */
     setobj2t(L, gval(gnode(t, hres - HFIRSTNODE)), value);
   }
@@ -1128,6 +1747,14 @@ void luaH_set (lua_State *L, Table *t, const TValue *key, TValue *value) {
 void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
   if (keyinarray(t, key))
     obj2arr(t, key - 1, value);
+  else if (isvector(t)) {
+    int hres = vecpsetint(t, key, value);
+    if (hres != HOK) {
+      TValue k;
+      setivalue(&k, key);
+      luaH_finishset(L, t, &k, value, hres);
+    }
+  }
   else {
     int ok = rawfinishnodeset(getintfromhash(t, key), value);
     if (!ok) {
@@ -1139,6 +1766,58 @@ void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
 }
 
 
+/*
+** Copy the 'n' entries 'src[f .. f + n - 1]' into 'dst[t .. t + n - 1]',
+** with the same result as raw gets and sets done in a proper order
+** (as in a 'memmove', when both tables are the same). Neither range
+** can wrap around. When both ranges are inside the array parts, tags
+** and values are copied in bulk; a destination range starting inside
+** its array part or right after it grows that part to fit. (Vectors
+** are handled likewise.)
+*/
+void luaH_move (lua_State *L, Table *src, lua_Integer f, lua_Integer n,
+                              Table *dst, lua_Integer t) {
+  lua_Unsigned f0 = l_castS2U(f) - 1u;  /* C indices */
+  lua_Unsigned t0 = l_castS2U(t) - 1u;
+  lua_Unsigned un = l_castS2U(n);
+  unsigned dsize = luaH_realasize(dst);
+  if (n <= 0)
+    return;  /* nothing to move */
+  if (isvector(src) && isvector(dst) && vecmove(L, src, f0, un, dst, t0))
+    return;  /* moved in bulk between vectors */
+  if (!isvector(dst) &&
+      f0 < luaH_realasize(src) && un <= luaH_realasize(src) - f0 &&
+      t0 <= dsize && un <= MAXASIZE - t0) {
+    if (t0 + un > dsize) {  /* must grow destination's array part? */
+      unsigned size = (dsize > 0) ? dsize : 1;
+      while (size < t0 + un)
+        size = (size <= MAXASIZE / 2) ? size * 2 : MAXASIZE;
+      luaH_resizearray(L, dst, size);
+    }
+    memmove(getArrTag(dst, t0), getArrTag(src, f0), cast_sizet(un));
+    /* (values are stored backwards) */
+    memmove(getArrVal(dst, t0 + un - 1), getArrVal(src, f0 + un - 1),
+            cast_sizet(un) * sizeof(Value));
+    if (isblack(obj2gco(dst)))  /* may have copied white objects? */
+      luaC_barrierback_(L, obj2gco(dst));
+  }
+  else {  /* copy one by one */
+    /* copy up unless 't' is in '(f, f + n - 1]' in the same table */
+    int up = (src != dst ||
+              l_castS2U(t) - l_castS2U(f) - 1u >= un - 1u);
+    lua_Integer i;
+    for (i = 0; i < n; i++) {
+      lua_Integer k = up ? i : n - 1 - i;
+      TValue v;
+      if (tagisempty(luaH_getint(src, f + k, &v)))
+        setnilvalue(&v);
+      luaH_setint(L, dst, t + k, &v);
+      luaC_barrierback(L, obj2gco(dst), &v);
+    }
+  }
+}
+
+
 /*
 ** Try to find a boundary in the hash part of table 't'. From the
 ** caller, we know that 'j' is zero or present and that 'j + 1' is
@@ -1221,6 +1900,8 @@ static unsigned int binsearch (Table *array, unsigned int i, unsigned int j) {
 */
 lua_Unsigned luaH_getn (Table *t) {
   unsigned int limit = t->alimit;
+  if (isvector(t))
+    return getvecinfo(t)->len;
   if (limit > 0 && arraykeyisempty(t, limit)) {  /* (1)? */
     /* there must be a boundary before 'limit' */
     if (limit >= 2 && !arraykeyisempty(t, limit - 1)) {
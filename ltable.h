@@ -51,6 +51,8 @@
     if ((u < h->alimit)) { \
       tag = *getArrTag(h, u); \
       if (!tagisempty(tag)) { farr2val(h, u, tag, res); }} \
+    else if (isvector(h) && u < getvecinfo(h)->len) { \
+      tag = getvecinfo(h)->tag; farr2val(h, u, tag, res); } \
     else { tag = luaH_getint(h, (k), res); }}
 
 
@@ -60,6 +62,9 @@
       lu_byte *tag = getArrTag(h, u); \
       if (tagisempty(*tag)) hres = ~cast_int(u); \
       else { fval2arr(h, u, tag, val); hres = HOK; }} \
+    else if (isvector(h) && u < getvecinfo(h)->len && \
+             ttypetag(val) == getvecinfo(h)->tag) { \
+      *getArrVal(h, u) = (val)->value_; hres = HOK; } \
     else { hres = luaH_psetint(h, k, val); }}
 
 
@@ -67,7 +72,8 @@
 #define HOK		0
 #define HNOTFOUND	1
 #define HNOTATABLE	2
-#define HFIRSTNODE	3
+#define HVECTOR		3
+#define HFIRSTNODE	4
 
 /*
 ** 'luaH_get*' operations set 'res', unless the value is absent, and
@@ -81,7 +87,10 @@
 ** hash part, the encoding is (HFIRSTNODE + hash index); if the slot is
 ** in the array part, the encoding is (~array index), a negative value.
 ** The value HNOTATABLE is used by the fast macros to signal that the
-** value being indexed is not a table.
+** value being indexed is not a table. HVECTOR signals that the key is
+** present in a vector (see below) that cannot keep the new value; the
+** set must go on without metamethods, after the vector becomes a
+** regular table.
 ** (The size for the array part is limited by the maximum power of two
 ** that fits in an unsigned integer; that is INT_MAX+1. So, the C-index
 ** ranges from 0, which encodes to -1, to INT_MAX, which encodes to
@@ -115,6 +124,26 @@
 #define getArrVal(t,k)	((t)->array - 1 - (k))
 
 
+/*
+** A "vector" is a table whose array part keeps only values with one
+** numeric tag (integer or float), with no tags per element: its block
+** has the values, stored backwards as in regular arrays, followed by
+** a 'VecInfo' with the common tag, the number of values, and the size
+** of the block. A vector has no hash part and 'alimit' equal to zero,
+** so that code unaware of vectors sees an empty array part. (A regular
+** table with an array part always has a positive 'alimit'.)
+*/
+typedef struct VecInfo {
+  unsigned len;  /* values are t[1 .. len] */
+  unsigned size;  /* number of slots in the block */
+  lu_byte tag;  /* tag of all values */
+} VecInfo;
+
+#define isvector(t)	((t)->alimit == 0 && (t)->array != NULL)
+
+#define getvecinfo(t)	check_exp(isvector(t), cast(VecInfo*, (t)->array))
+
+
 /*
 ** Move TValues to/from arrays, using C indices
 */
@@ -152,10 +181,20 @@ LUAI_FUNC int luaH_psetshortstr (Table *t, TString *key, TValue *val);
 LUAI_FUNC int luaH_psetstr (Table *t, TString *key, TValue *val);
 LUAI_FUNC int luaH_pset (Table *t, const TValue *key, TValue *val);
 
+#if defined(LUA_USE_FIELDCACHE)
+/* variants of 'luaH_getshortstr'/'luaH_psetshortstr' with a slot hint */
+LUAI_FUNC lu_byte luaH_getshortstrc (lua_State *L, Table *t, TString *key,
+                                     TValue *res, unsigned *hint);
+LUAI_FUNC int luaH_psetshortstrc (lua_State *L, Table *t, TString *key,
+                                  TValue *val, unsigned *hint);
+#endif
+
 LUAI_FUNC void luaH_setint (lua_State *L, Table *t, lua_Integer key,
                                                     TValue *value);
 LUAI_FUNC void luaH_set (lua_State *L, Table *t, const TValue *key,
                                                  TValue *value);
+LUAI_FUNC void luaH_move (lua_State *L, Table *src, lua_Integer f,
+                          lua_Integer n, Table *dst, lua_Integer t);
 
 LUAI_FUNC void luaH_finishset (lua_State *L, Table *t, const TValue *key,
                                               TValue *value, int hres);
@@ -163,6 +202,8 @@ LUAI_FUNC Table *luaH_new (lua_State *L);
 LUAI_FUNC void luaH_resize (lua_State *L, Table *t, unsigned nasize,
                                                     unsigned nhsize);
 LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, unsigned nasize);
+LUAI_FUNC void luaH_setvector (lua_State *L, Table *t, lu_byte tag,
+                                                     unsigned size);
 LUAI_FUNC void luaH_free (lua_State *L, Table *t);
 LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
 LUAI_FUNC lua_Unsigned luaH_getn (Table *t);
@@ -11,6 +11,7 @@
 
 
 #include <limits.h>
+#include <locale.h>
 #include <stddef.h>
 #include <string.h>
 
@@ -59,6 +60,25 @@ static void checktab (lua_State *L, int arg, int what) {
 }
 
 
+/*
+** Check whether 'arg' is a table without the metamethods for the
+** operations in 'what' (only read and write), so that raw accesses to
+** it are equivalent to regular ones.
+*/
+static int israwtab (lua_State *L, int arg, int what) {
+  int res = 1;
+  if (lua_type(L, arg) != LUA_TTABLE)
+    return 0;
+  else if (lua_getmetatable(L, arg)) {
+    int n = 1;  /* number of elements to pop */
+    res = (!(what & TAB_R) || !checkfield(L, "__index", ++n)) &&
+          (!(what & TAB_W) || !checkfield(L, "__newindex", ++n));
+    lua_pop(L, n);  /* pop metatable and tested metamethods */
+  }
+  return res;
+}
+
+
 static int tcreate (lua_State *L) {
   lua_Unsigned sizeseq = (lua_Unsigned)luaL_checkinteger(L, 1);
   lua_Unsigned sizerest = (lua_Unsigned)luaL_optinteger(L, 2, 0);
@@ -69,6 +89,16 @@ static int tcreate (lua_State *L) {
 }
 
 
+static int tvector (lua_State *L) {
+  static const char *const kinds[] = {"float", "integer", NULL};
+  int isint = luaL_checkoption(L, 1, NULL, kinds);
+  lua_Unsigned size = (lua_Unsigned)luaL_optinteger(L, 2, 0);
+  luaL_argcheck(L, size <= UINT_MAX, 2, "out of range");
+  lua_createvector(L, isint, (unsigned)size);
+  return 1;
+}
+
+
 static int tinsert (lua_State *L) {
   lua_Integer pos;  /* where to insert new element */
   lua_Integer e = aux_getn(L, 1, TAB_RW);
@@ -84,9 +114,13 @@ static int tinsert (lua_State *L) {
       /* check whether 'pos' is in [1, e] */
       luaL_argcheck(L, (lua_Unsigned)pos - 1u < (lua_Unsigned)e, 2,
                        "position out of bounds");
-      for (i = e; i > pos; i--) {  /* move up elements */
-        lua_geti(L, 1, i - 1);
-        lua_seti(L, 1, i);  /* t[i] = t[i - 1] */
+      if (israwtab(L, 1, TAB_RW))  /* move up elements in bulk? */
+        lua_rawmove(L, 1, pos, e - 1, pos + 1, 1);
+      else {
+        for (i = e; i > pos; i--) {  /* move up elements */
+          lua_geti(L, 1, i - 1);
+          lua_seti(L, 1, i);  /* t[i] = t[i - 1] */
+        }
       }
       break;
     }
@@ -107,6 +141,10 @@ static int tremove (lua_State *L) {
     luaL_argcheck(L, (lua_Unsigned)pos - 1u <= (lua_Unsigned)size, 2,
                      "position out of bounds");
   lua_geti(L, 1, pos);  /* result = t[pos] */
+  if (pos < size && israwtab(L, 1, TAB_RW)) {  /* move down in bulk? */
+    lua_rawmove(L, 1, pos + 1, size, pos, 1);
+    pos = size;
+  }
   for ( ; pos < size; pos++) {
     lua_geti(L, 1, pos + 1);
     lua_seti(L, 1, pos);  /* t[pos] = t[pos + 1] */
@@ -121,7 +159,8 @@ static int tremove (lua_State *L) {
 ** Copy elements (1[f], ..., 1[e]) into (tt[t], tt[t+1], ...). Whenever
 ** possible, copy in increasing order, which is better for rehashing.
 ** "possible" means destination after original range, or smaller
-** than origin, or copying to another table.
+** than origin, or copying to another table. Tables without the
+** relevant metamethods are copied in bulk.
 */
 static int tmove (lua_State *L) {
   lua_Integer f = luaL_checkinteger(L, 2);
@@ -137,7 +176,10 @@ static int tmove (lua_State *L) {
     n = e - f + 1;  /* number of elements to move */
     luaL_argcheck(L, t <= LUA_MAXINTEGER - n + 1, 4,
                   "destination wrap around");
-    if (t > e || t <= f || (tt != 1 && !lua_compare(L, 1, tt, LUA_OPEQ))) {
+    if (israwtab(L, 1, TAB_R) && israwtab(L, tt, TAB_W))
+      lua_rawmove(L, 1, f, e, t, tt);
+    else if (t > e || t <= f ||
+             (tt != 1 && !lua_compare(L, 1, tt, LUA_OPEQ))) {
       for (i = 0; i < n; i++) {
         lua_geti(L, 1, f + i);
         lua_seti(L, tt, t + i);
@@ -164,6 +206,63 @@ static void addfield (lua_State *L, luaL_Buffer *b, lua_Integer i) {
 }
 
 
+/*
+** Ranges from this size on are concatenated in bulk, when possible.
+** (For smaller ones, the first pass costs more than it saves.)
+*/
+#if !defined(CONCATBULK)
+#define CONCATBULK	2048
+#endif
+
+
+/* a string of the array in 'concat' */
+typedef struct CStr {
+  const char *s;
+  size_t l;
+} CStr;
+
+
+/*
+** Concatenation of 't[i .. last]', for a table without '__index' where
+** all these values are strings: a first pass collects the strings
+** (which the table keeps alive) and the length of the result, so that
+** the result is built with plain copies into a buffer of the right
+** size. Returns 0, with nothing pushed, if some value is not a string.
+*/
+static int concatstrs (lua_State *L, lua_Integer i, lua_Integer last,
+                       const char *sep, size_t lsep) {
+  size_t n = cast_sizet(l_castS2U(last) - l_castS2U(i)) + 1;
+  size_t tl = 0;  /* total length */
+  size_t k;
+  CStr *a = (CStr *)lua_newuserdatauv(L, n * sizeof(CStr), 0);
+  luaL_Buffer b;
+  char *p;
+  for (k = 0; k < n; k++) {
+    if (lua_rawgeti(L, 1, i + l_castU2S(k)) != LUA_TSTRING) {
+      lua_pop(L, 2);  /* pop value and array */
+      return 0;
+    }
+    a[k].s = lua_tolstring(L, -1, &a[k].l);
+    lua_pop(L, 1);
+    if (a[k].l + lsep > MAX_SIZE - tl)
+      return luaL_error(L, "resulting string too large");
+    tl += a[k].l + lsep;
+  }
+  tl -= lsep;  /* no separator after last string */
+  p = luaL_buffinitsize(L, &b, tl);
+  for (k = 0; k < n; k++) {
+    memcpy(p, a[k].s, a[k].l);
+    p += a[k].l;
+    if (k < n - 1) {
+      memcpy(p, sep, lsep);
+      p += lsep;
+    }
+  }
+  luaL_pushresultsize(&b, tl);
+  return 1;
+}
+
+
 static int tconcat (lua_State *L) {
   luaL_Buffer b;
   lua_Integer last = aux_getn(L, 1, TAB_R);
@@ -171,6 +270,12 @@ static int tconcat (lua_State *L) {
   const char *sep = luaL_optlstring(L, 2, "", &lsep);
   lua_Integer i = luaL_optinteger(L, 3, 1);
   last = luaL_optinteger(L, 4, last);
+  if (1 <= i && i < last &&
+      l_castS2U(last) - l_castS2U(i) >= CONCATBULK &&
+      israwtab(L, 1, TAB_R) &&
+      l_castS2U(last) <= lua_rawlen(L, 1) &&  /* all values present? */
+      concatstrs(L, i, last, sep, lsep))
+    return 1;
   luaL_buffinit(L, &b);
   for (; i < last; i++) {
     addfield(L, &b, i);
@@ -211,6 +316,10 @@ static int tunpack (lua_State *L) {
   if (l_unlikely(n >= (unsigned int)INT_MAX  ||
                  !lua_checkstack(L, (int)(++n))))
     return luaL_error(L, "too many results to unpack");
+  if (israwtab(L, 1, TAB_R)) {  /* push all elements in bulk? */
+    lua_rawgetn(L, 1, i, (int)n);
+    return (int)n;
+  }
   for (; i < e; i++) {  /* push arg[i..e - 1] (to avoid overflows) */
     lua_geti(L, 1, i);
   }
@@ -391,20 +500,620 @@ static void auxsort (lua_State *L, IdxT lo, IdxT up, unsigned rnd) {
 }
 
 
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Sort of arrays of numbers or strings
+** (pattern-defeating quicksort, after Orson Peters, "pdqsort",
+**  arXiv:2106.05123, 2021)
+** =======================================================
+*/
+
+/*
+** When there is no order function and the table has no metatable,
+** an array with only integers, only floats (but no NaN), or only
+** strings is copied to a C array, sorted there, and written back,
+** without any call to 'lua_compare'. Numbers are mapped to unsigned
+** keys with the same order; strings are sorted as byte sequences,
+** which is their order only in the "C" locale.
+*/
+
+typedef lua_Unsigned SKey;
+
+#define SIGNBIT		(~(~(SKey)0 >> 1))
+
+/* arrays up to this size are sorted by insertion */
+#define SMALLSORT	24
+
+/* arrays up to this size use a buffer in the C stack */
+#define SORTBUFF	64
+
+/*
+** Arrays of integers from this size on use a radix sort, if their keys
+** span at most RADIXBYTES bytes. (Keys of floats crowd into a few top
+** bytes, which makes the radix sort slower than the quicksort.)
+*/
+#if !defined(RADIXMIN)
+#define RADIXMIN	2048
+#endif
+#if !defined(RADIXBYTES)
+#define RADIXBYTES	8
+#endif
+
+/* arrays larger than this first split the keys by their top byte */
+#if !defined(RADIXMSD)
+#define RADIXMSD	(1u << 16)
+#endif
+
+
+#define swapkeys(a,i,j)	{ SKey t_ = a[i]; a[i] = a[j]; a[j] = t_; }
+
+
+static void inssortkeys (SKey *a, size_t n) {
+  size_t i;
+  for (i = 1; i < n; i++) {
+    SKey x = a[i];
+    size_t j;
+    for (j = i; j > 0 && x < a[j - 1]; j--)
+      a[j] = a[j - 1];
+    a[j] = x;
+  }
+}
+
+
+static void siftkeys (SKey *a, size_t i, size_t n) {
+  SKey x = a[i];
+  size_t c;
+  while ((c = 2 * i + 1) < n) {  /* while 'i' has a child 'c' */
+    if (c + 1 < n && a[c] < a[c + 1]) c++;  /* use the larger child */
+    if (!(x < a[c])) break;
+    a[i] = a[c];
+    i = c;
+  }
+  a[i] = x;
+}
+
+
+static void heapsortkeys (SKey *a, size_t n) {
+  size_t i;
+  for (i = n / 2; i > 0; i--)
+    siftkeys(a, i - 1, n);
+  for (i = n - 1; i > 0; i--) {
+    swapkeys(a, 0, i);
+    siftkeys(a, 0, i);
+  }
+}
+
+
+/* sort 'a[i]', 'a[j]', and 'a[k]' */
+static void sort3keys (SKey *a, size_t i, size_t j, size_t k) {
+  if (a[j] < a[i]) swapkeys(a, i, j);
+  if (a[k] < a[j]) {
+    swapkeys(a, j, k);
+    if (a[j] < a[i]) swapkeys(a, i, j);
+  }
+}
+
+
+/*
+** Partition 'a[0 .. n - 1]' around the pivot 'a[0]', with no branches
+** that depend on the data: each element is swapped to the border, and
+** the border advances by the result of the comparison. With 'eq', the
+** left part also gets the elements equal to the pivot. Returns the
+** final position of the pivot.
+*/
+static size_t partkeys (SKey *a, size_t n, int eq) {
+  SKey p = a[0];
+  size_t i, b = 1;  /* a[1 .. b - 1] goes left */
+  if (eq) {
+    for (i = 1; i < n; i++) {
+      SKey x = a[i];
+      a[i] = a[b]; a[b] = x;
+      b += (x <= p);
+    }
+  }
+  else {
+    for (i = 1; i < n; i++) {
+      SKey x = a[i];
+      a[i] = a[b]; a[b] = x;
+      b += (x < p);
+    }
+  }
+  a[0] = a[b - 1]; a[b - 1] = p;
+  return b - 1;
+}
+
+
+/*
+** Sort 'a[0 .. n - 1]'. When not 'leftmost', 'a[-1]' is not larger
+** than any element in the array. 'bad' is the number of imbalanced
+** partitions still allowed before switching to heapsort.
+*/
+static void pdqkeys (SKey *a, size_t n, int bad, int leftmost) {
+  while (n > SMALLSORT) {
+    size_t m = n / 2;
+    size_t p, nl, nr;
+    if (n > 128) {  /* pivot is the median of three medians */
+      sort3keys(a, 0, m, n - 1);
+      sort3keys(a, 1, m - 1, n - 2);
+      sort3keys(a, 2, m + 1, n - 3);
+      sort3keys(a, m - 1, m, m + 1);
+      swapkeys(a, 0, m);
+    }
+    else  /* pivot is the median of three */
+      sort3keys(a, m, 0, n - 1);
+    if (!leftmost && !(a[-1] < a[0])) {  /* pivot equal to 'a[-1]'? */
+      p = partkeys(a, n, 1);  /* left part has only copies of 'a[-1]' */
+      a += p + 1; n -= p + 1;  /* they are done */
+      continue;
+    }
+    p = partkeys(a, n, 0);
+    nl = p; nr = n - p - 1;
+    if (nl < n / 8 || nr < n / 8) {  /* imbalanced partition? */
+      if (--bad == 0) {  /* too many of them? */
+        heapsortkeys(a, n);
+        return;
+      }
+      /* break patterns that may cause imbalance */
+      if (nl >= SMALLSORT) {
+        swapkeys(a, 0, nl / 4);
+        swapkeys(a, p - 1, p - nl / 4);
+      }
+      if (nr >= SMALLSORT) {
+        swapkeys(a, p + 1, p + 1 + nr / 4);
+        swapkeys(a, n - 1, n - nr / 4);
+      }
+    }
+    if (nl < nr) {  /* recurse into the smaller part */
+      pdqkeys(a, nl, bad, leftmost);
+      a += p + 1; n = nr; leftmost = 0;
+    }
+    else {
+      pdqkeys(a + p + 1, nr, bad, 0);
+      n = nl;
+    }
+  }
+  inssortkeys(a, n);
+}
+
+
+/*
+** LSD radix sort of 'a[0 .. n - 1]', one byte per pass, using 'b' as
+** scratch space for 'n' keys. Keys are taken relative to the smallest
+** one ('min'), with 'nb' bytes in their range, so that there are
+** passes only for those bytes; passes where all keys have the same
+** byte are skipped.
+*/
+static void radixkeys (SKey *a, SKey *b, size_t n, SKey min, unsigned nb) {
+  SKey *const a0 = a;
+  size_t count[sizeof(SKey)][256];
+  size_t i;
+  unsigned d;
+  memset(count, 0, sizeof(count[0]) * nb);
+  for (i = 0; i < n; i++) {  /* count all bytes in one go */
+    SKey k = a[i] - min;
+    for (d = 0; d < nb; d++)
+      count[d][(k >> (8 * d)) & 0xFF]++;
+  }
+  for (d = 0; d < nb; d++) {
+    size_t *c = count[d];
+    size_t sum = 0;
+    unsigned v;
+    if (c[((a[0] - min) >> (8 * d)) & 0xFF] == n)
+      continue;  /* all keys have the same byte */
+    for (v = 0; v < 256; v++) {  /* count -> first position for byte */
+      size_t t = c[v];
+      c[v] = sum;
+      sum += t;
+    }
+    for (i = 0; i < n; i++) {
+      SKey k = a[i];
+      b[c[((k - min) >> (8 * d)) & 0xFF]++] = k;
+    }
+    { SKey *t = a; a = b; b = t; }  /* result goes back to 'a' */
+  }
+  if (a != a0)  /* result is in the scratch space? */
+    memcpy(a0, a, n * sizeof(SKey));
+}
+
+
+/*
+** For arrays too large for the caches, the scattering in each pass of
+** the LSD radix sort misses too much. Instead, a first pass splits the
+** keys by their most significant byte, into buckets that usually fit
+** in the caches; then each bucket is sorted by the other bytes.
+*/
+static void msdradixkeys (SKey *a, SKey *b, size_t n, SKey min,
+                          unsigned nb) {
+  size_t count[256], start[256];
+  unsigned sh = 8 * (nb - 1);
+  size_t i, sum = 0;
+  unsigned v;
+  memset(count, 0, sizeof(count));
+  for (i = 0; i < n; i++)
+    count[((a[i] - min) >> sh) & 0xFF]++;
+  for (v = 0; v < 256; v++) {
+    start[v] = sum;
+    sum += count[v];
+  }
+  for (i = 0; i < n; i++) {
+    SKey k = a[i];
+    b[start[((k - min) >> sh) & 0xFF]++] = k;
+  }
+  for (v = 0, i = 0; v < 256; i += count[v++]) {  /* sort each bucket */
+    size_t m = count[v];
+    if (m <= SMALLSORT)
+      inssortkeys(b + i, m);
+    else if (m > RADIXMSD && nb > 2)  /* bucket still too large? */
+      msdradixkeys(b + i, a + i, m, min, nb - 1);
+    else  /* (all keys in the bucket have the same top byte) */
+      radixkeys(b + i, a + i, m, min, nb - 1);
+  }
+  memcpy(a, b, n * sizeof(SKey));
+}
+
+
+/*
+** Sort 'a[0 .. n - 1]', with a shortcut for (reversed) sorted arrays.
+** If given a scratch space 'b', use a radix sort.
+*/
+static void sortkeys (SKey *a, SKey *b, size_t n) {
+  size_t i;
+  int bad = 1;
+  for (i = 1; i < n && a[i - 1] <= a[i]; i++) ;
+  if (i == n) return;  /* already sorted */
+  for (i = 1; i < n && a[i - 1] >= a[i]; i++) ;
+  if (i == n) {  /* sorted in reverse order? */
+    for (i = 0; i < n / 2; i++) swapkeys(a, i, n - 1 - i);
+    return;
+  }
+  if (b != NULL) {  /* radix sort worth it for narrow ranges */
+    SKey min = a[0], max = a[0];
+    unsigned nb = 0;
+    for (i = 1; i < n; i++) {
+      if (a[i] < min) min = a[i];
+      else if (a[i] > max) max = a[i];
+    }
+    for (max -= min; max != 0; max >>= 8) nb++;  /* bytes in range */
+    if (nb <= RADIXBYTES) {
+      if (n > RADIXMSD && nb > 1)
+        msdradixkeys(a, b, n, min, nb);
+      else
+        radixkeys(a, b, n, min, nb);
+      return;
+    }
+  }
+  for (i = n; i > 1; i >>= 1) bad++;  /* log2(n) + 1 */
+  pdqkeys(a, n, bad, 1);
+}
+
+
+/* strings are sorted through records with their original positions */
+typedef struct SStr {
+  const char *s;
+  size_t l;
+  IdxT i;  /* original position in the array */
+} SStr;
+
+
+static int strless (const SStr *a, const SStr *b) {
+  int res = memcmp(a->s, b->s, (a->l < b->l) ? a->l : b->l);
+  return (res < 0 || (res == 0 && a->l < b->l));
+}
+
+
+#define swapstrs(a,i,j)	{ SStr t_ = a[i]; a[i] = a[j]; a[j] = t_; }
+
+
+static void inssortstrs (SStr *a, size_t n) {
+  size_t i;
+  for (i = 1; i < n; i++) {
+    SStr x = a[i];
+    size_t j;
+    for (j = i; j > 0 && strless(&x, &a[j - 1]); j--)
+      a[j] = a[j - 1];
+    a[j] = x;
+  }
+}
+
+
+static void siftstrs (SStr *a, size_t i, size_t n) {
+  SStr x = a[i];
+  size_t c;
+  while ((c = 2 * i + 1) < n) {
+    if (c + 1 < n && strless(&a[c], &a[c + 1])) c++;
+    if (!strless(&x, &a[c])) break;
+    a[i] = a[c];
+    i = c;
+  }
+  a[i] = x;
+}
+
+
+/*
+** Quicksort with a median-of-three pivot and Hoare's partition (string
+** comparisons cost too much for the tricks in 'pdqkeys' to pay off),
+** switching to heapsort after too many imbalanced partitions.
+*/
+static void sortstrs (SStr *a, size_t n, int bad) {
+  while (n > SMALLSORT) {
+    size_t m = n / 2, i = 0, j = n - 1;
+    if (strless(&a[m], &a[0])) swapstrs(a, 0, m);
+    if (strless(&a[n - 1], &a[m])) {
+      swapstrs(a, m, n - 1);
+      if (strless(&a[m], &a[0])) swapstrs(a, 0, m);
+    }
+    swapstrs(a, 0, m);  /* pivot goes to 'a[0]' */
+    for (;;) {  /* invariant: a[1 .. i] <= P <= a[j + 1 .. n - 1] */
+      while (strless(&a[++i], &a[0])) ;  /* (a[n - 1] >= P stops it) */
+      while (strless(&a[0], &a[--j])) ;  /* (a[0] == P stops it) */
+      if (j <= i) break;
+      swapstrs(a, i, j);
+    }
+    swapstrs(a, 0, j);  /* a[0 .. j - 1] <= a[j] == P <= a[j + 1 ..] */
+    if (j < n / 8 || n - j - 1 < n / 8) {  /* imbalanced partition? */
+      if (--bad == 0) {
+        size_t k;
+        for (k = n / 2; k > 0; k--) siftstrs(a, k - 1, n);
+        for (k = n - 1; k > 0; k--) {
+          swapstrs(a, 0, k);
+          siftstrs(a, 0, k);
+        }
+        return;
+      }
+    }
+    if (j < n - j - 1) {  /* recurse into the smaller part */
+      sortstrs(a, j, bad);
+      a += j + 1; n -= j + 1;
+    }
+    else {
+      sortstrs(a + j + 1, n - j - 1, bad);
+      n = j;
+    }
+  }
+  inssortstrs(a, n);
+}
+
+
+static int ccollate (void) {
+  const char *loc = setlocale(LC_COLLATE, NULL);
+  return (loc != NULL &&
+          (strcmp(loc, "C") == 0 || strcmp(loc, "POSIX") == 0));
+}
+
+
+/*
+** Map a number at the top of the stack to its key; 0 if not possible.
+** (A stable sort cannot tell -0.0 from 0.0 by their keys.)
+*/
+static int tokey (lua_State *L, int isint, int stable, SKey *k) {
+  if (isint)
+    *k = l_castS2U(lua_tointeger(L, -1)) ^ SIGNBIT;
+  else {
+    lua_Number x = lua_tonumber(L, -1);
+    if (x != x)  /* NaN? */
+      return 0;
+    memcpy(k, &x, sizeof(x));  /* IEEE layout: sign + magnitude */
+    *k = (*k & SIGNBIT) ? ~*k : *k | SIGNBIT;
+    if (stable && *k == ~SIGNBIT)  /* -0.0? */
+      return 0;
+  }
+  return 1;
+}
+
+
+static void pushkey (lua_State *L, int isint, SKey k) {
+  if (isint)
+    lua_pushinteger(L, l_castU2S(k ^ SIGNBIT));
+  else {
+    lua_Number x;
+    k = (k & SIGNBIT) ? k ^ SIGNBIT : ~k;
+    memcpy(&x, &k, sizeof(x));
+    lua_pushnumber(L, x);
+  }
+}
+
+
+static int sortnumbers (lua_State *L, IdxT n, int isint, int stable) {
+  SKey buff[SORTBUFF];
+  SKey *a, *b = NULL;
+  int radix = (isint && n >= RADIXMIN);  /* use a radix sort? */
+  IdxT i;
+  if (!isint && sizeof(lua_Number) != sizeof(SKey))
+    return 0;  /* no keys for these floats */
+  if (n <= SORTBUFF && !radix)
+    a = buff;
+  else {  /* a radix sort needs scratch space for other 'n' keys */
+    size_t sz = radix ? 2 * cast_sizet(n) : n;
+    a = (SKey *)lua_newuserdatauv(L, sz * sizeof(SKey), 0);
+    if (radix) b = a + n;
+  }
+  for (i = 0; i < n; i++) {
+    int t = lua_rawgeti(L, 1, l_castU2S(i + 1));
+    if (t != LUA_TNUMBER || lua_isinteger(L, -1) != isint ||
+        !tokey(L, isint, stable, &a[i])) {
+      lua_settop(L, 2);
+      return 0;  /* not a homogeneous array */
+    }
+    lua_pop(L, 1);
+  }
+  sortkeys(a, b, n);
+  for (i = 0; i < n; i++) {
+    pushkey(L, isint, a[i]);
+    lua_rawseti(L, 1, l_castU2S(i + 1));
+  }
+  lua_settop(L, 2);
+  return 1;
+}
+
+
+static int sortstrings (lua_State *L, IdxT n) {
+  SStr *a;
+  IdxT i;
+  int bad = 1;
+  if (!ccollate())
+    return 0;
+  a = (SStr *)lua_newuserdatauv(L, n * sizeof(SStr), 0);
+  for (i = 0; i < n; i++) {  /* (the table keeps the strings alive) */
+    if (lua_rawgeti(L, 1, l_castU2S(i + 1)) != LUA_TSTRING) {
+      lua_settop(L, 2);
+      return 0;  /* not a homogeneous array */
+    }
+    a[i].s = lua_tolstring(L, -1, &a[i].l);
+    a[i].i = i;
+    lua_pop(L, 1);
+  }
+  for (i = n; i > 1; i >>= 1) bad++;  /* log2(n) + 1 */
+  sortstrs(a, n, bad);
+  for (i = 0; i < n; i++) {  /* apply the permutation, cycle by cycle */
+    IdxT j = i;
+    if (a[i].i == i) continue;  /* already in place */
+    lua_rawgeti(L, 1, l_castU2S(i + 1));  /* save first element */
+    for (;;) {  /* a[j].i is the element that goes to 'j' */
+      IdxT src = a[j].i;
+      a[j].i = j;  /* mark it as done */
+      if (src == i) break;
+      lua_rawgeti(L, 1, l_castU2S(src + 1));
+      lua_rawseti(L, 1, l_castU2S(j + 1));
+      j = src;
+    }
+    lua_rawseti(L, 1, l_castU2S(j + 1));  /* saved element closes cycle */
+  }
+  lua_settop(L, 2);
+  return 1;
+}
+
+
+/*
+** Try to sort the array in the table at index 1 (with 'n' > 1 elements)
+** without an order function. Returns 0 if that is not possible. (For
+** these arrays, elements that compare equal are equal, so any sort is
+** stable, except for -0.0 and 0.0.)
+*/
+static int sortarray (lua_State *L, IdxT n, int stable) {
+  if (!lua_isnil(L, 2) || lua_type(L, 1) != LUA_TTABLE)
+    return 0;
+  if (lua_getmetatable(L, 1)) {  /* metamethods may change the order */
+    lua_pop(L, 1);
+    return 0;
+  }
+  switch (lua_rawgeti(L, 1, 1)) {  /* the type of the first element */
+    case LUA_TNUMBER: {
+      int isint = lua_isinteger(L, -1);
+      lua_pop(L, 1);
+      return sortnumbers(L, n, isint, stable);
+    }
+    case LUA_TSTRING: {
+      lua_pop(L, 1);
+      return sortstrings(L, n);
+    }
+    default: {
+      lua_pop(L, 1);
+      return 0;
+    }
+  }
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Stable sort
+** =======================================================
+*/
+
+/*
+** A merge sort of the indices of a copy of the array (a table at stack
+** index 3), so that the array itself changes only at the end, after
+** all calls to the order function.
+*/
+
+/* arrays up to this size are sorted by insertion */
+#define MERGESMALL	8
+
+
+/* Return true iff element 'a' is less than element 'b' in the copy */
+static int idxless (lua_State *L, IdxT a, IdxT b) {
+  int res;
+  lua_rawgeti(L, 3, l_castU2S(a));
+  lua_rawgeti(L, 3, l_castU2S(b));
+  res = sort_comp(L, -2, -1);
+  lua_pop(L, 2);
+  return res;
+}
+
+
+/* sort 'a[0 .. n - 1]' using 'buff' with room for 'n / 2' indices */
+static void mergesort (lua_State *L, IdxT *a, IdxT n, IdxT *buff) {
+  if (n <= MERGESMALL) {  /* insertion sort */
+    IdxT i, j;
+    for (i = 1; i < n; i++) {
+      IdxT x = a[i];
+      for (j = i; j > 0 && idxless(L, x, a[j - 1]); j--)
+        a[j] = a[j - 1];
+      a[j] = x;
+    }
+  }
+  else {
+    IdxT h = n / 2;
+    mergesort(L, a, h, buff);
+    mergesort(L, a + h, n - h, buff);
+    if (idxless(L, a[h], a[h - 1])) {  /* halves not already in order? */
+      IdxT i = 0, j = h, k = 0;
+      memcpy(buff, a, h * sizeof(IdxT));  /* move left half out */
+      while (i < h && j < n) {  /* ties go to the left half */
+        if (idxless(L, a[j], buff[i])) a[k++] = a[j++];
+        else a[k++] = buff[i++];
+      }
+      while (i < h) a[k++] = buff[i++];  /* rest of the left half */
+    }
+  }
+}
+
+
+static void stablesort (lua_State *L, IdxT n) {
+  IdxT *a;
+  IdxT i;
+  lua_createtable(L, n, 0);  /* copy of the array */
+  for (i = 1; i <= n; i++) {
+    geti(L, 1, i);
+    lua_rawseti(L, 3, l_castU2S(i));
+  }
+  a = (IdxT *)lua_newuserdatauv(L, (n + n / 2) * sizeof(IdxT), 0);
+  for (i = 0; i < n; i++) a[i] = i + 1;
+  mergesort(L, a, n, a + n);
+  for (i = 0; i < n; i++) {
+    lua_rawgeti(L, 3, l_castU2S(a[i]));
+    seti(L, 1, i + 1);
+  }
+  lua_settop(L, 2);
+}
+
+/* }====================================================== */
+
+
 static int sort (lua_State *L) {
+  static const char *const opts[] = {"unstable", "stable", NULL};
   lua_Integer n = aux_getn(L, 1, TAB_RW);
+  int stable = luaL_checkoption(L, 3, "unstable", opts);
   if (n > 1) {  /* non-trivial interval? */
     luaL_argcheck(L, n < INT_MAX, 1, "array too big");
     if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
       luaL_checktype(L, 2, LUA_TFUNCTION);  /* must be a function */
     lua_settop(L, 2);  /* make sure there are two arguments */
-    auxsort(L, 1, (IdxT)n, 0);
+    if (!sortarray(L, (IdxT)n, stable)) {  /* no shortcut? */
+      if (stable)
+        stablesort(L, (IdxT)n);
+      else
+        auxsort(L, 1, (IdxT)n, 0);
+    }
   }
   return 0;
 }
 
-/* }====================================================== */
-
 
 static const luaL_Reg tab_funcs[] = {
   {"concat", tconcat},
@@ -415,6 +1124,7 @@ static const luaL_Reg tab_funcs[] = {
   {"remove", tremove},
   {"move", tmove},
   {"sort", sort},
+  {"vector", tvector},
   {NULL, NULL}
 };
 
@@ -1322,6 +1322,138 @@ static int checkpanic (lua_State *L) {
 }
 
 
+#if defined(LUA_USE_BGSWEEP)
+
+#include <pthread.h>
+
+/*
+** A thread-safe allocator with a limit on the memory in use. As the
+** background thread frees blocks late, allocations near the limit can
+** fail until it does.
+*/
+typedef struct BGAlloc {
+  pthread_mutex_t lock;
+  size_t total;  /* bytes in use */
+  size_t limit;  /* maximum bytes in use */
+} BGAlloc;
+
+
+static void *bg_realloc (void *ud, void *block, size_t oldsize, size_t size) {
+  BGAlloc *a = cast(BGAlloc *, ud);
+  void *res = NULL;
+  if (block == NULL)
+    oldsize = 0;  /* 'oldsize' is a tag */
+  pthread_mutex_lock(&a->lock);
+  if (size == 0) {
+    free(block);
+    a->total -= oldsize;
+  }
+  else if (size <= oldsize || a->total + (size - oldsize) <= a->limit) {
+    res = realloc(block, size);
+    if (res != NULL)
+      a->total = a->total - oldsize + size;
+  }
+  pthread_mutex_unlock(&a->lock);
+  return res;
+}
+
+
+/*
+** Run 'code' in a new state that frees memory in the background, with
+** at most 'limit' more bytes than its libraries use. Returns the result
+** of the code (an error message or nothing) and whether closing the
+** state freed all its memory.
+*/
+static int bgsweep (lua_State *L) {
+  const char *code = luaL_checkstring(L, 1);
+  size_t limit = cast_sizet(luaL_checkinteger(L, 2));
+  BGAlloc a;
+  lua_State *L1;
+  int status;
+  a.total = 0;
+  a.limit = MAX_SIZE;
+  pthread_mutex_init(&a.lock, NULL);
+  L1 = lua_newstate(bg_realloc, &a, 0);
+  if (L1 == NULL) {
+    pthread_mutex_destroy(&a.lock);
+    return luaL_error(L, "cannot create state");
+  }
+  luaL_openlibs(L1);
+  a.limit = a.total + limit;
+  lua_gc(L1, LUA_GCBGSWEEP, 1);
+  status = lua_gc(L1, LUA_GCBGSWEEP, 1);
+  lua_assert(status == 1);  /* thread is running */
+  status = luaL_dostring(L1, code);
+  if (status == LUA_OK)
+    lua_pushnil(L);
+  else
+    lua_pushstring(L, lua_tostring(L1, -1));
+  lua_close(L1);  /* must wait for the thread to free its blocks */
+  pthread_mutex_destroy(&a.lock);
+  lua_pushboolean(L, a.total == 0);
+  return 2;
+}
+
+#endif
+
+
+#if defined(LUA_USE_POSIX)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+** System page holding a collectable object, as a light userdata (which
+** does not keep the object alive).
+*/
+static int slab_pageof (lua_State *L) {
+  size_t ps = cast_sizet(sysconf(_SC_PAGESIZE));
+  size_t a = (size_t)lua_topointer(L, 1);
+  luaL_argcheck(L, a != 0, 1, "collectable object expected");
+  lua_pushlightuserdata(L, cast_voidp(a & ~(ps - 1)));
+  return 1;
+}
+
+
+/*
+** Check whether a system page is still mapped; 'msync' fails for
+** addresses that are not.
+*/
+static int slab_ismapped (lua_State *L) {
+  void *p = lua_touserdata(L, 1);
+  lua_pushboolean(L, msync(p, 1, MS_ASYNC) == 0);
+  return 1;
+}
+
+
+/*
+** Run 'code' in a new state created with the slab allocator, with
+** functions 'pageof' and 'ismapped' to check which pages the allocator
+** keeps. Returns the result of the code (an error message or nothing)
+** and whether the state really uses that allocator.
+*/
+static int slabstate (lua_State *L) {
+  const char *code = luaL_checkstring(L, 1);
+  lua_State *L1 = luaL_newstatex(LUAL_SLABALLOC);
+  int status;
+  if (L1 == NULL)
+    return luaL_error(L, "cannot create state");
+  luaL_openlibs(L1);
+  lua_register(L1, "pageof", slab_pageof);
+  lua_register(L1, "ismapped", slab_ismapped);
+  status = luaL_dostring(L1, code);
+  if (status == LUA_OK)
+    lua_pushnil(L);
+  else
+    lua_pushstring(L, lua_tostring(L1, -1));
+  lua_pushboolean(L, luaL_trimalloc(L1));
+  lua_close(L1);
+  return 2;
+}
+
+#endif
+
+
 static int externKstr (lua_State *L) {
   size_t len;
   const char *s = luaL_checklstring(L, 1, &len);
@@ -1604,6 +1736,9 @@ static int runC (lua_State *L, lua_State *L1, const char *pc) {
     else if EQ("loadfile") {
       luaL_loadfile(L1, luaL_checkstring(L1, getnum));
     }
+    else if EQ("loadmapped") {
+      luaL_loadmapped(L1, luaL_checkstring(L1, getnum), NULL);
+    }
     else if EQ("loadstring") {
       size_t slen;
       const char *s = luaL_checklstring(L1, getnum, &slen);
@@ -2021,6 +2156,9 @@ static const struct luaL_Reg tests_funcs[] = {
   {"listlocals", listlocals},
   {"loadlib", loadlib},
   {"checkpanic", checkpanic},
+#if defined(LUA_USE_BGSWEEP)
+  {"bgsweep", bgsweep},
+#endif
   {"newstate", newstate},
   {"newuserdata", newuserdata},
   {"num2int", num2int},
@@ -2035,6 +2173,9 @@ static const struct luaL_Reg tests_funcs[] = {
   {"resume", coresume},
   {"s2d", s2d},
   {"sethook", sethook},
+#if defined(LUA_USE_POSIX)
+  {"slabstate", slabstate},
+#endif
   {"stacklevel", stacklevel},
   {"testC", testC},
   {"makeCfunc", makeCfunc},
@@ -2069,6 +2210,14 @@ int luaB_opentests (lua_State *L) {
   lua_assert(f == debug_realloc && ud == cast_voidp(&l_memcontrol));
   lua_setallocf(L, f, ud);  /* exercise this function */
   luaL_newlib(L, tests_funcs);
+#if defined(LUA_USE_SWISSHASH)
+  lua_pushboolean(L, 1);
+  lua_setfield(L, -2, "swisshash");  /* hash part keeps load <= 7/8 */
+#endif
+#if defined(LUA_USE_FASTHASH)
+  lua_pushboolean(L, 1);
+  lua_setfield(L, -2, "fasthash");  /* strings have few hash collisions */
+#endif
   return 1;
 }
 
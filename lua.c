@@ -83,7 +83,7 @@ static void laction (int i) {
 
 static void print_usage (const char *badoption) {
   lua_writestringerror("%s: ", progname);
-  if (badoption[1] == 'e' || badoption[1] == 'l')
+  if (badoption[1] == 'e' || badoption[1] == 'l' || badoption[1] == 'p')
     lua_writestringerror("'%s' needs argument\n", badoption);
   else
     lua_writestringerror("unrecognized option '%s'\n", badoption);
@@ -94,6 +94,7 @@ static void print_usage (const char *badoption) {
   "  -i        enter interactive mode after executing 'script'\n"
   "  -l mod    require library 'mod' into global 'mod'\n"
   "  -l g=mod  require library 'mod' into global 'g'\n"
+  "  -p file   profile execution, writing folded stacks to 'file'\n"
   "  -v        show version information\n"
   "  -E        ignore environment variables\n"
   "  -W        turn warnings on\n"
@@ -325,7 +326,8 @@ static int collectargs (char **argv, int *first) {
         break;
       case 'e':
         args |= has_e;  /* FALLTHROUGH */
-      case 'l':  /* both options need an argument */
+      case 'l':  /* these options need an argument */
+      case 'p':
         if (argv[i][2] == '\0') {  /* no concatenated argument? */
           i++;  /* try next 'argv' */
           if (argv[i] == NULL || argv[i][0] == '-')
@@ -342,8 +344,30 @@ static int collectargs (char **argv, int *first) {
 
 
 /*
-** Processes options 'e' and 'l', which involve running Lua code, and
-** 'W', which also affects the state.
+** Option '-p': start the profiler; 'endprofile' writes its results
+** into 'proffile' when the program ends.
+*/
+static const char *proffile = NULL;
+
+static int startprofile (lua_State *L, const char *file) {
+  proffile = file;
+  return dostring(L, "require'" LUA_PROFLIBNAME "'.start()", "=(profiler)");
+}
+
+
+static int endprofile (lua_State *L) {
+  if (luaL_loadstring(L, "local p = require'" LUA_PROFLIBNAME "'; "
+                         "p.stop(); assert(p.dump(...))") != LUA_OK)
+    return lua_error(L);
+  lua_pushstring(L, proffile);
+  lua_call(L, 1, 0);
+  return 0;
+}
+
+
+/*
+** Processes options 'e', 'l', and 'p', which involve running Lua code,
+** and 'W', which also affects the state.
 ** Returns 0 if some code raises an error.
 */
 static int runargs (lua_State *L, char **argv, int n) {
@@ -352,14 +376,17 @@ static int runargs (lua_State *L, char **argv, int n) {
     int option = argv[i][1];
     lua_assert(argv[i][0] == '-');  /* already checked */
     switch (option) {
-      case 'e':  case 'l': {
+      case 'e':  case 'l':  case 'p': {
         int status;
-        char *extra = argv[i] + 2;  /* both options need an argument */
+        char *extra = argv[i] + 2;  /* these options need an argument */
         if (*extra == '\0') extra = argv[++i];
         lua_assert(extra != NULL);
-        status = (option == 'e')
-                 ? dostring(L, extra, "=(command line)")
-                 : dolibrary(L, extra);
+        if (option == 'e')
+          status = dostring(L, extra, "=(command line)");
+        else if (option == 'l')
+          status = dolibrary(L, extra);
+        else
+          status = startprofile(L, extra);
         if (status != LUA_OK) return 0;
         break;
       }
@@ -669,7 +696,7 @@ static void doREPL (lua_State *L) {
 /* }================================================================== */
 
 #if !defined(luai_openlibs)
-#define luai_openlibs(L)	luaL_openselectedlibs(L, ~0, 0)
+#define luai_openlibs(L)	luaL_openlibs(L)
 #endif
 
 
@@ -736,6 +763,10 @@ int main (int argc, char **argv) {
   status = lua_pcall(L, 2, 1, 0);  /* do the call */
   result = lua_toboolean(L, -1);  /* get result */
   report(L, status);
+  if (proffile != NULL) {  /* option '-p'? */
+    lua_pushcfunction(L, &endprofile);
+    report(L, lua_pcall(L, 0, 0, 0));  /* write profile */
+  }
   lua_close(L);
   return (result && status == LUA_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -517,7 +517,8 @@
 @@ LUA_MAXINTEGER is the maximum value for a LUA_INTEGER.
 @@ LUA_MININTEGER is the minimum value for a LUA_INTEGER.
 @@ LUA_MAXUNSIGNED is the maximum value for a LUA_UNSIGNED.
-@@ lua_integer2str converts an integer to a string.
+@@ lua_integer2str converts an integer to a string (only used with
+** LUA_NOFASTN2S or without 'long long').
 */
 
 
@@ -744,6 +745,84 @@
 /* }================================================================== */
 
 
+/*
+** {==================================================================
+** Performance Options
+** =====================================================================
+*/
+
+/*
+@@ LUA_USE_FIELDCACHE turns on per-instruction caches for field
+** accesses with constant keys ('t.x', 't.x = v', and 't:m()'). Each
+** of these instructions remembers the hash slot where it found its
+** key last time, so that accesses to tables with the same layout
+** can skip the search for the key.
+*/
+/* #define LUA_USE_FIELDCACHE */
+
+/*
+@@ LUA_USE_SWISSHASH changes the hash part of tables to open addressing
+** with one control byte per node. Lookups compare the control bytes of
+** a group of 16 nodes at once (with SSE2 or NEON, when available) and
+** only touch the nodes whose bytes match. The hash part keeps a maximum
+** load of 7/8, so it may use more memory than the default layout.
+*/
+/* #define LUA_USE_SWISSHASH */
+
+/*
+@@ LUA_USE_PARALLELMARK allows the collector to use helper threads
+** to mark objects in its atomic phase (the part of a cycle that stops
+** the program). The number of threads is a GC parameter (LUA_GCPWORKERS),
+** zero by default. It needs POSIX threads and the '__atomic' builtins
+** of gcc and clang.
+*/
+/* #define LUA_USE_PARALLELMARK */
+
+/*
+@@ LUA_USE_BGSWEEP allows the collector to free the memory of dead
+** objects in a background thread (see option LUA_GCBGSWEEP in 'lua_gc').
+** It needs POSIX threads and an allocation function that can be called
+** from any thread, as the one used by 'luaL_newstate'.
+*/
+/* #define LUA_USE_BGSWEEP */
+
+/*
+@@ LUA_USE_FASTHASH changes the hash function for strings to one that
+** reads 8 bytes at a time, with two independent lanes, instead of one
+** byte at a time. It is much faster for strings longer than a few
+** bytes and mixes its bits better. It needs 'long long'.
+*/
+/* #define LUA_USE_FASTHASH */
+
+/*
+@@ LUA_USE_CONCATBUF makes concatenations that extend a long string
+** put their results in buffers with room to grow, shared by the
+** strings made by extending the same string again. That makes loops
+** like 's = s .. x' take linear time, instead of quadratic, at the
+** cost of up to 50% more memory for those strings.
+*/
+/* #define LUA_USE_CONCATBUF */
+
+/*
+@@ LUA_NOFASTN2S turns off Lua's own conversions of numbers to strings
+** (used by 'tostring', concatenation, and the like), so that Lua uses
+** 'lua_integer2str' and 'snprintf' with LUA_NUMBER_FMT instead. Lua's
+** conversion of floats, which works only for IEEE doubles, gives the
+** shortest numeral that reads back as the same float.
+*/
+/* #define LUA_NOFASTN2S */
+
+/*
+@@ LUA_NOFASTS2N turns off Lua's own conversion of decimal numerals to
+** floats (used by the lexer, 'tonumber', coercions, and the like), so
+** that Lua uses 'lua_str2number' for all of them. Lua's conversion,
+** which works only for IEEE doubles, rounds correctly, as 'strtod'.
+*/
+/* #define LUA_NOFASTS2N */
+
+/* }================================================================== */
+
+
 /*
 ** {==================================================================
 ** Macros that affect the API and must be stable (that is, must be the
@@ -54,12 +54,17 @@ LUAMOD_API int (luaopen_table) (lua_State *L);
 #define LUA_UTF8LIBK	(LUA_TABLIBK << 1)
 LUAMOD_API int (luaopen_utf8) (lua_State *L);
 
+#define LUA_PROFLIBNAME	"profiler"
+#define LUA_PROFLIBK	(LUA_UTF8LIBK << 1)
+LUAMOD_API int (luaopen_profiler) (lua_State *L);
+
 
 /* open selected libraries */
 LUALIB_API void (luaL_openselectedlibs) (lua_State *L, int load, int preload);
 
-/* open all libraries */
-#define luaL_openlibs(L)	luaL_openselectedlibs(L, ~0, 0)
+/* open all libraries (the profiler is only preloaded) */
+#define luaL_openlibs(L)  \
+	luaL_openselectedlibs(L, ~LUA_PROFLIBK, LUA_PROFLIBK)
 
 
 #endif
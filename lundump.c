@@ -39,6 +39,7 @@ typedef struct {
   size_t offset;  /* current position relative to beginning of dump */
   lua_Integer nstr;  /* number of strings in the list */
   lu_byte fixed;  /* dump is fixed in memory */
+  FixedBuf *fb;  /* owner of fixed buffer (NULL if none) */
 } LoadState;
 
 
@@ -171,7 +172,12 @@ static void loadString (LoadState *S, Proto *p, TString **sl) {
   }
   else if (S->fixed) {  /* for a fixed buffer, use a fixed string */
     const char *s = getaddr(S, size + 1, char);  /* get content address */
-    *sl = ts = luaS_newextlstr(L, s, size, NULL, NULL);
+    if (S->fb == NULL)  /* buffer outlives the state? */
+      *sl = ts = luaS_newextlstr(L, s, size, NULL, NULL);
+    else {  /* string keeps a reference to the buffer */
+      S->fb->nrefs++;
+      *sl = ts = luaS_newextlstr(L, s, size, luaF_releasefixed, S->fb);
+    }
     luaC_objbarrier(L, p, ts);
   }
   else {  /* create internal copy */
@@ -199,6 +205,9 @@ static void loadCode (LoadState *S, Proto *f) {
     f->sizecode = cast_int(n);
     loadVector(S, f->code, n);
   }
+#if defined(LUA_USE_FIELDCACHE)
+  luaF_initfcache(S->L, f);
+#endif
 }
 
 
@@ -331,8 +340,13 @@ static void loadFunction (LoadState *S, Proto *f) {
   f->lastlinedefined = loadInt(S);
   f->numparams = loadByte(S);
   f->flag = loadByte(S) & PF_ISVARARG;  /* get only the meaningful flags */
-  if (S->fixed)
+  if (S->fixed) {
     f->flag |= PF_FIXED;  /* signal that code is fixed */
+    if (S->fb != NULL) {  /* prototype keeps a reference to the buffer */
+      S->fb->nrefs++;
+      f->fixedbuf = S->fb;
+    }
+  }
   f->maxstacksize = loadByte(S);
   loadCode(S, f);
   loadConstants(S, f);
@@ -381,7 +395,8 @@ static void checkHeader (LoadState *S) {
 /*
 ** Load precompiled chunk.
 */
-LClosure *luaU_undump (lua_State *L, ZIO *Z, const char *name, int fixed) {
+LClosure *luaU_undump (lua_State *L, ZIO *Z, const char *name, int fixed,
+                                                               FixedBuf *fb) {
   LoadState S;
   LClosure *cl;
   if (*name == '@' || *name == '=')
@@ -393,6 +408,7 @@ LClosure *luaU_undump (lua_State *L, ZIO *Z, const char *name, int fixed) {
   S.L = L;
   S.Z = Z;
   S.fixed = cast_byte(fixed);
+  S.fb = fb;
   S.offset = 1;  /* fist byte was already read */
   checkHeader(&S);
   cl = luaF_newLclosure(L, loadByte(&S));
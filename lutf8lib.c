@@ -15,6 +15,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "lua.h"
 
 #include "lauxlib.h"
@@ -81,12 +87,177 @@ static const char *utf8_decode (const char *s, l_uint32 *val, int strict) {
 
 
 /*
-** utf8len(s [, i [, j [, lax]]]) --> number of characters that
-** start in the range [i,j], or nil + current position if 's' is not
-** well formed in that interval
+** {======================================================
+** Skipping well-formed text in blocks
+** =======================================================
 */
-static int utflen (lua_State *L) {
-  lua_Integer n = 0;  /* counter for the number of characters */
+
+#if defined(__SSSE3__)
+
+/*
+** Validation of 16 bytes at once after Keiser and Lemire, "Validating
+** UTF-8 In Less Than One Instruction Per Byte" (2021). Each error in a
+** 2-byte window (a byte and its predecessor) sets some bit in all three
+** tables, indexed by the high and low nibbles of the predecessor and
+** by the high nibble of the byte; 3rd and 4th bytes of sequences are
+** checked apart ('must23'). That accepts exactly what 'utf8_decode'
+** accepts in strict mode, which is a subset of the lax mode.
+*/
+
+#define TOOSHORT	0x01  /* lead byte not followed by a continuation */
+#define TOOLONG		0x02  /* continuation after an ASCII byte */
+#define OVERLONG3	0x04
+#define TOOLARGE	0x08  /* code point above MAXUNICODE */
+#define SURROGATE	0x10
+#define OVERLONG2	0x20
+#define TOOLARGE1000	0x40
+#define OVERLONG4	0x40
+#define TWOCONTS	0x80  /* continuation after a continuation */
+#define CARRY		(TOOSHORT | TOOLONG | TWOCONTS)
+
+static const unsigned char byte1high[16] = {
+  TOOLONG, TOOLONG, TOOLONG, TOOLONG,  /* ASCII */
+  TOOLONG, TOOLONG, TOOLONG, TOOLONG,
+  TWOCONTS, TWOCONTS, TWOCONTS, TWOCONTS,  /* continuation */
+  TOOSHORT | OVERLONG2,  /* 1100xxxx */
+  TOOSHORT,  /* 1101xxxx */
+  TOOSHORT | OVERLONG3 | SURROGATE,  /* 1110xxxx */
+  TOOSHORT | TOOLARGE | TOOLARGE1000 | OVERLONG4  /* 1111xxxx */
+};
+
+static const unsigned char byte1low[16] = {
+  CARRY | OVERLONG3 | OVERLONG2 | OVERLONG4,  /* xxxx0000 */
+  CARRY | OVERLONG2,  /* xxxx0001 */
+  CARRY, CARRY,
+  CARRY | TOOLARGE,  /* xxxx0100 */
+  CARRY | TOOLARGE | TOOLARGE1000, CARRY | TOOLARGE | TOOLARGE1000,
+  CARRY | TOOLARGE | TOOLARGE1000, CARRY | TOOLARGE | TOOLARGE1000,
+  CARRY | TOOLARGE | TOOLARGE1000, CARRY | TOOLARGE | TOOLARGE1000,
+  CARRY | TOOLARGE | TOOLARGE1000, CARRY | TOOLARGE | TOOLARGE1000,
+  CARRY | TOOLARGE | TOOLARGE1000 | SURROGATE,  /* xxxx1101 */
+  CARRY | TOOLARGE | TOOLARGE1000, CARRY | TOOLARGE | TOOLARGE1000
+};
+
+static const unsigned char byte2high[16] = {
+  TOOSHORT, TOOSHORT, TOOSHORT, TOOSHORT,  /* ASCII */
+  TOOSHORT, TOOSHORT, TOOSHORT, TOOSHORT,
+  TOOLONG | OVERLONG2 | TWOCONTS | OVERLONG3 | TOOLARGE1000 | OVERLONG4,
+  TOOLONG | OVERLONG2 | TWOCONTS | OVERLONG3 | TOOLARGE,  /* 1001xxxx */
+  TOOLONG | OVERLONG2 | TWOCONTS | SURROGATE | TOOLARGE,  /* 101xxxxx */
+  TOOLONG | OVERLONG2 | TWOCONTS | SURROGATE | TOOLARGE,
+  TOOSHORT, TOOSHORT, TOOSHORT, TOOSHORT  /* lead bytes */
+};
+
+#define lookup(t,x)  \
+  _mm_shuffle_epi8(t, _mm_and_si128(x, _mm_set1_epi8(0x0F)))
+#define highnibble(x)	_mm_srli_epi16(x, 4)
+
+#if defined(__GNUC__)
+#define popcount(m)	__builtin_popcount(m)
+#else
+static int popcount (unsigned m) {
+  int n = 0;
+  for (; m != 0; m &= m - 1u) n++;
+  return n;
+}
+#endif
+
+
+/* true iff block 'in', preceded by block 'prev', has no errors */
+static int validblock (__m128i in, __m128i prev) {
+  const __m128i t1h = _mm_loadu_si128((const __m128i *)byte1high);
+  const __m128i t1l = _mm_loadu_si128((const __m128i *)byte1low);
+  const __m128i t2h = _mm_loadu_si128((const __m128i *)byte2high);
+  __m128i prev1 = _mm_alignr_epi8(in, prev, 15);
+  __m128i prev2 = _mm_alignr_epi8(in, prev, 14);
+  __m128i prev3 = _mm_alignr_epi8(in, prev, 13);
+  __m128i sc = _mm_and_si128(_mm_and_si128(
+                   lookup(t1h, highnibble(prev1)), lookup(t1l, prev1)),
+                   lookup(t2h, highnibble(in)));
+  __m128i must23 = _mm_or_si128(  /* 3rd or 4th byte of a sequence? */
+                       _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80)),
+                       _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80)));
+  __m128i err = _mm_xor_si128(sc,
+                  _mm_and_si128(must23, _mm_set1_epi8(cast_char(0x80))));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(err, _mm_setzero_si128()))
+         == 0xFFFF;
+}
+
+
+/*
+** Skip a prefix of 's[i..j-1]', starting at a character, made only of
+** complete and well-formed characters, adding their number to '*n'.
+** Returns where the prefix ends, which is the start of a character;
+** from there, the caller decodes one character by itself.
+*/
+static lua_Integer skipvalid (const char *s, lua_Integer i, lua_Integer j,
+                              lua_Integer *n) {
+  const lua_Integer i0 = i;
+  __m128i prev = _mm_setzero_si128();  /* as if preceded by ASCII */
+  for (; j - i >= 16; i += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(s + i));
+    if (_mm_movemask_epi8(_mm_or_si128(in, prev)) == 0)  /* all ASCII? */
+      *n += 16;
+    else if (validblock(in, prev))  /* count non-continuation bytes */
+      *n += popcount(cast_uint(_mm_movemask_epi8(
+                       _mm_cmpgt_epi8(in, _mm_set1_epi8(-65)))));
+    else break;  /* some error; let the caller find it */
+    prev = in;
+  }
+  if (i > i0) {  /* last character may continue after 'i' */
+    lua_Integer r = i - 1;
+    while (r > i0 && iscontp(s + r)) r--;  /* go to its first byte */
+    if ((unsigned char)s[r] >= 0x80) {  /* not ASCII? */
+      (*n)--;  /* let the caller decode it */
+      i = r;
+    }
+  }
+  return i;
+}
+
+#elif defined(__SSE2__)
+
+/* Skip ASCII text, 16 bytes at once */
+static lua_Integer skipvalid (const char *s, lua_Integer i, lua_Integer j,
+                              lua_Integer *n) {
+  for (; j - i >= 16; i += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(s + i));
+    if (_mm_movemask_epi8(in) != 0)  /* some non-ASCII byte? */
+      break;
+    *n += 16;
+  }
+  return i;
+}
+
+#else
+
+/* Skip ASCII text, a word at a time */
+static lua_Integer skipvalid (const char *s, lua_Integer i, lua_Integer j,
+                              lua_Integer *n) {
+  const size_t high = (~(size_t)0 / 0xFF) * 0x80;  /* 0x80 in each byte */
+  const lua_Integer ws = (lua_Integer)sizeof(size_t);
+  for (; j - i >= ws; i += ws) {
+    size_t w;
+    memcpy(&w, s + i, sizeof(w));
+    if (w & high)  /* some non-ASCII byte? */
+      break;
+    *n += ws;
+  }
+  return i;
+}
+
+#endif
+
+/* }====================================================== */
+
+
+/*
+** Count the characters that start in the range [i,j] of the string at
+** index 1, as given by the arguments to 'utf8.len', putting the result
+** in '*n'. Returns the position of the first invalid byte, or 0 if
+** all are well formed.
+*/
+static lua_Integer utfcount (lua_State *L, lua_Integer *n) {
   size_t len;  /* string length in bytes */
   const char *s = luaL_checklstring(L, 1, &len);
   lua_Integer posi = u_posrelat(luaL_optinteger(L, 2, 1), len);
@@ -96,21 +267,57 @@ static int utflen (lua_State *L) {
                    "initial position out of bounds");
   luaL_argcheck(L, --posj < (lua_Integer)len, 3,
                    "final position out of bounds");
+  *n = 0;
   while (posi <= posj) {
-    const char *s1 = utf8_decode(s + posi, NULL, !lax);
-    if (s1 == NULL) {  /* conversion error? */
-      luaL_pushfail(L);  /* return fail ... */
-      lua_pushinteger(L, posi + 1);  /* ... and current position */
-      return 2;
-    }
+    const char *s1;
+    posi = skipvalid(s, posi, posj + 1, n);
+    if (posi > posj)
+      break;
+    s1 = utf8_decode(s + posi, NULL, !lax);
+    if (s1 == NULL)  /* conversion error? */
+      return posi + 1;  /* current position */
     posi = ct_diff2S(s1 - s);
-    n++;
+    (*n)++;
+  }
+  return 0;
+}
+
+
+/*
+** utf8len(s [, i [, j [, lax]]]) --> number of characters that
+** start in the range [i,j], or nil + current position if 's' is not
+** well formed in that interval
+*/
+static int utflen (lua_State *L) {
+  lua_Integer n;  /* counter for the number of characters */
+  lua_Integer pos = utfcount(L, &n);
+  if (pos != 0) {  /* conversion error? */
+    luaL_pushfail(L);  /* return fail ... */
+    lua_pushinteger(L, pos);  /* ... and current position */
+    return 2;
   }
   lua_pushinteger(L, n);
   return 1;
 }
 
 
+/*
+** utf8valid(s [, i [, j [, lax]]]) --> true if all characters that
+** start in the range [i,j] are well formed, or false + position of
+** the first invalid byte
+*/
+static int utfvalid (lua_State *L) {
+  lua_Integer n;
+  lua_Integer pos = utfcount(L, &n);
+  lua_pushboolean(L, pos == 0);
+  if (pos != 0) {
+    lua_pushinteger(L, pos);
+    return 2;
+  }
+  return 1;
+}
+
+
 /*
 ** codepoint(s, [i, [j [, lax]]]) -> returns codepoints for all
 ** characters that start in the range [i,j]
@@ -275,6 +482,7 @@ static const luaL_Reg funcs[] = {
   {"codepoint", codepoint},
   {"char", utfchar},
   {"len", utflen},
+  {"valid", utfvalid},
   {"codes", iter_codes},
   /* placeholders */
   {"charpattern", NULL},
@@ -86,7 +86,9 @@
 ** If the value is not a string or is a string not representing
 ** a valid numeral (or if coercions from strings to numbers
 ** are disabled via macro 'cvt2num'), do not modify 'result'
-** and return 0.
+** and return 0. A string in a concatenation buffer may lack its
+** ending '\0'; as this function cannot allocate memory, it puts one
+** there during the conversion.
 */
 static int l_strton (const TValue *obj, TValue *result) {
   lua_assert(obj != result);
@@ -95,7 +97,15 @@ static int l_strton (const TValue *obj, TValue *result) {
   else {
     TString *st = tsvalue(obj);
     size_t stlen;
-    const char *s = getlstr(st, stlen);
+    char *s = getlstr(st, stlen);
+    if (l_unlikely(luaS_noend(st))) {
+      char c = s[stlen];
+      int res;
+      s[stlen] = '\0';
+      res = (luaO_str2num(s, result) == stlen + 1);
+      s[stlen] = c;  /* restore following byte */
+      return res;
+    }
     return (luaO_str2num(s, result) == stlen + 1);
   }
 }
@@ -333,7 +343,10 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
     const TValue *tm;  /* '__newindex' metamethod */
     if (hres != HNOTATABLE) {  /* is 't' a table? */
       Table *h = hvalue(t);  /* save 't' table */
-      tm = fasttm(L, h->metatable, TM_NEWINDEX);  /* get metamethod */
+      if (hres == HVECTOR)  /* key is present? */
+        tm = NULL;  /* no metamethod */
+      else
+        tm = fasttm(L, h->metatable, TM_NEWINDEX);  /* get metamethod */
       if (tm == NULL) {  /* no metamethod? */
         luaH_finishset(L, h, key, val, hres);  /* set new value */
         invalidateTMcache(h);
@@ -370,11 +383,15 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
 ** of the strings. Note that segments can compare equal but still
 ** have different lengths.
 */
-static int l_strcmp (const TString *ts1, const TString *ts2) {
+static int l_strcmp (lua_State *L, TString *ts1, TString *ts2) {
   size_t rl1;  /* real length */
-  const char *s1 = getlstr(ts1, rl1);
+  const char *s1;
   size_t rl2;
-  const char *s2 = getlstr(ts2, rl2);
+  const char *s2;
+  luaS_seal(L, ts1);  /* 'strcoll' needs the ending zeros */
+  luaS_seal(L, ts2);
+  s1 = getlstr(ts1, rl1);
+  s2 = getlstr(ts2, rl2);
   for (;;) {  /* for each segment */
     int temp = strcoll(s1, s2);
     if (temp != 0)  /* not equal? */
@@ -519,7 +536,7 @@ l_sinline int LEnum (const TValue *l, const TValue *r) {
 static int lessthanothers (lua_State *L, const TValue *l, const TValue *r) {
   lua_assert(!ttisnumber(l) || !ttisnumber(r));
   if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) < 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) < 0;
   else
     return luaT_callorderTM(L, l, r, TM_LT);
 }
@@ -541,7 +558,7 @@ int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
 static int lessequalothers (lua_State *L, const TValue *l, const TValue *r) {
   lua_assert(!ttisnumber(l) || !ttisnumber(r));
   if (ttisstring(l) && ttisstring(r))  /* both are strings? */
-    return l_strcmp(tsvalue(l), tsvalue(r)) <= 0;
+    return l_strcmp(L, tsvalue(l), tsvalue(r)) <= 0;
   else
     return luaT_callorderTM(L, l, r, TM_LE);
 }
@@ -668,6 +685,13 @@ void luaV_concat (lua_State *L, int total) {
         copy2buff(top, n, buff);  /* copy strings to buffer */
         ts = luaS_newlstr(L, buff, tl);
       }
+#if defined(LUA_USE_CONCATBUF)
+      else if (!ttisshrstring(s2v(top - n))) {  /* extending a long string? */
+        TString *a = tsvalue(s2v(top - n));
+        ts = luaS_extend(L, a, tl);  /* result starts with 'a' */
+        copy2buff(top, n - 1, getlngstr(ts) + a->u.lnglen);
+      }
+#endif
       else {  /* long string; copy strings directly to final result */
         ts = luaS_createlngstrobj(L, tl);
         copy2buff(top, n, getlngstr(ts));
@@ -1138,6 +1162,30 @@ void luaV_finishOp (lua_State *L) {
            luai_threadyield(L); }
 
 
+/*
+** Get/set a field with a constant short-string key, using the field
+** cache of the current instruction when available.
+*/
+#if defined(LUA_USE_FIELDCACHE)
+
+#define fchint()	(&cl->p->fcache[pcRel(pc, cl->p)])
+
+#define fcgetfield(t,k,res,tag)  \
+  (tag = (!ttistable(t) ? LUA_VNOTABLE \
+                        : luaH_getshortstrc(L, hvalue(t), k, res, fchint())))
+
+#define fcsetfield(t,k,val,hres)  \
+  (hres = (!ttistable(t) ? HNOTATABLE \
+                         : luaH_psetshortstrc(L, hvalue(t), k, val, fchint())))
+
+#else
+
+#define fcgetfield(t,k,res,tag)	luaV_fastget(t,k,res,luaH_getshortstr,tag)
+#define fcsetfield(t,k,val,hres)	luaV_fastset(t,k,val,hres,luaH_psetshortstr)
+
+#endif
+
+
 /* fetch an instruction and prepare its execution */
 #define vmfetch()	{ \
   if (l_unlikely(trap)) {  /* stack reallocation or hooks? */ \
@@ -1294,7 +1342,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = KC(i);
         TString *key = tsvalue(rc);  /* key must be a short string */
         lu_byte tag;
-        luaV_fastget(rb, key, s2v(ra), luaH_getshortstr, tag);
+        fcgetfield(rb, key, s2v(ra), tag);
         if (tagisempty(tag))
           Protect(luaV_finishget(L, rb, rc, ra, tag));
         vmbreak;
@@ -1350,7 +1398,7 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rb = KB(i);
         TValue *rc = RKC(i);
         TString *key = tsvalue(rb);  /* key must be a short string */
-        luaV_fastset(s2v(ra), key, rc, hres, luaH_psetshortstr);
+        fcsetfield(s2v(ra), key, rc, hres);
         if (hres == HOK)
           luaV_finishfastset(L, s2v(ra), rc);
         else
@@ -1385,6 +1433,11 @@ void luaV_execute (lua_State *L, CallInfo *ci) {
         TValue *rc = RKC(i);
         TString *key = tsvalue(rc);  /* key must be a string */
         setobj2s(L, ra + 1, rb);
+#if defined(LUA_USE_FIELDCACHE)
+        if (key->tt == LUA_VSHRSTR)
+          fcgetfield(rb, key, s2v(ra), tag);
+        else
+#endif
         luaV_fastget(rb, key, s2v(ra), luaH_getstr, tag);
         if (tagisempty(tag))
           Protect(luaV_finishget(L, rb, rc, ra, tag));
@@ -107,6 +107,7 @@
 #include "lstrlib.c"
 #include "ltablib.c"
 #include "lutf8lib.c"
+#include "lproflib.c"
 #include "linit.c"
 #endif
 
@@ -585,6 +585,48 @@ do
 end
 
 
+do
+  print("testing load of mapped binaries")
+  local fname = os.tmpname()
+  local long = string.rep("x", 100)
+  local function write (s)
+    local f = assert(io.open(fname, "wb")); f:write(s); f:close()
+  end
+  write(string.dump(load(string.format([[
+    local a = ...
+    return function () return a .. '%s' end, '%s'
+  ]], long, long), "=mapped")))
+  local f = T.testC("loadmapped 2; return 1", fname)
+  assert(os.remove(fname))   -- mapping outlives the file name
+  local g, s = f("y")
+  f = nil
+  collectgarbage(); collectgarbage()
+  -- inner prototype and string keep the buffer alive
+  assert(g() == "y" .. long and s == long)
+  g = nil
+  collectgarbage(); collectgarbage()
+  assert(s == long)
+  s = nil
+  collectgarbage()
+
+  -- stripped binary with errors
+  write(string.dump(load("local x = {} .. 1", "=mapped"), true))
+  f = T.testC("loadmapped 2; return 1", fname)
+  checkerr("concatenate", f)
+  -- text files are loaded as usual
+  write("return 10, ...")
+  f = T.testC("loadmapped 2; return 1", fname)
+  assert(select(2, f(20)) == 20)
+  write("")   -- empty file
+  f = T.testC("loadmapped 2; return 1", fname)
+  assert(f() == nil)
+  write(string.sub(string.dump(load("return 1")), 1, 20))  -- truncated
+  check3("truncated", T.testC("loadmapped 2; return *", fname))
+  assert(os.remove(fname))
+  check3("cannot open", T.testC("loadmapped 2; return *", fname))
+end
+
+
 if not _soft then
   collectgarbage("stop")   -- avoid __gc with full stack
   checkerrnopro("pushnum 3; call 0 0", "attempt to call")
@@ -225,6 +225,62 @@ assert(require"P1" == m and m.AA == 10)
 removefiles(files)
 AA = nil
 
+
+do  print("testing bytecode cache")
+  local cdir = string.sub(DIR, 1, -2)
+  -- name of the cache file for a given module path (FNV-1a hash)
+  local function cname (path)
+    local h = 2166136261
+    for i = 1, #path do
+      h = ((h ~ string.byte(path, i)) * 16777619) & 0xffffffff
+    end
+    return string.format("%s%08x.luac", DIR, h)
+  end
+  package.path = D"?.lua"
+  package.bytecodecache = cdir
+  local files = {["bc.lua"] = "local n = ...\nreturn function () error(n) end\n"}
+  createfiles(files, "", "")
+  local h0, m0 = package.bytecodestats()
+  for i = 1, 3 do
+    package.loaded.bc = nil
+    local f = require"bc"
+    local st, msg = pcall(f)   -- debug information is kept
+    assert(not st and string.find(msg, "bc.lua:2: bc"))
+  end
+  local h, m = package.bytecodestats()
+  assert(h == h0 + 2 and m == m0 + 1)
+  assert(io.open(cname(D"bc.lua")), "no cache file")
+  -- a changed source invalidates the entry
+  createfiles(files, "", "-- changed\n")
+  package.loaded.bc = nil
+  assert(type(require"bc") == "function")
+  h, m = package.bytecodestats()
+  assert(h == h0 + 2 and m == m0 + 2)
+  -- a corrupted entry is not used
+  local f = io.open(cname(D"bc.lua"), "rb")
+  local s = f:read("a"); f:close()
+  f = io.open(cname(D"bc.lua"), "wb")
+  f:write(string.sub(s, 1, -20)); f:close()   -- truncate dump
+  package.loaded.bc = nil
+  assert(type(require"bc") == "function")
+  h, m = package.bytecodestats()
+  assert(h == h0 + 2 and m == m0 + 3)
+  package.loaded.bc = nil
+  assert(type(require"bc") == "function")
+  h, m = package.bytecodestats()
+  assert(h == h0 + 3 and m == m0 + 3)
+  -- errors are reported as usual
+  files["bc.lua"] = "x ="
+  createfiles(files, "", "")
+  package.loaded.bc = nil
+  local st, msg = pcall(require, "bc")
+  assert(not st and string.find(msg, "error loading module"))
+  assert(os.remove(cname(D"bc.lua")))
+  removefiles(files)
+  package.loaded.bc = nil
+  package.bytecodecache = nil
+end
+
 package.path = ""
 assert(not pcall(require, "file_does_not_exist"))
 package.path = "??\0?"
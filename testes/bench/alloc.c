@@ -0,0 +1,66 @@
+/*
+** $Id: testes/bench/alloc.c $
+** Allocation throughput and memory use of the slab allocator
+** ('luaL_newstatex(LUAL_SLABALLOC)') versus the default allocator.
+** See Copyright Notice in file lua.h
+**
+** Build (from this directory, after building Lua):
+**   cc -O2 -I../.. alloc.c ../../liblua.a -lm -ldl -o alloc
+** Run each allocator in its own process, so that their peak RSS can
+** be compared:
+**   ./alloc default; ./alloc slab
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+/* churn of small objects: tables, closures, upvalues, short strings */
+static const char workload[] =
+  "local N = 200000\n"
+  "local keep = {}\n"
+  "for r = 1, 20 do\n"
+  "  for i = 1, N do\n"
+  "    local x = i\n"
+  "    local t = {x, tostring(i), f = function () return x end}\n"
+  "    keep[i % 5000 + 1] = t\n"
+  "  end\n"
+  "end\n";
+
+
+static long rsskb (void) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;  /* in Kbytes on Linux */
+}
+
+
+int main (int argc, char **argv) {
+  int slab = (argc > 1 && strcmp(argv[1], "slab") == 0);
+  lua_State *L = luaL_newstatex(slab ? LUAL_SLABALLOC : 0);
+  clock_t t0;
+  double dt;
+  if (L == NULL) {
+    fprintf(stderr, "cannot create state\n");
+    return 1;
+  }
+  luaL_openlibs(L);
+  t0 = clock();
+  if (luaL_dostring(L, workload) != LUA_OK) {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    return 1;
+  }
+  dt = (double)(clock() - t0) / CLOCKS_PER_SEC;
+  printf("%-8s time %6.3f s   peak RSS %6ld KB   heap %6d KB",
+         slab ? "slab" : "default", dt, rsskb(), lua_gc(L, LUA_GCCOUNT));
+  lua_gc(L, LUA_GCCOLLECT);
+  printf("   after collect %6d KB\n", lua_gc(L, LUA_GCCOUNT));
+  lua_close(L);
+  return 0;
+}
@@ -0,0 +1,65 @@
+-- $Id: testes/bench/append.lua $
+-- See Copyright Notice in file all.lua
+
+-- Time of building arrays by appending: with 't[#t + 1] = v', with
+-- 't[i] = v', with 'table.insert', on tables that also have fields
+-- in the hash part, and with constructors ('OP_SETLIST').
+-- Usage: lua append.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 1000000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+
+local function bench (name, f)
+  local best = math.huge
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    f()
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-28s %8.3f s", name, best))
+end
+
+bench("t[#t + 1] = v", function ()
+  for _ = 1, 10 do
+    local t = {}
+    for i = 1, N do t[#t + 1] = i end
+  end
+end)
+
+bench("t[i] = v", function ()
+  for _ = 1, 10 do
+    local t = {}
+    for i = 1, N do t[i] = i end
+  end
+end)
+
+bench("table.insert(t, v)", function ()
+  local insert = table.insert
+  for _ = 1, 10 do
+    local t = {}
+    for i = 1, N do insert(t, i) end
+  end
+end)
+
+bench("t[i] = v (with fields)", function ()
+  for _ = 1, 10 do
+    local t = {a = 1, b = 2, c = 3, d = 4, e = 5, f = 6, g = 7}
+    for i = 1, N do t[i] = i end
+  end
+end)
+
+bench("small arrays (8)", function ()
+  for _ = 1, N // 8 do
+    local t = {}
+    for i = 1, 8 do t[i] = i end
+  end
+end)
+
+bench("constructors {...}", function ()
+  local function f (...) return {...} end
+  for _ = 1, N // 10 do f(1, 2, 3, 4, 5, 6, 7, 8, 9, 10) end
+end)
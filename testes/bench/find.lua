@@ -0,0 +1,87 @@
+-- $Id: testes/bench/find.lua $
+-- See Copyright Notice in file all.lua
+
+-- Throughput of plain substring search ('string.find' with plain
+-- mode, and literal patterns in 'find', 'gsub', and 'gmatch') over
+-- realistic and adversarial subjects.
+-- Usage: lua find.lua [size in MB] [rounds]
+
+local MB = tonumber(arg and arg[1]) or 8
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+local find, gsub, gmatch, rep = string.find, string.gsub, string.gmatch,
+                                string.rep
+
+local N = math.floor(MB * 2^20)
+
+-- log lines: mostly ASCII text with spaces, quotes, and digits
+local lines = {}
+local len = 0
+local i = 0
+while len < N do
+  i = i + 1
+  local l = string.format(
+    '2024-05-%02d 12:%02d:%02d INFO [worker-%d] {"user": "u%d", ' ..
+    '"path": "/api/v1/items/%d", "status": %d, "ms": %d}\n',
+    i % 28 + 1, i % 60, i % 59, i % 16, i * 7 % 1000, i % 5000,
+    (i % 97 == 0) and 500 or 200, i % 300)
+  lines[#lines + 1] = l
+  len = len + #l
+end
+local logs = table.concat(lines)
+lines = nil
+
+local function bench (name, s, f)
+  local best = math.huge
+  local res
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    res = f()
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-24s %8.4f s  %8.1f MB/s  (%s)", name, best,
+                      #s / best / 2^20, tostring(res)))
+end
+
+-- count all (non-overlapping) occurrences of 'p' in 's'
+local function count (s, p)
+  local n, init = 0, 1
+  while true do
+    local _, e = find(s, p, init, true)
+    if not e then return n end
+    n = n + 1
+    init = e + 1
+  end
+end
+
+print("-- realistic subject (" .. #logs .. " bytes of log lines)")
+bench("absent, 4 bytes", logs, function () return count(logs, "WARN") end)
+bench("rare, 10 bytes", logs, function ()
+  return count(logs, '"status": 500') end)
+bench("common, 2 bytes", logs, function () return count(logs, '"u') end)
+bench("absent, 48 bytes", logs, function ()
+  return count(logs, '"path": "/api/v2/items/1234", "status": 404, "ms"') end)
+bench("gsub literal", logs, function ()
+  return select(2, gsub(logs, "INFO", "info")) end)
+bench("gmatch literal", logs, function ()
+  local n = 0
+  for _ in gmatch(logs, "\"ms\": 7") do n = n + 1 end
+  return n
+end)
+
+local adv = rep("a", N)
+print("-- adversarial subject (" .. #adv .. " bytes of 'a')")
+bench("a^15 b", adv, function () return count(adv, rep("a", 15) .. "b") end)
+bench("b a^15", adv, function () return count(adv, "b" .. rep("a", 15)) end)
+bench("a^100 b", adv, function () return count(adv, rep("a", 100) .. "b") end)
+bench("a^50 b a^50", adv, function ()
+  return count(adv, rep("a", 50) .. "b" .. rep("a", 50)) end)
+
+local per = rep("ab", N // 2)
+print("-- periodic subject (" .. #per .. " bytes of 'ab')")
+bench("(ab)^20 c", per, function ()
+  return count(per, rep("ab", 20) .. "c") end)
+bench("(ab)^8 b", per, function () return count(per, rep("ab", 8) .. "b") end)
@@ -0,0 +1,52 @@
+-- $Id: testes/bench/hash.lua $
+-- See Copyright Notice in file all.lua
+
+-- Throughput of the hash part of tables: insert, lookup, miss, and
+-- iterate over tables with string keys. Compare builds with and
+-- without LUA_USE_SWISSHASH. Usage: lua hash.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 1000000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+
+local keys, miss = {}, {}
+for i = 1, N do
+  keys[i] = "k" .. i
+  miss[i] = "m" .. i
+end
+
+local function bench (name, f)
+  local best = math.huge
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    f()
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-8s %8.3f s  %10.1f Mop/s", name, best,
+                      N / best / 1e6))
+end
+
+local t
+bench("insert", function ()
+  t = {}
+  for i = 1, N do t[keys[i]] = i end
+end)
+
+bench("lookup", function ()
+  local s = 0
+  for i = 1, N do s = s + t[keys[i]] end
+  assert(s == N * (N + 1) // 2)
+end)
+
+bench("miss", function ()
+  for i = 1, N do assert(t[miss[i]] == nil) end
+end)
+
+bench("iterate", function ()
+  local n = 0
+  for _ in pairs(t) do n = n + 1 end
+  assert(n == N)
+end)
@@ -0,0 +1,43 @@
+-- $Id: testes/bench/num2str.lua $
+-- See Copyright Notice in file all.lua
+
+-- Throughput of conversions of numbers to strings, as in a JSON
+-- encoder: 'tostring' against 'string.format', which always uses
+-- 'snprintf'. Compare builds with and without LUA_NOFASTN2S.
+-- Usage: lua num2str.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 1000000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+local format, tostring = string.format, tostring
+
+math.randomseed(42)
+local floats, prices, ints = {}, {}, {}
+for i = 1, N do
+  floats[i] = math.random() * 10.0^math.random(-10, 10)
+  prices[i] = math.random(0, 100000) / 100
+  ints[i] = math.random(-1000000000, 1000000000)
+end
+
+local function bench (name, t, f)
+  local best = math.huge
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    for i = 1, N do f(t[i]) end
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-16s %8.3f s  %8.2f M/s", name, best, N / best / 1e6))
+end
+
+local function g17 (x) return format("%.17g", x) end
+local function d (x) return format("%d", x) end
+
+bench("floats tostring", floats, tostring)
+bench("floats %.17g", floats, g17)
+bench("prices tostring", prices, tostring)
+bench("prices %.17g", prices, g17)
+bench("ints tostring", ints, tostring)
+bench("ints %d", ints, d)
@@ -0,0 +1,101 @@
+-- $Id: testes/bench/patterns.lua $
+-- See Copyright Notice in file all.lua
+
+-- Throughput of 'match', 'gmatch', 'gsub', and 'find' with the same
+-- few patterns applied over and over to log lines, as in a log parser,
+-- plus patterns that backtrack a lot.
+-- Usage: lua patterns.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 200000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+local match, gmatch, gsub, find = string.match, string.gmatch,
+                                  string.gsub, string.find
+
+local lines = {}
+for i = 1, N do
+  lines[i] = string.format(
+    '2024-05-%02d 12:%02d:%02d INFO [worker-%d] user=u%d ' ..
+    'path=/api/v1/items/%d status=%d ms=%d',
+    i % 28 + 1, i % 60, i % 59, i % 16, i * 7 % 1000, i % 5000,
+    (i % 97 == 0) and 500 or 200, i % 300)
+end
+
+local function bench (name, f, n)
+  n = n or N
+  local best = math.huge
+  local res
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    res = f()
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-12s %8.3f s  %8.2f M lines/s  (%s)", name, best,
+                      n / best / 1e6, tostring(res)))
+end
+
+bench("match", function ()
+  local c = 0
+  for i = 1, N do
+    local d, lvl, w = match(lines[i],
+                            "^(%d+%-%d+%-%d+) %S+ (%u+) %[([%w_%-]+)%]")
+    if lvl == "INFO" then c = c + 1 end
+  end
+  return c
+end)
+
+bench("match-key", function ()
+  local c = 0
+  for i = 1, N do
+    local st = match(lines[i], "status=(%d+)")
+    if st == "500" then c = c + 1 end
+  end
+  return c
+end)
+
+bench("gmatch", function ()
+  local c = 0
+  for i = 1, N do
+    for k, v in gmatch(lines[i], "(%w+)=([^%s]+)") do c = c + 1 end
+  end
+  return c
+end)
+
+bench("gsub", function ()
+  local c = 0
+  for i = 1, N do
+    local _, n = gsub(lines[i], "%d+", "#")
+    c = c + n
+  end
+  return c
+end)
+
+bench("find", function ()
+  local c = 0
+  for i = 1, N do
+    if find(lines[i], "ms=%d%d%d?$") then c = c + 1 end
+  end
+  return c
+end)
+
+bench("split", function ()   -- lazy fields: backtracks on every field
+  local c = 0
+  for i = 1, N do
+    local a, b, rest = match(lines[i], "^(.-) (.-) (.*)$")
+    c = c + #rest
+  end
+  return c
+end)
+
+local M = N // 1000
+bench("adversarial", function ()   -- polynomial blowup for backtracking
+  local c = 0
+  local s = string.rep("x", 200)
+  for i = 1, M do
+    if not find(s, ".-.-y") then c = c + 1 end
+  end
+  return c
+end, M)
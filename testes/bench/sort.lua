@@ -0,0 +1,81 @@
+-- $Id: testes/bench/sort.lua $
+-- See Copyright Notice in file all.lua
+
+-- Time of 'table.sort' on arrays of integers, floats, and strings,
+-- with several input patterns, for sizes from 1K up to N elements:
+-- with no order function (which uses the specialized sorts), with
+-- an order function (the generic quicksort), and in stable mode
+-- with an order function (the merge sort).
+-- Usage: lua sort.lua [N] [rounds]      (e.g., N = 10000000)
+
+local N = math.tointeger(arg and arg[1]) or 1000000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+local random = math.random
+
+math.randomseed(42)
+
+local patterns = {
+  random = function (i, n) return random(n) end,
+  sorted = function (i, n) return i end,
+  reversed = function (i, n) return n - i end,
+  ["few unique"] = function (i, n) return random(16) end,
+  sawtooth = function (i, n) return i % 1000 end,
+  ["organ pipe"] = function (i, n) return (i < n // 2) and i or n - i end,
+}
+
+local kinds = {
+  int = function (x) return x end,
+  float = function (x) return x / 7 end,
+  string = function (x) return string.format("key%09d", x) end,
+}
+
+local function lt (a, b) return a < b end
+
+local modes = {
+  {"", table.sort},
+  {"(lt)", function (t) table.sort(t, lt) end},
+  {"(lt, stable)", function (t) table.sort(t, lt, "stable") end},
+}
+
+-- best time per element, in nanoseconds; small arrays are sorted
+-- several times in each round, to get measurable times
+local function bench (n, base, f)
+  local reps = math.max(1, 100000 // n)
+  local best = math.huge
+  for _ = 1, R do
+    local ts = {}
+    for j = 1, reps do ts[j] = table.move(base, 1, n, 1, table.create(n)) end
+    collectgarbage()
+    local t0 = clock()
+    for j = 1, reps do f(ts[j]) end
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  return best / (reps * n) * 1e9
+end
+
+local sizes = {}
+local n = 1000
+while n <= N do sizes[#sizes + 1] = n; n = n * 10 end
+
+io.write(string.format("%-32s", "ns per element"))
+for _, n in ipairs(sizes) do io.write(string.format("%9d", n)) end
+print()
+
+for _, k in ipairs{"int", "float", "string"} do
+  for _, p in ipairs{"random", "sorted", "reversed", "few unique",
+                     "sawtooth", "organ pipe"} do
+    for _, m in ipairs(modes) do
+      io.write(string.format("%-32s", k .. " " .. p .. " " .. m[1]))
+      for _, n in ipairs(sizes) do
+        local base = {}
+        for i = 1, n do base[i] = kinds[k](patterns[p](i, n)) end
+        io.write(string.format("%9.1f", bench(n, base, m[2])))
+        io.flush()
+      end
+      print()
+    end
+  end
+end
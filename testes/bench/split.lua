@@ -0,0 +1,66 @@
+-- $Id: testes/bench/split.lua $
+-- See Copyright Notice in file all.lua
+
+-- Throughput of splitting CSV text into lines and fields, with
+-- 'gmatch' and with 'split'/'iterlines'.
+-- Usage: lua split.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 200000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+local gmatch, split, iterlines, sub = string.gmatch, string.split,
+                                      string.iterlines, string.sub
+
+local t = {}
+for i = 1, N do
+  t[i] = string.format("%d,customer%d,%s,%d.%02d,,%s", i, i % 1000,
+                       (i % 3 == 0) and "active" or "closed",
+                       i % 5000, i % 100, string.rep("z", i % 20))
+end
+local doc = table.concat(t, "\n") .. "\n"
+t = nil
+
+local function bench (name, f)
+  local best = math.huge
+  local res
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    res = f()
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-16s %8.3f s  %8.2f M lines/s  (%s)", name, best,
+                      N / best / 1e6, tostring(res)))
+end
+
+bench("lines gmatch", function ()
+  local c = 0
+  for l in gmatch(doc, "([^\n]*)\n") do c = c + 1 end
+  return c
+end)
+
+bench("lines iterlines", function ()
+  local c = 0
+  for i, j in iterlines(doc) do c = c + 1 end
+  return c
+end)
+
+bench("fields gmatch", function ()
+  local c = 0
+  for l in gmatch(doc, "([^\n]*)\n") do
+    local f = {}
+    for v in gmatch(l .. ",", "([^,]*),") do f[#f + 1] = v end
+    c = c + #f
+  end
+  return c
+end)
+
+bench("fields split", function ()
+  local c = 0
+  for i, j in iterlines(doc) do
+    c = c + #split(sub(doc, i, j), ",")
+  end
+  return c
+end)
@@ -0,0 +1,39 @@
+-- $Id: testes/bench/str2num.lua $
+-- See Copyright Notice in file all.lua
+
+-- Throughput of conversions of decimal numerals to numbers, as in a
+-- JSON or CSV decoder. Compare builds with and without LUA_NOFASTS2N.
+-- Usage: lua str2num.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 1000000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+local format, tonumber = string.format, tonumber
+
+math.randomseed(42)
+local floats, prices, sci, long = {}, {}, {}, {}
+for i = 1, N do
+  local x = math.random() * 10.0^math.random(-10, 10)
+  floats[i] = tostring(x)
+  prices[i] = format("%.2f", math.random(0, 100000) / 100)
+  sci[i] = format("%.6e", x)
+  long[i] = format("%.25f", math.random())
+end
+
+local function bench (name, t)
+  local best = math.huge
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    for i = 1, N do tonumber(t[i]) end
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(format("%-16s %8.3f s  %8.2f M/s", name, best, N / best / 1e6))
+end
+
+bench("shortest", floats)
+bench("prices", prices)
+bench("scientific", sci)
+bench("long (>19 dig.)", long)
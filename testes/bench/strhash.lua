@@ -0,0 +1,58 @@
+-- $Id: testes/bench/strhash.lua $
+-- See Copyright Notice in file all.lua
+
+-- Throughput of string interning, as in a parser that slices keys of
+-- 20-40 bytes out of its input, and of hashing long strings used as
+-- table keys. Compare builds with and without LUA_USE_FASTHASH.
+-- Usage: lua strhash.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 1000000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+
+-- a "document" with N keys of 20-40 bytes, sliced out by offsets
+local parts, pos, len = {}, {}, {}
+local p = 1
+for i = 1, N do
+  local k = string.format("%s_%s_%d", "customer.billing",
+                          string.rep("x", i % 16), i)
+  parts[i] = k
+  pos[i], len[i] = p, #k
+  p = p + #k
+end
+local doc = table.concat(parts)
+parts = nil
+
+local function bench (name, n, f)
+  local best = math.huge
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    f()
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-8s %8.3f s  %10.1f Mop/s", name, best,
+                      n / best / 1e6))
+end
+
+local sub = string.sub
+
+bench("intern", N, function ()   -- new strings
+  local t = {}
+  for i = 1, N do t[i] = sub(doc, pos[i], pos[i] + len[i] - 1) end
+end)
+
+local keep = {}
+for i = 1, N do keep[i] = sub(doc, pos[i], pos[i] + len[i] - 1) end
+
+bench("reintern", N, function ()   -- strings already in the table
+  for i = 1, N do local s = sub(doc, pos[i], pos[i] + len[i] - 1) end
+end)
+
+local M = N // 100
+bench("long", M, function ()   -- long strings as table keys
+  local t = {}
+  for i = 1, M do t[sub(doc, i, i + 999)] = i end
+end)
@@ -0,0 +1,44 @@
+-- $Id: testes/bench/strops.lua $
+-- See Copyright Notice in file all.lua
+
+-- Throughput of 'string.lower', 'string.upper', 'string.reverse' and
+-- 'string.rep' on strings from 8 bytes to 16 MB. (Case conversion
+-- takes its fast path only in the "C" locale.)
+-- Usage: lua strops.lua [total MB per case] [rounds]
+
+local MB = tonumber(arg and arg[1]) or 64
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+local lower, upper, reverse, rep =
+      string.lower, string.upper, string.reverse, string.rep
+
+math.randomseed(42)
+local t = {}
+for i = 1, 16 * 2^20 do t[i] = string.char(math.random(32, 126)) end
+local text = table.concat(t)
+t = nil
+
+local function bench (name, size, f, s)
+  local n = math.max(1, MB * 2^20 // size)
+  local best = math.huge
+  for _ = 1, R do
+    local t0 = clock()
+    for _ = 1, n do f(s) end
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-8s %9d  %8.3f s  %8.2f GB/s", name, size, best,
+                      n * size / best / 1e9))
+end
+
+for _, size in ipairs{8, 64, 512, 4096, 2^16, 2^20, 16 * 2^20} do
+  local s = string.sub(text, 1, size)
+  bench("lower", size, lower, s)
+  bench("upper", size, upper, s)
+  bench("reverse", size, reverse, s)
+  bench("rep", size, function (c) return rep(c, size) end, "x")
+  bench("rep sep", size, function (c) return rep(c, size // 4, ", ") end,
+        "ab")
+  print()
+end
@@ -0,0 +1,71 @@
+-- $Id: testes/bench/tableops.lua $
+-- See Copyright Notice in file all.lua
+
+-- Time of 'table.move', 'table.unpack', 'table.concat', and of
+-- 'table.insert'/'table.remove' at the front of an array, on plain
+-- tables (which use the bulk copies) and on tables with an empty
+-- '__index' metamethod (which go element by element).
+-- Usage: lua tableops.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 100000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+
+local function bench (name, f)
+  local best = math.huge
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    f()
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-28s %8.3f s", name, best))
+end
+
+local mt = {__index = function () end}
+
+for _, meta in ipairs{false, true} do
+  local function new ()
+    local t = {}
+    for i = 1, N do t[i] = i end
+    return meta and setmetatable(t, mt) or t
+  end
+  local pre = meta and "(meta) " or ""
+  local a = new()
+
+  bench(pre .. "move to new table", function ()
+    for _ = 1, 20 do table.move(a, 1, N, 1, meta and new() or {}) end
+  end)
+
+  bench(pre .. "move inside table", function ()
+    for _ = 1, 20 do
+      table.move(a, 1, N - 1, 2)
+      table.move(a, 2, N, 1)
+    end
+  end)
+
+  local s = {}
+  for i = 1, N do s[i] = string.rep("x", i % 20) end
+  if meta then setmetatable(s, mt) end
+  bench(pre .. "concat strings", function ()
+    for _ = 1, 20 do table.concat(s, ",") end
+  end)
+
+  local u = {}
+  for i = 1, 200 do u[i] = i end
+  if meta then setmetatable(u, mt) end
+  bench(pre .. "unpack 200", function ()
+    local unpack = table.unpack
+    for _ = 1, N // 10 do unpack(u) end
+  end)
+
+  local t = new()
+  bench(pre .. "insert/remove at front", function ()
+    for _ = 1, 1000 do
+      table.insert(t, 1, 0)
+      table.remove(t, 1)
+    end
+  end)
+end
@@ -0,0 +1,52 @@
+-- $Id: testes/bench/utf8.lua $
+-- See Copyright Notice in file all.lua
+
+-- Throughput of 'utf8.len' and 'utf8.valid' on documents of about
+-- 100 KB: plain ASCII, mostly ASCII, Latin text with accents, and CJK
+-- text. Compare builds with and without SSSE3 (e.g., -mno-ssse3).
+-- Usage: lua utf8.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 2000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+
+math.randomseed(42)
+local function doc (chars)
+  local t, size = {}, 0
+  while size < 100000 do
+    local c = chars[math.random(#chars)]
+    t[#t + 1] = c
+    size = size + #c
+  end
+  return table.concat(t)
+end
+
+local ascii = {}
+for c = 32, 126 do ascii[#ascii + 1] = string.char(c) end
+local mostly = {table.unpack(ascii)}
+mostly[#mostly + 1] = "é"
+mostly[#mostly + 1] = "€"
+local latin = {table.unpack(ascii, 65, 90)}
+for c = 0xE0, 0xFF do latin[#latin + 1] = utf8.char(c) end
+local cjk = {}
+for c = 0x4E00, 0x4FFF do cjk[#cjk + 1] = utf8.char(c) end
+
+local function bench (name, s, f)
+  local best = math.huge
+  for _ = 1, R do
+    local t0 = clock()
+    for _ = 1, N do f(s) end
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  print(string.format("%-18s %8.3f s  %8.2f GB/s", name, best,
+                      N * #s / best / 1e9))
+end
+
+for _, d in ipairs{{"ascii", ascii}, {"mostly ascii", mostly},
+                   {"latin", latin}, {"cjk", cjk}} do
+  local s = doc(d[2])
+  bench(d[1] .. " len", s, utf8.len)
+  bench(d[1] .. " valid", s, utf8.valid)
+end
@@ -0,0 +1,64 @@
+-- $Id: testes/bench/vector.lua $
+-- See Copyright Notice in file all.lua
+
+-- Time and memory of filling, summing, and sorting arrays of floats and
+-- of integers kept in regular tables and in vectors ('table.vector').
+-- Usage: lua vector.lua [N] [rounds]
+
+local N = math.tointeger(arg and arg[1]) or 1000000
+local R = math.tointeger(arg and arg[2]) or 3
+
+local clock = os.clock
+
+local function bench (name, f)
+  local best = math.huge
+  for _ = 1, R do
+    collectgarbage()
+    local t0 = clock()
+    f()
+    local t = clock() - t0
+    if t < best then best = t end
+  end
+  io.write(string.format("%10.3f s", best))
+end
+
+local kinds = {
+  float = function (i) return i * 0.5 end,
+  integer = function (i) return i * 3 end,
+}
+
+print(string.format("%-24s%12s%12s%12s%12s%13s", "", "fill", "append",
+                    "sum", "sort", "memory"))
+for _, kind in ipairs{"float", "integer"} do
+  for _, vec in ipairs{false, true} do
+    local function new (n)
+      if vec then return table.vector(kind, n) else return table.create(n) end
+    end
+    local val = kinds[kind]
+    io.write(string.format("%-24s", kind .. (vec and " vector" or " table")))
+    local t
+    bench("fill", function ()
+      t = new(N)
+      for i = 1, N do t[i] = val(i) end
+    end)
+    bench("append", function ()
+      t = new(0)
+      for i = 1, N do t[#t + 1] = val(i) end
+    end)
+    bench("sum", function ()
+      local s = 0
+      for i = 1, #t do s = s + t[i] end
+      for _, x in ipairs(t) do s = s + x end
+    end)
+    bench("sort", function ()
+      local a = new(N)
+      for i = 1, N do a[i] = val((i * 7919) % N) end
+      table.sort(a)
+    end)
+    collectgarbage()
+    local m = collectgarbage("count")
+    t = new(N)
+    for i = 1, N do t[i] = val(i) end
+    print(string.format("%10.1f MB", (collectgarbage("count") - m) / 1024))
+  end
+end
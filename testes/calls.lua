@@ -289,7 +289,8 @@ assert(a[1] == 1 and a[2] == 3 and a[3] == "a" and a[4] == "b")
 rawget({}, "x", 1)
 rawset({}, "x", 1, 2)
 assert(math.sin(1,2) == math.sin(1))
-table.sort({10,9,8,4,19,23,0,0}, function (a,b) return a<b end, "extra arg")
+table.sort({10,9,8,4,19,23,0,0}, function (a,b) return a<b end, "unstable",
+           "extra arg")
 
 
 -- test for generic load
@@ -1050,5 +1050,105 @@ do   -- tests for 'source' in binary dumps
          debug.getinfo(h).source == '=?')
 end
 
+
+do   print("testing profiler")
+  local profiler = require"profiler"
+  assert(profiler == package.loaded.profiler and rawget(_G, "profiler") == nil)
+  local function checkerr (msg, f, ...)
+    local st, err = pcall(f, ...)
+    assert(not st and string.find(err, msg))
+  end
+  local function busy ()
+    local s = 0
+    for i = 1, 1000 do s = s + i end
+    return s
+  end
+  local function run ()
+    local t = os.clock()
+    while os.clock() - t < 0.1 do busy() end
+  end
+  profiler.start(0.1)
+  checkerr("already running", profiler.start)
+  run()
+  local n, dropped = profiler.stop()
+  assert(n > 0 and dropped == 0)
+  assert(profiler.stop() == n)   -- stopping again does nothing
+  local t = profiler.dump()
+  local total = 0
+  for st, c in string.gmatch(t, "([^\n]*) (%d+)\n") do
+    total = total + tonumber(c)
+    assert(string.find(st, "^[^;]+@[^;]+;"))
+  end
+  assert(total == n)
+  assert(string.find(t, ";run@[^;]+;busy@"))
+  -- dump to a file
+  local fname = os.tmpname()
+  assert(profiler.dump(fname))
+  local f = assert(io.open(fname))
+  assert(f:read("a") == t)
+  f:close()
+  assert(os.remove(fname))
+  -- a new run starts from scratch
+  profiler.start()
+  assert(profiler.stop() <= n)
+  checkerr("positive", profiler.start, 0)
+  -- time in a coroutine goes to the coroutine's stack
+  profiler.start(0.1)
+  coroutine.wrap(function () run() end)()
+  n = profiler.stop()
+  assert(n > 0 and debug.gethook() == nil)
+  t = profiler.dump()
+  assert(string.find(t, ";run@[^;]+;busy@"))
+end
+
+do   print("testing memory profiler")
+  local profiler = require"profiler"
+  local function alloc ()
+    local t = {}
+    for i = 1, 1000 do t[i] = {} end
+    return t
+  end
+  local function garbage ()
+    for i = 1, 1000 do local s = string.rep("x", 100) .. i end
+  end
+  profiler.memstart(1)   -- sample every block
+  assert(not pcall(profiler.memstart))
+  local keep = alloc()
+  garbage()
+  collectgarbage()
+  local n, dropped = profiler.memstop()
+  assert(n >= 3000 and dropped == 0)
+  local r = profiler.memreport()
+  local sites, types = {}, {}
+  for a, l, c, site in string.gmatch(r, " *(%d+) +(%d+) +(%d+)  ([^\n]+)") do
+    sites[site] = {tonumber(a), tonumber(l), tonumber(c)}
+  end
+  for l in string.gmatch(r, "[^\n]+") do
+    local a, c, ty = string.match(l, "^ *(%d+) +(%d+)  (%a+)$")
+    if a then types[ty] = {tonumber(a), tonumber(c)} end
+  end
+  local line = debug.getinfo(alloc, "S").linedefined + 2
+  local s = sites["alloc@" .. debug.getinfo(1, "S").short_src .. ":" .. line]
+  assert(s and s[3] >= 1000 and s[2] > s[1] * 0.8)  -- mostly live
+  line = debug.getinfo(garbage, "S").linedefined + 1
+  s = sites["garbage@" .. debug.getinfo(1, "S").short_src .. ":" .. line]
+  assert(s and s[3] >= 2000 and s[2] < s[1] / 2)   -- mostly freed
+  assert(types.table[2] >= 1000 and types.string[2] >= 2000)
+  -- report with only the top site
+  local _, k = string.gsub(profiler.memreport(1), "@", "@")
+  assert(k == 1)
+  assert(#keep == 1000)
+  assert(not pcall(profiler.memstart, 0))
+  -- allocations in a coroutine go to the coroutine's line
+  profiler.memstart(1)
+  local co = coroutine.wrap(function () local t = alloc(); return t end)
+  keep = co()
+  n, dropped = profiler.memstop()
+  assert(n >= 1000 and dropped == 0 and debug.gethook() == nil)
+  line = debug.getinfo(alloc, "S").linedefined + 2
+  s = string.match(profiler.memreport(1), " (%d+)  alloc@[^\n]*:" .. line)
+  assert(tonumber(s) >= 1000)
+end
+
 print"OK"
 
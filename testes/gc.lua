@@ -620,6 +620,59 @@ if T then
 end
 
 
+if T and T.bgsweep then
+  print("background sweeping")
+  -- runs in a state with a thread-safe allocator limited to 1 MB
+  local code = [[
+    local function garbage (n)   -- ('string.rep' does not retry)
+      for i = 1, n do local t = table.create(1000) end
+    end
+    garbage(1000)                     -- normal cycles
+    collectgarbage("stop")
+    garbage(1000)                     -- only emergency collections
+    collectgarbage("restart")
+    collectgarbage("generational")
+    garbage(1000)
+    collectgarbage("incremental")
+    local t = {}
+    for i = 1, 50 do t[i] = table.create(1000) end
+  ]]
+  local err, freed = T.bgsweep(code, 1000000)
+  assert(err == nil and freed)      -- closing frees all queued blocks
+  -- a real lack of memory is still an error
+  err, freed = T.bgsweep("local t = {}; for i = 1, 1e6 do t[i] = {} end",
+                         1000000)
+  assert(string.find(err, "not enough memory") and freed)
+end
+
+
+if T and T.slabstate then
+  print("slab allocator")
+  local err, slab = T.slabstate[[
+    local pages = {}
+    local l
+    for i = 1, 100000 do
+      l = {l}
+      if i % 100 == 0 then pages[#pages + 1] = pageof(l) end
+    end
+    for i = 1, #pages do assert(ismapped(pages[i])) end
+    local s = 0
+    for i = 1, 1000 do s = s + #string.format("%d", i) end
+    assert(s == 2893)
+    l = nil
+    collectgarbage()      -- must give all empty pages back
+    local n = 0
+    for i = 1, #pages do
+      if ismapped(pages[i]) then n = n + 1 end
+    end
+    -- (a few pages get new objects; without trimming, more than 100
+    -- samples fall in the empty pages the allocator keeps)
+    assert(n < 50)
+  ]]
+  assert(err == nil and slab)
+end
+
+
 -- create an object to be collected when state is closed
 do
   local setmetatable,assert,type,print,getmetatable =
@@ -675,6 +728,48 @@ do    -- check that the collector is not reentrant in incremental mode
 end
 
 
+do   print("testing parallel marking")
+  -- (without LUA_USE_PARALLELMARK, there are no workers and
+  -- marking is always sequential)
+  local old = collectgarbage("param", "workers", 3)
+  local n = collectgarbage("param", "workers")
+  assert(n == 0 or n == 3)
+  local N = 20000
+  local strong, weakv, weakk = {}, setmetatable({}, {__mode = "v"}),
+                               setmetatable({}, {__mode = "k"})
+  local mt = {__index = function () return 0 end}
+  for i = 1, N do
+    local t = setmetatable({i, tostring(i), {i}}, mt)
+    strong[i] = t
+    weakv[i] = (i % 2 == 0) and t or {}        -- half of them die
+    weakk[t] = {t}                             -- ephemeron chain to itself
+    weakk[{}] = i                              -- dead key
+  end
+  local co = coroutine.wrap(function (t)       -- values only in a stack
+    local x = {t, function () return t end}
+    coroutine.yield()
+    return x[2]()[1][1]
+  end)
+  co(strong)
+  strong[N + 1] = string.rep("x", 100)
+  collectgarbage()
+  for i = 1, N do
+    assert(strong[i][1] == i and strong[i][2] == tostring(i))
+    assert(strong[i][3][1] == i and strong[i].x == 0)
+    assert(weakk[strong[i]][1] == strong[i])
+    assert((i % 2 == 0) == (weakv[i] ~= nil))
+  end
+  local k = 0
+  for _ in pairs(weakk) do k = k + 1 end
+  assert(k == N)
+  assert(co() == 1)
+  strong = nil
+  collectgarbage()
+  assert(next(weakv) == nil and next(weakk) == nil)
+  assert(collectgarbage("param", "workers", old) == n)
+end
+
+
 collectgarbage(oldmode)
 
 print('OK')
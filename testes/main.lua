@@ -232,6 +232,26 @@ RUN("env LUA_CPATH='./libs/?.so' lua -l lib2-v2 -e 'print(lib2.id())' > %s",
 checkout("true\n")
 
 
+-- test option '-p'
+prepfile[[
+  local function loop (n) local s = 0; for i = 1, n do s = s + i end end
+  local t = os.clock()
+  while os.clock() - t < 0.2 do loop(1000) end
+]]
+RUN('lua -p %s %s', out, prog)
+do
+  local t = getoutput()
+  -- each line is a stack from root to leaf plus a count
+  for l in string.gmatch(t, "[^\n]+") do
+    assert(string.find(l, "^[^ ]+@.* %d+$"))
+  end
+  assert(string.find(t, "main chunk@" .. prog .. ";loop@" .. prog .. ":1 %d+"))
+end
+RUN('lua -p%s -e "a=1" > %s', out, otherprog)   -- profile may be empty
+assert(os.remove(otherprog))
+getoutput()
+
+
 -- test 'arg' table
 local a = [[
   assert(#arg == 3 and arg[1] == 'a' and
@@ -482,6 +502,7 @@ NoRun("unrecognized option '-iv'", "lua -iv")
 NoRun("'-e' needs argument", "lua -e")
 NoRun("syntax error", "lua -e a")
 NoRun("'-l' needs argument", "lua -l")
+NoRun("'-p' needs argument", "lua -p")
 
 
 if T then   -- test library?
@@ -481,6 +481,45 @@ assert(not f(tonumber('e1')))
 assert(not f(tonumber('e  1')))
 assert(not f(tonumber(' 3.4.5 ')))
 
+if floatbits == 53 and maxexp == 1024 then   -- testing decimal numerals
+  -- correctly rounded, including halfway cases
+  assert(tonumber("9007199254740993") == 2^53)
+  assert(tonumber("9007199254740993.0") == 2^53)
+  assert(tonumber("9007199254740995.0") == 2^53 + 4)
+  assert(tonumber("9007199254740993.00000000001") == 2^53 + 2)
+  assert(tonumber("0.1") == 1/10 and tonumber("0.3") == 3/10)
+  assert(tonumber("1e23") == 1e23 and tonumber("8.5e-5") == 85/1e6)
+  assert(tonumber("1.7976931348623157e308") == 0x1.fffffffffffffp1023)
+  assert(tonumber("1.7976931348623159e308") == math.huge)
+  assert(tonumber("2.2250738585072011e-308") == 0x0.fffffffffffffp-1022)
+  assert(tonumber("2.2250738585072014e-308") == 0x1p-1022)
+  assert(tonumber("4.9e-324") == 0x1p-1074 and tonumber("2e-324") == 0)
+  assert(tonumber("1e-400") == 0 and tonumber("-1e400") == -math.huge)
+  assert(tonumber("0." .. string.rep("0", 400) .. "1e400") == 0.1)
+  assert(tonumber(string.rep("9", 30)) == 1e30)
+  assert(tonumber(" \t-12.5e+1\n ") == -125.0)
+  assert(tonumber("+.5") == 0.5 and tonumber("5.") == 5.0)
+  assert(1 / tonumber("-0.0") == -math.huge)
+  assert(math.type(tonumber("1e2")) == "float")
+  for _, s in ipairs{"1e", ".", "1.0e+", "e1", "1..2", "1e1.5", "- 1",
+                     "1 2", "++1", "0.5f", "1e+-2", ".e1"} do
+    assert(not f(tonumber(s)))
+  end
+  -- round trip of random floats
+  local random = math.random
+  for i = 1, 20000 do
+    local x = random() * 10.0^random(-300, 300)
+    if random(2) == 1 then x = -x end
+    assert(tonumber(string.format("%.17g", x)) == x)
+    assert(tonumber(string.format("%.14e", x)) ==
+           tonumber(string.format("%.14e", x) .. string.rep("0", 10)))
+    local y = string.unpack("d", string.pack("i8", random(0)))
+    if y - y == 0 then   -- finite?
+      assert(tonumber(string.format("%.17g", y)) == y)
+    end
+  end
+end
+
 
 -- testing 'tonumber' for invalid hexadecimal formats
 
@@ -12,6 +12,8 @@ end
 local function check (t, na, nh)
   if not T then return end
   local a, h = T.querytab(t)
+  -- with control-byte hashing, a large hash part may be one size bigger
+  if T.swisshash and nh > 16 and h == 2 * nh then h = nh end
   if a ~= na or h ~= nh then
     print(na, nh, a, h)
     assert(nil)
@@ -133,6 +135,35 @@ for _, sa in ipairs(sizes) do    -- 'sa' is size of the array part
 end
 
 
+-- testing sizes of tables built by a constructor plus field assignments
+do
+  local function f (x)
+    local t = {1, 2, a = 1}
+    t.b = x; t.c = {}; t.d = x
+    t.e = {x = 1, y = x}
+    return t
+  end
+  collectgarbage("stop")
+  f(1)    -- call once to ensure stack space
+  T.alloccount(6);  -- header + parts for each table
+  local t = f(10)
+  T.alloccount();
+  collectgarbage("restart")
+  check(t, 2, mp2(5))
+  assert(t.a == 1 and t.d == 10 and t.e.y == 10)
+
+  -- other statements in between stop the growth
+  local function g ()
+    local t = {}
+    t.a = 1
+    local x = 0
+    t.b = 2
+    return t
+  end
+  check(g(), 0, 2)
+end
+
+
 -- tests with unknown number of elements
 local a = {}
 for i=1,sizes[#sizes] do a[i] = i end   -- build auxiliary table
@@ -165,6 +196,24 @@ for i = 1,lim do
   check(a, 0, mp2(i))
 end
 
+-- appending to a full array part grows it even when the hash part
+-- has free slots (which then keep the other keys)
+a = {1, x = 1, y = 2, z = 3, w = 4, v = 5}
+check(a, 1, 8)
+for i = 2,lim do
+  a[#a + 1] = i
+  check(a, mp2(i), 8)
+end
+a = {1, 2, 3, 4, [6] = 6, x = 1}
+check(a, 4, 2)
+a[5] = 5   -- a rehash moves key 6 to the array part
+check(a, 8, 1)
+for i = 1, 6 do assert(a[i] == i) end
+assert(#a == 6 and a.x == 1)
+a[9] = 9   -- array part is not full
+check(a, 8, 2)
+assert(a[9] == 9 and a[7] == nil)
+
 a = {}
 for i=1,16 do a[i] = i end
 check(a, 16, 0)
@@ -184,7 +233,8 @@ end
 for i=1,lim do
   local a = {}
   for i=i,1,-1 do a[i] = i end   -- fill in reverse
-  check(a, mp2(i), 0)
+  -- (rehash points depend on the maximum load of the hash part)
+  if not T or not T.swisshash then check(a, mp2(i), 0) end
 end
 
 -- size tests for vararg
@@ -824,4 +874,35 @@ do
   
 end
 
+
+do   print("testing field caches")
+  local function get (t) return t.x, t.y end
+  local function set (t, v) t.y = v end
+  local hasfc = collectgarbage("fieldcache", true)
+  local a = {x = 1, y = 2}
+  local b = {y = 20, x = 10}    -- same keys, maybe other layout
+  for i = 1, 10 do
+    local x, y = get((i % 2 == 0) and a or b)
+    assert(x == ((i % 2 == 0) and 1 or 10) and y == x * 2)
+  end
+  -- hints must survive rehashes
+  for i = 1, 100 do
+    set(a, i)
+    a["k" .. i] = i
+    assert(get(a) == 1 and a.y == i)
+  end
+  -- and removals
+  a.x = nil
+  assert(get(a) == nil)
+  a.x = 3
+  assert(get(a) == 3)
+  local o = {n = 0}
+  function o:inc () self.n = self.n + 1 end
+  for i = 1, 50 do o:inc() end
+  assert(o.n == 50)
+  if hasfc then
+    assert(collectgarbage("fieldcache") > 50)
+  end
+end
+
 print"OK"
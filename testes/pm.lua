@@ -383,6 +383,11 @@ end
 
 malform("(.", "unfinished capture")
 malform(".)", "invalid pattern capture")
+-- a lone ')' is literal only for 'find', which never checked it
+assert(string.find("a)b", ")") == 2)
+checkerror("invalid pattern capture", string.match, "a)b", ")")
+checkerror("invalid pattern capture", string.gsub, "a)b", ")", "X")
+checkerror("invalid pattern capture", string.gmatch("a)b", ")"))
 malform("[a")
 malform("[]")
 malform("[^]")
@@ -436,5 +441,265 @@ do   -- test reuse of original string in gsub
   assert(r == s and string.format("%p", s) ~= string.format("%p", r))
 end
 
+
+do   print("testing plain search")
+  -- naive search, to check against
+  local function naive (s, p, init)
+    for i = init, #s - #p + 1 do
+      if string.sub(s, i, i + #p - 1) == p then return i end
+    end
+    return nil
+  end
+
+  local function randstr (n, alpha)
+    local t = {}
+    for i = 1, n do
+      local c = math.random(#alpha)
+      t[i] = string.sub(alpha, c, c)
+    end
+    return table.concat(t)
+  end
+
+  -- needles of all sizes, short and long, over small alphabets (so
+  -- that there are many partial matches); includes periodic needles
+  for _, alpha in ipairs{"ab", "abc", "a\0b"} do
+    for _ = 1, 60 do
+      local s = randstr(math.random(0, 300), alpha)
+      local p
+      local k = math.random(5)
+      if k == 1 then   -- periodic needle
+        p = string.rep(randstr(math.random(3), alpha), math.random(40))
+      elseif k == 2 and #s > 0 then   -- substring of the subject
+        local i = math.random(#s)
+        p = string.sub(s, i, i + math.random(0, 80))
+      else
+        p = randstr(math.random(80), alpha)
+      end
+      local init = math.random(#s + 1)
+      local i, e = string.find(s, p, init, true)
+      assert(i == naive(s, p, init) and (not i or e == i + #p - 1))
+    end
+  end
+
+  -- adversarial cases for the long-needle searcher
+  local s = string.rep("a", 1000)
+  assert(not string.find(s, string.rep("a", 40) .. "b", 1, true))
+  assert(string.find(s .. "b", string.rep("a", 40) .. "b", 1, true) == 961)
+  assert(string.find(s, string.rep("a", 1000), 1, true) == 1)
+  assert(not string.find(s, string.rep("a", 1001), 1, true))
+  s = string.rep("ab", 500) .. "abc"
+  assert(string.find(s, string.rep("ab", 30) .. "c", 1, true) == 943)
+  assert(string.find(s, string.rep("ab", 30) .. "c", 944, true) == nil)
+
+  -- literal patterns in 'match', 'gmatch', and 'gsub'
+  s = "one two one three one"
+  assert(string.match(s, "one") == "one")
+  assert(string.match(s, "one", 19) == "one")
+  assert(string.match(s, "one", 20) == nil)
+  assert(string.match(s, "four") == nil)
+  local t = {}
+  for w in string.gmatch(s, "one") do t[#t + 1] = w end
+  assert(#t == 3 and t[3] == "one")
+  t = {}
+  for w in string.gmatch("aaaaa", "aa") do t[#t + 1] = w end
+  assert(#t == 2)
+  t = {}
+  for w in string.gmatch("aaaaa", "aa", 3) do t[#t + 1] = w end
+  assert(#t == 1)
+  for w in string.gmatch("aaaaa", "aa", 10) do error("cannot match") end
+  assert(string.gsub(s, "one", "1") == "1 two 1 three 1")
+  assert(select(2, string.gsub(s, "one", "1", 2)) == 2)
+  assert(string.gsub(s, "one", "1", 2) == "1 two 1 three one")
+  assert(string.gsub(s, "one", "<%0%1>") ==
+         "<oneone> two <oneone> three <oneone>")
+  assert(string.gsub(s, "one", {one = 1}) == "1 two 1 three 1")
+  assert(string.gsub(s, "one", function (x) return nil end) == s)
+  assert(string.gsub("aaaaa", "aa", "b") == "bba")
+  assert(string.gsub("x\0y\0z", "\0", "-") == "x-y-z")
+  checkerror("invalid capture index %%2", string.gsub, s, "one", "%2")
+  -- compare literal search with an equivalent non-literal pattern
+  for _ = 1, 50 do
+    local s = randstr(math.random(0, 200), "abc ")
+    local p = randstr(math.random(4), "abc")
+    local ep = p .. "()"   -- same matches, with a position capture
+    local r1, n1 = string.gsub(s, p, "[%0]")
+    local r2, n2 = string.gsub(s, ep, "[%0]")
+    assert(r1 == r2 and n1 == n2)
+    local c = 0
+    for _ in string.gmatch(s, p) do c = c + 1 end
+    assert(c == n1)
+  end
+end
+
+
+do   print("testing compiled patterns")
+  -- programs in the cache survive collections or are rebuilt
+  for _ = 1, 3 do
+    local k, v = string.match("key=val", "(%w+)=(%w+)")
+    assert(k == "key" and v == "val")
+    assert(string.gsub("a1b22c333", "%d+", "#") == "a#b#c#")
+    collectgarbage()
+  end
+  -- malformed patterns only raise errors when matching gets there
+  assert(string.find("abc", "x%") == nil)
+  checkerror("ends with '%%'", string.find, "xbc", "x%")
+  assert(string.match("abc", "x[a") == nil)
+  checkerror("missing ']'", string.match, "xbc", "x[a")
+  assert(string.gsub("abc", "x%b", "") == "abc")
+  checkerror("missing arguments", string.gsub, "xbc", "x%b", "")
+  checkerror("missing '%['", string.gmatch("abc", "%f%a"))
+  -- '^' is not an anchor in 'gmatch'
+  local t = {}
+  for w in string.gmatch("^a^b", "^%a") do t[#t + 1] = w end
+  assert(#t == 2 and t[1] == "^a" and t[2] == "^b")
+  assert(string.match("a^b", "^%a") == "a")
+  assert(string.find("^a^b", "^%a") == nil)
+  -- patterns starting with a literal string
+  assert(string.find("xx user=ab user=cd", "user=(%a+)", 5) == 12)
+  assert(select(3, string.find("xx user=ab user=cd", "user=(%a+)", 5)) == "cd")
+  assert(string.gsub("k=1, kk=2, k=", "k=(%d)", "<%1>") == "<1>, k<2>, k=")
+  t = {}
+  for v in string.gmatch("k=1, kk=2, k=", "k=(%d)") do t[#t + 1] = v end
+  assert(#t == 2 and t[2] == "2")
+  -- sets and frontiers
+  assert(string.gsub("a-b_c]d", "[%w_%-]+", "#") == "#]#")
+  assert(string.gsub("a-b_c]d", "[^%w_%-]", "#") == "a-b_c#d")
+  assert(string.gsub("THE (quick) fox", "%f[%a]%a+", "w") == "w (w) w")
+  assert(string.gsub("x]]y", "[]]+", "") == "xy")
+end
+
+
+do   print("testing backtracking")
+  local rep = string.rep
+  -- results of the recursive matcher (before patterns were compiled)
+  local corpus = {
+  {"hello world", "(h)(e)(l)(l)(o)", {"h", "e", "l", "l", "o"}},
+  {"  key = value  ", "^%s*(%S+)%s*=%s*(.-)%s*$", {"key", "value"}},
+  {"a,b,,c", "([^,]*),([^,]*),([^,]*),([^,]*)", {"a", "b", "", "c"}},
+  {"aaab", "a-b", {"aaab"}},
+  {"aaab", "()a*()", {1, 4}},
+  {"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaac", "a*a*a*a*a*b", {nil}},
+  {"xyzxyzxyz", "(x.-z)%1", {"xyz"}},
+  {"xyzxyzxyz", "(x.-z)(%1)$", {"xyz", "xyz"}},
+  {"abcabc", "(a(b(c)))%3", {nil}},
+  {"f(a(b)c)d", "%b()", {"(a(b)c)"}},
+  {"f(a(b)c", "%b()", {"(b)"}},
+  {"THE (quick) fox", "%f[%a]%a+%f[%A]", {"THE"}},
+  {"[[x]] ]]", "%[(=*)%[(.-)%]%1%]", {"", "x"}},
+  {"one; two; three", "(%a+);%s*(.*)", {"one", "two; three"}},
+  {"aaa", "a?a?a?aaa", {"aaa"}},
+  {"aaa", "^(a?)(a?)(a?)aaa$", {"", "", ""}},
+  {"abab", "(ab)-$", {nil}},
+  {"0x1F, 0X2a", "0[xX](%x+)", {"1F"}},
+  {"a.b.c", "(.-)%.(.*)", {"a", "b.c"}},
+  {"test123abc", "^(%a+)(%d+)(%a+)$", {"test", "123", "abc"}},
+  {"<a><b></b></a>", "<(%w+)>.*</%1>", {"a"}},
+  {"<a><b></b></a>", "<(%w+)>.-</%1>", {"a"}},
+  {"", "a*", {""}},
+  {"", "()", {1}},
+  {"abc", "$", {""}},
+  {"a$b", "a$b", {"a$b"}},
+  {"a^b", "a^b", {"a^b"}},
+  {"\0a\0", "%z(a)%z", {"a"}},
+  {"ab12", "[%a%d]+", {"ab12"}},
+  {"--x--", "%-%-(x)%-%-", {"x"}},
+  {"aXbXc", "[^X]+$", {"c"}},
+  {"mississippi", "(s+)(i)(p*)", {"ss", "i", ""}},
+  {"mississippi", "i(ss)i%1", {"ss"}},
+  {rep("ab", 50), "(.-)b(.-)b(.-)b$", {"a", "a", rep("ab", 47) .. "a"}},
+  {rep("x", 200) .. "y", ".-.-.-y", {rep("x", 200) .. "y"}},
+  {rep("x", 200), ".-.-.-y", {nil}},
+  {rep("(", 50) .. rep(")", 50), "%b()", {rep("(", 50) .. rep(")", 50)}},
+  }
+  for _, c in ipairs(corpus) do
+    local r = table.pack(string.match(c[1], c[2]))
+    local e = c[3]
+    assert(r.n == math.max(#e, 1))
+    for i = 1, r.n do assert(r[i] == e[i]) end
+  end
+
+  -- exponential for a naive backtracker
+  assert(string.match(rep("a", 30), rep("a?", 30) .. rep("a", 30)) ==
+         rep("a", 30))
+  assert(not string.match(rep("a", 30), rep("a?", 30) .. rep("a", 31)))
+  assert(not string.find(rep("x", 5000), ".-.-.-.-y"))
+  assert(not string.find(rep("ab", 1000), "(a*b*)*c"))  -- '*' after ')'
+  assert(string.gsub(rep("x", 2000), "%w-%w-%w-$", "") == "")
+  -- back references disable memoization but work as before
+  assert(string.match(rep("ab", 100) .. "c", "(a.-)%1%1c") == rep("ab", 33))
+  -- without a bitmap (too big or back references), backtracking is bounded
+  checkerror("too complex", string.find, rep("a", 300000),
+                                         rep(".?", 3000) .. ".-b")
+  checkerror("too complex", string.match, rep("a", 40),
+                                          "(a)" .. rep(".?", 24) .. "%1b")
+  -- long matches need no C stack
+  local s = rep("a", 100000)
+  assert(#string.match(s, rep(".?", 5000)) == 5000)
+  assert(string.match(s .. "b", "(.-)b") == s)
+  assert(string.match(s, "^(a-)a*$") == "")
+  local n = 0
+  for a, b in string.gmatch(rep("k=v;", 10000), "(%w+)=(%w-);") do
+    assert(a == "k" and b == "v")
+    n = n + 1
+  end
+  assert(n == 10000)
+end
+
+do   print("testing split")
+  local function eqt (t, e)
+    assert(#t == #e)
+    for i = 1, #e do assert(t[i] == e[i]) end
+  end
+  local split = string.split
+  eqt(split("a,b,,c", ","), {"a", "b", "", "c"})
+  eqt(split(",a,", ","), {"", "a", ""})
+  eqt(split("", ","), {""})
+  eqt(split("abc", ","), {"abc"})
+  eqt(split("a<>b<>c", "<>"), {"a", "b", "c"})
+  eqt(split("a.b.c", "."), {"", "", "", "", "", ""})
+  eqt(split("a.b.c", ".", true), {"a", "b", "c"})
+  eqt(split("a.b.c", "%."), {"a", "b", "c"})
+  eqt(split("a, b ,c", "%s*,%s*"), {"a", "b", "c"})
+  eqt(split("a1b22c333", "%d*"), {"a", "b", "c", ""})   -- no empty seps.
+  eqt(split("a^b", "^"), {"a", "b"})   -- '^' is not an anchor
+  eqt(split("a^b^c", "^%a"), {"a", "", ""})
+  eqt(split("k=v=w", "=", true, 2), {"k", "v=w"})
+  eqt(split("k=v=w", "=", false, 1), {"k=v=w"})
+  eqt(split("k=v=w", "=", false, math.maxinteger), {"k", "v", "w"})
+  eqt(split("a\0b\0", "\0"), {"a", "b", ""})
+  eqt(split("x(y)z", "[()]"), {"x", "y", "z"})
+  eqt(split("key = value", "%s*=%s*", nil, 2), {"key", "value"})
+  checkerror("empty separator", split, "abc", "")
+  checkerror("out of range", split, "abc", ",", false, 0)
+  checkerror("malformed", split, "abc", "%")
+  local t = split(string.rep("abc;", 1000), ";")
+  assert(#t == 1001 and t[1000] == "abc" and t[1001] == "")
+
+  local function lines (s, ...)
+    local t = {}
+    for i, j in string.iterlines(s, ...) do
+      t[#t + 1] = string.sub(s, i, j)
+    end
+    return t
+  end
+  eqt(lines("l1\nl2\n\nl4\n"), {"l1", "l2", "", "l4"})
+  eqt(lines("l1\nl2"), {"l1", "l2"})
+  eqt(lines("\n"), {""})
+  eqt(lines(""), {})
+  eqt(lines("a\r\nb\r\n", "\r?\n"), {"a", "b"})
+  eqt(lines("a\tb\t\tc", "\t"), {"a", "b", "", "c"})
+  eqt(lines("a.b", ".", true), {"a", "b"})
+  local f = string.iterlines("ab,cd")
+  local i, j = f(); assert(i == 1 and j == 5)
+  assert(f() == nil)
+  f = string.iterlines("ab,cd", ",")
+  i, j = f(); assert(i == 1 and j == 2)
+  i, j = f(); assert(i == 4 and j == 5)
+  assert(f() == nil and f() == nil)
+  checkerror("empty separator", string.iterlines, "abc", "")
+  -- separators that backtrack a lot
+  eqt(split(string.rep("x", 300) .. ",y", ".-.-,"), {"", "y"})
+end
+
 print('OK')
 
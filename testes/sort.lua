@@ -33,7 +33,7 @@ do print "testing 'table.create'"
   t = table.create(0, 1024)
   memdiff = collectgarbage("count") * 1024 - m
   assert(memdiff > 1024 * 12)
-  assert(not T or select(2, T.querytab(t)) == 1024)
+  assert(not T or select(2, T.querytab(t)) == (T.swisshash and 2048 or 1024))
 
   checkerror("table overflow", table.create, (1<<31) + 1)
   checkerror("table overflow", table.create, 0, (1<<31) + 1)
@@ -216,6 +216,189 @@ checkerror("wrap around", table.move, {}, 1, 2, maxI)
 checkerror("wrap around", table.move, {}, minI, -2, 2)
 
 
+do print "testing bulk operations on plain tables"
+  -- compare plain tables (which use bulk copies) with tables that have
+  -- metamethods (which go element by element)
+  local random = math.random
+  local mt = {__index = function () end, __newindex = rawset}
+  local function new (n, meta)
+    local t = {}
+    for i = 1, n do
+      local r = i % 4
+      t[i] = (r == 0) and {i} or (r == 1) and "x" .. i or (r == 2) and i
+    end
+    return meta and setmetatable(t, mt) or t
+  end
+  local function eq (a, b)
+    for k, v in pairs(a) do assert(rawequal(rawget(b, k), v)) end
+    for k, v in pairs(b) do assert(rawequal(rawget(a, k), v)) end
+  end
+  local oldmode = collectgarbage("incremental")
+  for round = 1, 200 do
+    if round == 100 then collectgarbage("generational") end
+    local n = random(0, 100)
+    local a, b = new(n), new(n, true)
+    b = table.move(a, 1, n, 1, b)   -- share the same values
+    local a2, b2 = new(random(0, 50)), new(0, true)
+    table.move(a2, 1, #a2, 1, b2)
+    for _ = 1, 20 do
+      local op = random(4)
+      if op == 1 then   -- move inside the table
+        local f, e, t = random(-2, n + 2), random(-2, n + 2), random(-2, n + 2)
+        table.move(a, f, e, t); table.move(b, f, e, t)
+      elseif op == 2 then   -- move to another table
+        local f, e, t = random(-2, n + 2), random(-2, n + 2), random(-2, 60)
+        table.move(a, f, e, t, a2); table.move(b, f, e, t, b2)
+      elseif op == 3 and #a == #b then
+        local p = random(#a + 1)
+        table.insert(a, p, {p}); table.insert(b, p, a[p])
+      elseif #a > 0 and #a == #b then
+        local p = random(#a)
+        assert(rawequal(table.remove(a, p), table.remove(b, p)))
+      end
+      collectgarbage("step", 0)
+    end
+    eq(a, b); eq(a2, b2)
+    if #a == #b and #a < 200 then
+      local t1, t2 = {table.unpack(a, 0, #a + 1)}, {table.unpack(b, 0, #b + 1)}
+      eq(t1, t2)
+    end
+  end
+  collectgarbage(oldmode)
+
+  -- growing the array part of the destination
+  local a = new(5000)
+  local b = table.move(a, 1, 5000, 1, {})
+  eq(a, b)
+  b = table.move(a, 1, 5000, 4001, b)
+  for i = 1, 9000 do
+    if i <= 4000 then assert(rawequal(b[i], a[i]))
+    else assert(rawequal(b[i], a[i - 4000]))
+    end
+  end
+  -- insert/remove at the front of large arrays
+  a = {}
+  for i = 1, 20000 do a[i] = i end
+  table.insert(a, 1, 0)
+  assert(#a == 20001 and a[1] == 0 and a[2] == 1 and a[20001] == 20000)
+  assert(table.remove(a, 1) == 0)
+  assert(#a == 20000 and a[1] == 1 and a[20000] == 20000 and a[20001] == nil)
+  assert(select("#", table.unpack(a, 1, 200)) == 200)
+
+  -- concatenation of large arrays
+  local s, t = {}, {}
+  for i = 1, 5000 do s[i] = tostring(i); t[i] = i end
+  local r = table.concat(s, ", ")
+  assert(r == table.concat(t, ", "))
+  assert(#r == #table.concat(s) + 2 * 4999)
+  assert(r:sub(1, 8) == "1, 2, 3," and r:sub(-10) == "4999, 5000")
+  assert(table.concat(s, "", 2, 4001) == table.concat(t, "", 2, 4001))
+  s[3000] = {}
+  checkerror("invalid value %(table%) at index 3000", table.concat, s)
+  s[3000] = nil
+  checkerror("invalid value %(nil%) at index 3000", table.concat, s, "",
+             1, 5000)
+end
+
+
+do print "testing vectors"
+  local mt = math.type
+  local N = 10000
+  collectgarbage()
+  local m = collectgarbage("count") * 1024
+  local v = table.vector("float", N)
+  local memdiff = collectgarbage("count") * 1024 - m
+  assert(memdiff >= N * 8 and memdiff < N * 9)
+  assert(#v == 0 and next(v) == nil and v[1] == nil)
+  for i = 1, N do v[i] = i / 2 end
+  assert(#v == N and v[N] == N / 2 and v[N + 1] == nil and v[0] == nil)
+  local s = 0
+  for i, x in ipairs(v) do assert(mt(x) == "float"); s = s + i end
+  assert(s == N * (N + 1) // 2)
+  s = 0
+  for k, x in pairs(v) do assert(x == k / 2); s = s + 1 end
+  assert(s == N)
+  v[N] = nil; v[N - 1] = nil   -- remove from the end
+  assert(#v == N - 2 and v[N - 1] == nil)
+  v[1] = 7.5
+  assert(v[1] == 7.5)
+
+  -- growth by appending
+  v = table.vector("integer")
+  for i = 1, 1000 do v[#v + 1] = i * 3 end
+  assert(#v == 1000 and v[1000] == 3000 and mt(v[500]) == "integer")
+  table.insert(v, 1, -1)
+  table.insert(v, 4)
+  assert(#v == 1002 and v[1] == -1 and v[2] == 3 and v[1002] == 4)
+  assert(table.remove(v, 1) == -1 and table.remove(v) == 4 and #v == 1000)
+  local w = table.move(v, 1, 1000, 11, table.vector("integer"))
+  -- 'w[1 .. 10]' are absent, so 'w' is no longer a vector
+  assert(w[10] == nil and w[11] == 3 and w[1010] == 3000)
+  w = table.move(v, 1, 1000, 1, table.vector("integer"))
+  assert(#w == 1000 and w[1] == 3 and w[1000] == 3000)
+  table.move(w, 1, 500, 3)
+  assert(w[1] == 3 and w[3] == 3 and w[502] == 1500 and w[503] == 1509)
+  table.move(v, 1, 3, 1001, w)
+  assert(#w == 1003 and w[1003] == 9)
+  assert(table.concat(table.move(v, 1, 4, 1, table.vector("integer")), ",")
+         == "3,6,9,12")
+  assert(select("#", table.unpack(v)) == 1000)
+
+  -- sorting
+  v = table.vector("float")
+  for i = 1, 5000 do v[i] = math.random() end
+  table.sort(v)
+  for i = 2, 5000 do assert(v[i - 1] <= v[i]) end
+  table.sort(v, function (a, b) return a > b end)
+  for i = 2, 5000 do assert(v[i - 1] >= v[i]) end
+
+  -- values with other types turn a vector into a regular table
+  local function degrade (f)
+    local v = table.vector("float")
+    for i = 1, 100 do v[i] = i + 0.5 end
+    f(v)
+    for i = 1, 100 do assert(v[i] == nil or v[i] == i + 0.5 or i == 50) end
+  end
+  degrade(function (v)
+    v[50] = 50; assert(mt(v[50]) == "integer" and #v == 100)
+  end)
+  degrade(function (v) v[50] = "x"; assert(v[50] == "x" and #v == 100) end)
+  degrade(function (v) v[50] = nil; assert(v[50] == nil and v[51] == 51.5) end)
+  degrade(function (v)
+    v.x = 1; v[200] = 2.5; v[-1] = 3.5; v[0.5] = 4.5
+    assert(v.x == 1 and v[200] == 2.5 and v[-1] == 3.5 and v[0.5] == 4.5)
+    assert(#v == 100)
+  end)
+
+  -- metamethods are called only for absent keys
+  local log = {}
+  v = setmetatable(table.vector("integer"), {__newindex = function (t, k, x)
+    log[#log + 1] = k; rawset(t, k, x)
+  end})
+  v[1] = 10; v[2] = 20; v[1] = 11; v[2] = "a"; v[3] = 30
+  assert(#log == 3 and log[1] == 1 and log[2] == 2 and log[3] == 3)
+  assert(v[1] == 11 and v[2] == "a" and v[3] == 30)
+
+  -- collection while building vectors
+  local oldmode = collectgarbage("incremental")
+  for round = 1, 100 do
+    if round == 50 then collectgarbage("generational") end
+    local t = {}
+    for i = 1, 20 do
+      t[i] = table.vector(i % 2 == 0 and "float" or "integer")
+      for j = 1, round do t[i][j] = (i % 2 == 0) and j / 1 or j end
+      collectgarbage("step", 0)
+    end
+    for i = 1, 20 do assert(#t[i] == round and t[i][round] == round) end
+  end
+  collectgarbage(oldmode)
+
+  checkerror("invalid option", table.vector, "string")
+  checkerror("bad argument #1", table.vector)
+  checkerror("out of range", table.vector, "float", -1)
+end
+
+
 print"testing sort"
 
 
@@ -336,4 +519,119 @@ table.sort(a)
 check(a, tt.__lt)
 check(a)
 
+
+do   print("testing sort of arrays of numbers or strings")
+  local random = math.random
+  -- sort 't' and compare with the generic sort
+  local function checksort (t)
+    local t1 = table.move(t, 1, #t, 1, {})
+    table.sort(t1, function (x, y) return x < y end)
+    table.sort(t)
+    for i = 1, #t do
+      assert(t[i] == t1[i] and math.type(t[i]) == math.type(t1[i]))
+    end
+    check(t)
+  end
+  local gens = {
+    function (i, n) return random(-1000, 1000) end,
+    function (i, n) return random(0) end,
+    function (i, n) return random(3) end,
+    function (i, n) return i end,
+    function (i, n) return n - i end,
+    function (i, n) return (i < n // 2) and i or n - i end,
+    function (i, n) return (i * 7919) % n end,
+  }
+  for k = 1, 200 do
+    local n = random(0, (k % 10 == 0) and limit // 10 or 200)
+    local g = gens[random(#gens)]
+    local ti, tf, ts = {}, {}, {}
+    for i = 1, n do
+      local v = g(i, n)
+      ti[i] = v
+      tf[i] = (random(10) == 1) and -v / 3 or v / 3
+      ts[i] = string.format("%x", v) .. ((random(4) == 1) and "\0" or "")
+    end
+    checksort(ti); checksort(tf); checksort(ts)
+  end
+  checksort{math.mininteger, math.maxinteger, 0, -1, 1, math.mininteger}
+  checksort{-math.huge, math.huge, -0.0, 0.0, -2^-1074, 2^-1074, 1e308}
+  checksort{"\0", "", "\255", "\0\0", "a\0b", "a", "a\0", "\128"}
+  -- -0.0 and 0.0 keep their signs
+  a = {0.0, -0.0, 0.0, -0.0}; table.sort(a)
+  local neg = 0
+  for i = 1, 4 do if 1/a[i] < 0 then neg = neg + 1 end end
+  assert(neg == 2)
+  -- mixed arrays and NaN go through the generic sort
+  checkerror("compare", table.sort, {1, 2, "x", 3})
+  checkerror("compare", table.sort, {"a", "b", 3})
+  a = {3, 1.5, 2, 0.5}; table.sort(a)
+  assert(a[1] == 0.5 and a[2] == 1.5 and a[3] == 2 and a[4] == 3)
+  assert(math.type(a[3]) == "integer")
+  a = {3, 2, 0/0, 1}; table.sort(a)   -- (result is unspecified)
+  -- tables with metatables go through the generic sort
+  a = setmetatable({3, 1, 2}, {__index = function () return 0 end})
+  table.sort(a); assert(a[1] == 1 and a[2] == 2 and a[3] == 3)
+end
+
+
+do   print("testing radix sort of large arrays of integers")
+  local random = math.random
+  local function checkints (n, lo, hi)
+    local t = {}
+    for i = 1, n do t[i] = lo and random(lo, hi) or random(0) end
+    local t1 = table.move(t, 1, n, 1, {})
+    table.sort(t1, function (x, y) return x < y end)
+    table.sort(t)
+    for i = 1, n do assert(t[i] == t1[i]) end
+  end
+  checkints(5000, 0, 10)
+  checkints(5000, -1000, 1000)
+  checkints(5000)   -- full range
+  checkints(5000, 1 << 40, (1 << 40) + 100000)
+  checkints(limit, 0, 1 << 24)
+  checkints(limit)
+end
+
+
+do   print("testing stable sort")
+  local random = math.random
+  -- elements are pairs {key, original position}
+  local function checkstable (n, m)
+    local t = {}
+    for i = 1, n do t[i] = {random(m), i} end
+    table.sort(t, function (x, y) return x[1] < y[1] end, "stable")
+    for i = 2, n do
+      local x, y = t[i - 1], t[i]
+      assert(x[1] < y[1] or (x[1] == y[1] and x[2] < y[2]))
+    end
+  end
+  for _, n in ipairs{0, 1, 2, 3, 7, 8, 9, 20, 100, 1000, limit} do
+    checkstable(n, 1); checkstable(n, 3); checkstable(n, n)
+  end
+  -- stable sort with no order function
+  a = {3, 1, 2, 1, 3, 0}
+  table.sort(a, nil, "stable")
+  check(a)
+  a = {0.0, -0.0, 1, -0.0, 0.0, 0.0}
+  table.sort(a, nil, "stable")
+  assert(1/a[1] > 0 and 1/a[2] < 0 and 1/a[3] < 0 and 1/a[4] > 0)
+  assert(1/a[5] > 0 and a[6] == 1)
+  a = {"b", "a", "c", "a"}
+  table.sort(a, nil, "stable")
+  check(a)
+  -- unstable sort is the default
+  a = {5, 4, 3}; table.sort(a, nil, "unstable"); check(a)
+  checkerror("invalid option", table.sort, {1, 2}, nil, "fast")
+  -- errors in the order function leave the array untouched
+  a = {}
+  for i = 1, 100 do a[i] = 101 - i end
+  local c = 0
+  checkerror("boom", table.sort, a, function (x, y)
+    c = c + 1
+    if c > 50 then error("boom") end
+    return x < y
+  end, "stable")
+  for i = 1, 100 do assert(a[i] == 101 - i) end
+end
+
 print"OK"
@@ -128,6 +128,42 @@ assert(string.reverse"\0001234" == "4321\0")
 
 for i=0,30 do assert(string.len(string.rep('a', i)) == i) end
 
+do   -- case conversion, reversal, and repetition in blocks
+  local all = {}
+  for c = 0, 255 do all[#all + 1] = string.char(c) end
+  all = table.concat(all)
+  local function lower (s)
+    return (string.gsub(s, "[A-Z]", function (c)
+      return string.char(string.byte(c) + 32) end))
+  end
+  local function upper (s)
+    return (string.gsub(s, "[a-z]", function (c)
+      return string.char(string.byte(c) - 32) end))
+  end
+  local function reverse (s)
+    local t = {}
+    for i = #s, 1, -1 do t[#t + 1] = string.sub(s, i, i) end
+    return table.concat(t)
+  end
+  for i = 1, 256, 7 do
+    for j = i - 1, 256, 5 do
+      local s = string.sub(all, i, j)
+      assert(string.lower(s) == lower(s) and string.upper(s) == upper(s))
+      assert(string.reverse(s) == reverse(s))
+    end
+  end
+  for _, l in ipairs{0, 1, 2, 3, 7, 16, 33} do
+    local s = string.sub(all, 60, 60 + l - 1)
+    for _, sep in ipairs{"", ",", "\0\1\2"} do
+      for n = 1, 70, 3 do
+        local t = {}
+        for i = 1, n do t[i] = s end
+        assert(string.rep(s, n, sep) == table.concat(t, sep))
+      end
+    end
+  end
+end
+
 assert(type(tostring(nil)) == 'string')
 assert(type(tostring(12)) == 'string')
 assert(string.find(tostring{}, 'table:'))
@@ -156,6 +192,63 @@ else   -- compatible coercion
   assert(tostring(-1203 + 0.0) == "-1203")
 end
 
+do   print("testing conversion of floats to strings")
+  -- numerals read back as the same float
+  local function check (x)
+    local s = tostring(x)
+    assert(tonumber(s) == x and math.type(tonumber(s)) == "float")
+    if x == 0 then assert(s == tostring(1/x < 0 and -0.0 or 0.0)) end
+  end
+  for _, x in ipairs{0.0, -0.0, 0.1, 1/3, 0.1 + 0.2, 2^53, 2^63, -2^63,
+                     1e15, 1e16, 1e-4, 1e-5, 1e22, 1e23, 1e300, 2^-1074,
+                     2^-1022, 2^-1022 - 2^-1074, 1.7976931348623157e308,
+                     -1.7976931348623157e308, 123456.789e10} do
+    check(x); check(-x)
+  end
+  local random = math.random
+  for i = 1, 20000 do
+    check(random() * 10.0^random(-30, 30))
+    local x = string.unpack("d", string.pack("i8", random(0)))
+    if x - x == 0 then check(x) end   -- finite?
+  end
+  for e = -1074, 1023 do check(2.0^e) end
+
+  if #tostring(0.1 + 0.7) == 18 and tostring(2^-1074) == "5e-324" then
+    -- shortest numerals, in the layout of "%.15g" or "%.17g"
+    assert(tostring(0.1 + 0.7) == "0.7999999999999999")
+    assert(tostring(0.1 + 0.2) == "0.30000000000000004")
+    assert(tostring(1e23) == "1e+23")
+    assert(tostring(2^63) == "9.223372036854776e+18")
+    assert(tostring(2^53) == "9007199254740992.0")
+    assert(tostring(2^-1074) == "5e-324")
+    assert(tostring(-1e-5) == "-1e-05")
+    assert(tostring(1234e-7) == "0.0001234")
+    assert(tostring(1e100) == "1e+100")
+    assert(tostring(1e15) == "1e+15" and tostring(1e14) == "100000000000000.0")
+    assert(tostring(123456789012345.0) == "123456789012345.0")
+    assert(tostring(1.2345678901234567e16) == "12345678901234568.0")
+    for i = 1, 5000 do
+      local x = random() * 10.0^random(-20, 20)
+      local k = 1   -- minimum number of digits for "%.kg" to read back
+      while tonumber(string.format("%." .. k .. "g", x)) ~= x do k = k + 1 end
+      local m = string.match(tostring(x), "^[^e]*")   -- significant digits
+      m = m:gsub("%D", ""):gsub("^0+", ""):gsub("0+$", "")
+      assert(#m <= k)
+      if k <= 15 then
+        assert(tostring(x):gsub("%.0$", "") == string.format("%.15g", x))
+      end
+    end
+  end
+  assert(tostring(math.mininteger) == "-9223372036854775808" or
+         math.mininteger ~= -2^63)
+  for i = 1, 1000 do
+    local n = random(0) >> random(0, 63)
+    assert(tostring(n) == string.format("%d", n))
+    assert(tostring(-n) == string.format("%d", -n))
+  end
+end
+
+
 
 local function topointer (s)
   return string.format("%p", s)
@@ -441,15 +534,20 @@ if not _port then
     assert("alo" < "lo" and "lo" < "amo")
   end
 
+  -- compiled patterns with classes depend on the locale
+  assert(string.gsub("\xE1\xE9", "%a", "x") == "\xE1\xE9")
+
   if trylocale("ctype") then
     assert(string.gsub("", "%a", "x") == "xxxxx")
     assert(string.gsub("", "%l", "x") == "xx")
     assert(string.gsub("", "%u", "x") == "xx")
     assert(string.upper"{xuxu}o" == "{XUXU}O")
+    assert(string.lower"{XUXU}O" == "{xuxu}o")
   end
 
   os.setlocale("C")
   assert(os.setlocale() == 'C')
+  assert(string.gsub("\xE1\xE9", "%a", "x") == "\xE1\xE9")
   assert(os.setlocale(nil, "numeric") == 'C')
 
 end
@@ -541,5 +639,104 @@ else
   assert(z == y)
 end
 
+if T then
+  print("testing quality of string hashes")
+  local nb = 1024   -- number of buckets (uses low bits, as the string table)
+  local function check (keys)
+    local seen, buckets, ncoll = {}, {}, 0
+    for i = 1, #keys do
+      local h = T.hash(keys[i]) & 0xffffffff
+      if seen[h] then ncoll = ncoll + 1 end
+      seen[h] = true
+      buckets[h % nb] = (buckets[h % nb] or 0) + 1
+    end
+    -- chi-square of bucket loads: mean 'nb - 1', deviation ~45
+    -- (the default hash does not spread these keys so well)
+    local mean, chi = #keys / nb, 0
+    for b = 0, nb - 1 do
+      chi = chi + ((buckets[b] or 0) - mean)^2 / mean
+    end
+    assert(not T.fasthash or chi < nb + 350)
+    -- full collisions: expected number is ~0.05 for 20000 keys
+    assert(not T.fasthash or ncoll <= 3)
+  end
+  local N = 20000
+  local t = {}
+  for i = 1, N do t[i] = "k" .. i end
+  check(t)
+  t = {}
+  for i = 1, N do t[i] = "user.profile.address.line" .. i end
+  check(t)
+  t = {}
+  for i = 1, N do t[i] = string.rep("x", 30) .. i end   -- common prefix
+  check(t)
+  t = {}
+  for i = 1, N do t[i] = string.format("%08x", i) end
+  check(t)
+  t = {}   -- keys that differ in a single byte
+  local base = string.rep("abcdefgh", 4)
+  local chars = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_."
+  for p = 1, #base do
+    for c = 1, #chars do
+      local ch = string.sub(chars, c, c)
+      if ch ~= string.sub(base, p, p) then
+        t[#t + 1] = string.sub(base, 1, p - 1) .. ch .. string.sub(base, p + 1)
+      end
+    end
+  end
+  check(t)
+end
+
+do  print("testing strings built by repeated concatenation")
+  local base = string.rep("x", 50)
+  local s = base
+  local parts = {}   -- keep all intermediate strings
+  for i = 1, 300 do
+    s = s .. i .. ";"
+    parts[i] = s
+  end
+  local t = {base}
+  for i = 1, 300 do   -- intermediate strings keep their contents
+    t[#t + 1] = i .. ";"
+    assert(parts[i] == table.concat(t))
+  end
+  assert(parts[10] < parts[11] and parts[11] > parts[10])
+  assert(parts[10] <= parts[10] and not (parts[11] <= parts[10]))
+  -- C functions see the end of each string
+  assert(string.sub(parts[5], -2) == "5;" and string.find(parts[5], "5;$"))
+  assert(#string.format("%s", parts[7]) == #parts[7])
+  -- extending the same string twice
+  local a = parts[3] .. "A" .. string.rep("a", 10)
+  local b = parts[3] .. "B"
+  assert(a ~= b and #a == #parts[3] + 11 and #b == #parts[3] + 1)
+  assert(string.sub(a, -11, -11) == "A" and string.sub(b, -1) == "B")
+  assert(parts[4] == parts[3] .. "4;")
+  local k = {}   -- as table keys
+  for i = 1, 300 do k[parts[i]] = i end
+  for i = 1, 300 do assert(k[parts[i]] == i) end
+  -- numerals that are extended afterwards
+  local n1 = string.rep(" ", 41) .. "12"
+  local n2 = n1 .. "34"
+  assert(math.abs(n1) == 12 and math.tointeger(n2 + 0) == 1234)
+  assert(string.rep("a", n1) == string.rep("a", 12))
+  assert(tonumber(n1) == 12 and tonumber(n2) == 1234)
+  -- '__name' that is extended afterwards
+  local name = string.rep("N", 41) .. "ame"
+  local name2 = name .. "X"
+  local obj = setmetatable({}, {__name = name})
+  local st, msg = pcall(function () return obj + 1 end)
+  assert(not st and string.find(msg, name .. " value", 1, true))
+  if T then   -- error objects in finalizers
+    local m = string.rep("@", 41) .. "expected@"
+    local m2 = m .. "!"
+    setmetatable({}, {__gc = function () error(m, 0) end})
+    warn("@on"); warn("@store")
+    collectgarbage()
+    assert(string.find(_WARN, "error in __gc (" .. m .. ")", 1, true))
+    _WARN = false
+    warn("@normal")
+  end
+end
+
 print('OK')
 
@@ -107,6 +107,8 @@ do    -- error indication in utf8.len
   local function checklen (s, p)
     local a, b = utf8.len(s)
     assert(not a and b == p)
+    a, b = utf8.valid(s)
+    assert(a == false and b == p)
   end
   checklen("abc\xE3def", 4)
   checklen("\xF4\x9F\xBF", 1)
@@ -192,7 +194,7 @@ checkerror("value out of range", utf8.char, -1)
 
 local function invalid (s)
   checkerror("invalid UTF%-8 code", utf8.codepoint, s)
-  assert(not utf8.len(s))
+  assert(not utf8.len(s) and not utf8.valid(s))
 end
 
 -- UTF-8 representation for 0x11ffff (value out of valid range)
@@ -265,5 +267,41 @@ for p, c in string.gmatch(x, "()(" .. utf8.charpattern .. ")") do
   end
 end
 
+do   print("testing long strings")   -- (checked in blocks)
+  assert(utf8.valid("") and utf8.valid(x) and utf8.valid(x, 4, 6))
+  assert(utf8.valid("\u{D800}", 1, -1, true) and not utf8.valid("\u{D800}"))
+  assert(utf8.valid("a\x80", 1, 1) and utf8.valid("a\x80", 3))
+  checkerror("out of bounds", utf8.valid, "abc", 0)
+  local chars = {"a", "\0", "é", "€", "𝄞", "\u{7FF}", "\u{800}",
+                 "\u{FFFF}", "\u{10000}", "\u{10FFFF}", "\u{D7FF}", "\u{E000}"}
+  local bad = {"\x80", "\xBF", "\xC0\x80", "\xC2", "\xE0\x9F\xBF",
+               "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xF5\x80\x80\x80",
+               "\xF0\x9D\x84", "\xFF", "\u{110000}"}
+  for k = 1, 400 do
+    local t = {}
+    for i = 1, math.random(0, 120) do
+      t[i] = chars[math.random(math.random(#chars))]
+    end
+    local s = table.concat(t)
+    assert(utf8.len(s) == #t and utf8.valid(s) and len(s) == #t)
+    local p = math.random(0, #t)   -- insert an error after 'p' characters
+    local pos = #table.concat(t, "", 1, p) + 1
+    local e = bad[math.random(#bad)]
+    local s1 = string.sub(s, 1, pos - 1) .. e .. string.sub(s, pos)
+    local a, b = utf8.len(s1)
+    assert(not a and b == pos)
+    a, b = utf8.valid(s1)
+    assert(a == false and b == pos)
+    assert(utf8.len(s1, 1, pos - 1) == p)   -- prefix is valid
+    assert(utf8.valid(s1, 1, pos - 1))
+    if utf8.len(e, 1, -1, true) then   -- valid in lax mode
+      assert(utf8.len(s1, 1, -1, true) == #t + utf8.len(e, 1, -1, true))
+    end
+    -- incomplete characters at the end
+    a, b = utf8.len(s .. "\xF0\x9D\x84")
+    assert(not a and b == #s + 1)
+  end
+end
+
 print'ok'
 